@@ -0,0 +1,266 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "blend.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+#if DWRITE_BLEND_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#elif DWRITE_BLEND_X86
+#include <cpuid.h>
+#endif
+
+void DWrite_GrayscaleBlendSpan_Scalar(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    const auto constants = DWrite_GetGrayscaleBlendConstants(params);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto alpha = static_cast<f32>(glyphAlpha[i]) * (1.0f / 255.0f);
+        const auto top = DWrite_GrayscaleBlend(constants, alpha);
+        dst[i] = DWrite_PackColor(DWrite_AlphaBlendPremultiplied(DWrite_UnpackColor(dst[i]), top));
+    }
+}
+
+void DWrite_CleartypeBlendSpan_Scalar(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    const auto constants = DWrite_GetCleartypeBlendConstants(params);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto glyph = DWrite_UnpackColor(glyphColor[i]);
+        const auto background = DWrite_UnpackColor(dst[i]);
+        dst[i] = DWrite_PackColor(DWrite_CleartypeBlend(constants, background, glyph));
+    }
+}
+
+// Indexed by DWrite_BlendIsa.
+static constexpr DWrite_BlendKernels s_kernels[]{
+    {
+        .grayscaleBlendSpan = DWrite_GrayscaleBlendSpan_Scalar,
+        .cleartypeBlendSpan = DWrite_CleartypeBlendSpan_Scalar,
+        .grayscaleBlendSpanFixed = DWrite_GrayscaleBlendSpanFixed_Scalar,
+        .cleartypeBlendSpanFixed = DWrite_CleartypeBlendSpanFixed_Scalar,
+        .grayscaleBlendSpanLut = DWrite_GrayscaleBlendSpanLut_Scalar,
+        .cleartypeBlendSpanLevels = DWrite_CleartypeBlendSpanLevels_Scalar,
+        .grayscaleBlendSpanScRgb = DWrite_GrayscaleBlendSpanScRgb_Scalar,
+        .cleartypeBlendSpanScRgb = DWrite_CleartypeBlendSpanScRgb_Scalar,
+        .packCleartypeCoverageSpan = DWrite_PackCleartypeCoverageSpan_Scalar,
+        .unpackCleartypeCoverageSpan = DWrite_UnpackCleartypeCoverageSpan_Scalar,
+        .cleartypeBlendSpanPacked = DWrite_CleartypeBlendSpanPacked_Scalar,
+    },
+#if DWRITE_BLEND_X86
+    {
+        .grayscaleBlendSpan = DWrite_GrayscaleBlendSpan_SSE41,
+        .cleartypeBlendSpan = DWrite_CleartypeBlendSpan_SSE41,
+        .grayscaleBlendSpanFixed = DWrite_GrayscaleBlendSpanFixed_Scalar,
+        .cleartypeBlendSpanFixed = DWrite_CleartypeBlendSpanFixed_Scalar,
+        .grayscaleBlendSpanLut = DWrite_GrayscaleBlendSpanLut_Scalar,
+        .cleartypeBlendSpanLevels = DWrite_CleartypeBlendSpanLevels_Scalar,
+        .grayscaleBlendSpanScRgb = DWrite_GrayscaleBlendSpanScRgb_Scalar,
+        .cleartypeBlendSpanScRgb = DWrite_CleartypeBlendSpanScRgb_Scalar,
+        .packCleartypeCoverageSpan = DWrite_PackCleartypeCoverageSpan_Scalar,
+        .unpackCleartypeCoverageSpan = DWrite_UnpackCleartypeCoverageSpan_Scalar,
+        .cleartypeBlendSpanPacked = DWrite_CleartypeBlendSpanPacked_Scalar,
+    },
+    {
+        .grayscaleBlendSpan = DWrite_GrayscaleBlendSpan_AVX2,
+        .cleartypeBlendSpan = DWrite_CleartypeBlendSpan_AVX2,
+        .grayscaleBlendSpanFixed = DWrite_GrayscaleBlendSpanFixed_AVX2,
+        .cleartypeBlendSpanFixed = DWrite_CleartypeBlendSpanFixed_AVX2,
+        .grayscaleBlendSpanLut = DWrite_GrayscaleBlendSpanLut_AVX2,
+        .cleartypeBlendSpanLevels = DWrite_CleartypeBlendSpanLevels_AVX2,
+        .grayscaleBlendSpanScRgb = DWrite_GrayscaleBlendSpanScRgb_AVX2,
+        .cleartypeBlendSpanScRgb = DWrite_CleartypeBlendSpanScRgb_AVX2,
+        .packCleartypeCoverageSpan = DWrite_PackCleartypeCoverageSpan_AVX2,
+        .unpackCleartypeCoverageSpan = DWrite_UnpackCleartypeCoverageSpan_AVX2,
+        .cleartypeBlendSpanPacked = DWrite_CleartypeBlendSpanPacked_AVX2,
+    },
+    {
+        .grayscaleBlendSpan = DWrite_GrayscaleBlendSpan_AVX512,
+        .cleartypeBlendSpan = DWrite_CleartypeBlendSpan_AVX512,
+        .grayscaleBlendSpanFixed = DWrite_GrayscaleBlendSpanFixed_AVX2,
+        .cleartypeBlendSpanFixed = DWrite_CleartypeBlendSpanFixed_AVX2,
+        .grayscaleBlendSpanLut = DWrite_GrayscaleBlendSpanLut_AVX2,
+        .cleartypeBlendSpanLevels = DWrite_CleartypeBlendSpanLevels_AVX2,
+        .grayscaleBlendSpanScRgb = DWrite_GrayscaleBlendSpanScRgb_AVX2,
+        .cleartypeBlendSpanScRgb = DWrite_CleartypeBlendSpanScRgb_AVX2,
+        .packCleartypeCoverageSpan = DWrite_PackCleartypeCoverageSpan_AVX2,
+        .unpackCleartypeCoverageSpan = DWrite_UnpackCleartypeCoverageSpan_AVX2,
+        .cleartypeBlendSpanPacked = DWrite_CleartypeBlendSpanPacked_AVX2,
+    },
+#endif
+};
+
+static std::atomic<const DWrite_BlendKernels*> s_activeKernels{ nullptr };
+
+static DWrite_BlendIsa detectBlendIsa() noexcept
+{
+#if DWRITE_BLEND_X86
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(&info[0], 0);
+    const auto maxLeaf = info[0];
+
+    __cpuid(&info[0], 1);
+    const auto sse41 = (info[2] & (1 << 19)) != 0;
+    const auto fma = (info[2] & (1 << 12)) != 0;
+    const auto f16c = (info[2] & (1 << 29)) != 0;
+    const auto osxsave = (info[2] & (1 << 27)) != 0;
+
+    auto avx2 = false;
+    auto avx512 = false;
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(&info[0], 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+        // AVX512F, AVX512BW and AVX512VL
+        avx512 = (info[1] & 0xC0010000) == 0xC0010000;
+    }
+
+    // The CPU supporting AVX isn't enough: The OS must also save the YMM/ZMM registers on context switches.
+    const auto xcr0 = osxsave ? _xgetbv(0) : 0;
+    // Every AVX2 CPU also supports F16C, but virtual machines can hide individual features.
+    avx2 = avx2 && fma && f16c && (xcr0 & 0x06) == 0x06;
+    avx512 = avx512 && avx2 && (xcr0 & 0xe6) == 0xe6;
+#else
+    __builtin_cpu_init();
+    const bool sse41 = __builtin_cpu_supports("sse4.1");
+    // Not every GCC version knows "f16c" for __builtin_cpu_supports, so we ask CPUID directly.
+    unsigned eax, ebx, ecx, edx;
+    const bool f16c = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_F16C) != 0;
+    const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && f16c;
+    const bool avx512 = avx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl");
+#endif
+
+    if (avx512)
+    {
+        return DWrite_BlendIsa::AVX512;
+    }
+    if (avx2)
+    {
+        return DWrite_BlendIsa::AVX2;
+    }
+    if (sse41)
+    {
+        return DWrite_BlendIsa::SSE41;
+    }
+#endif
+    return DWrite_BlendIsa::Scalar;
+}
+
+static DWrite_BlendIsa getBlendIsaFromEnvironment(DWrite_BlendIsa fallback) noexcept
+{
+    static constexpr const char* names[]{ "scalar", "sse41", "avx2", "avx512" };
+
+#pragma warning(suppress : 4996) // 'getenv': This function or variable may be unsafe.
+    const auto value = getenv("DWRITE_BLEND_ISA");
+    if (value)
+    {
+        for (u32 i = 0; i < std::size(names); ++i)
+        {
+            if (strcmp(value, names[i]) == 0)
+            {
+                return static_cast<DWrite_BlendIsa>(i);
+            }
+        }
+    }
+
+    return fallback;
+}
+
+static const DWrite_BlendKernels& activeBlendKernels() noexcept
+{
+    auto kernels = s_activeKernels.load(std::memory_order_relaxed);
+    if (!kernels) [[unlikely]]
+    {
+        // Racing threads all arrive at the same result, so this doesn't need a lock.
+        kernels = &DWrite_GetBlendKernels(getBlendIsaFromEnvironment(DWrite_GetSupportedBlendIsa()));
+        s_activeKernels.store(kernels, std::memory_order_relaxed);
+    }
+    return *kernels;
+}
+
+DWrite_BlendIsa DWrite_GetSupportedBlendIsa() noexcept
+{
+    static const auto isa = detectBlendIsa();
+    return isa;
+}
+
+DWrite_BlendIsa DWrite_GetBlendIsa() noexcept
+{
+    return static_cast<DWrite_BlendIsa>(&activeBlendKernels() - &s_kernels[0]);
+}
+
+DWrite_BlendIsa DWrite_SetBlendIsa(DWrite_BlendIsa isa) noexcept
+{
+    const auto& kernels = DWrite_GetBlendKernels(isa);
+    s_activeKernels.store(&kernels, std::memory_order_relaxed);
+    return static_cast<DWrite_BlendIsa>(&kernels - &s_kernels[0]);
+}
+
+const DWrite_BlendKernels& DWrite_GetBlendKernels(DWrite_BlendIsa isa) noexcept
+{
+    const auto supported = DWrite_GetSupportedBlendIsa();
+    return s_kernels[static_cast<u32>(isa < supported ? isa : supported)];
+}
+
+void DWrite_GrayscaleBlendSpan(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    activeBlendKernels().grayscaleBlendSpan(params, glyphAlpha, dst, count);
+}
+
+void DWrite_CleartypeBlendSpan(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    activeBlendKernels().cleartypeBlendSpan(params, glyphColor, dst, count);
+}
+
+void DWrite_GrayscaleBlendSpanFixed(const DWrite_FixedBlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    activeBlendKernels().grayscaleBlendSpanFixed(params, glyphAlpha, dst, count);
+}
+
+void DWrite_CleartypeBlendSpanFixed(const DWrite_FixedBlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    activeBlendKernels().cleartypeBlendSpanFixed(params, glyphColor, dst, count);
+}
+
+void DWrite_GrayscaleBlendSpanLut(const DWrite_GrayscaleLut& lut, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    activeBlendKernels().grayscaleBlendSpanLut(lut, glyphAlpha, dst, count);
+}
+
+void DWrite_CleartypeBlendSpanLevels(const DWrite_CleartypeLevelTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    activeBlendKernels().cleartypeBlendSpanLevels(table, glyphColor, dst, count);
+}
+
+void DWrite_GrayscaleBlendSpanScRgb(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u8* glyphAlpha, f16x4* dst, size_t count) noexcept
+{
+    activeBlendKernels().grayscaleBlendSpanScRgb(params, sdrWhiteLevel, glyphAlpha, dst, count);
+}
+
+void DWrite_CleartypeBlendSpanScRgb(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u32* glyphColor, f16x4* dst, size_t count) noexcept
+{
+    activeBlendKernels().cleartypeBlendSpanScRgb(params, sdrWhiteLevel, glyphColor, dst, count);
+}
+
+void DWrite_PackCleartypeCoverageSpan(const u32* src, u16* dst, size_t count) noexcept
+{
+    activeBlendKernels().packCleartypeCoverageSpan(src, dst, count);
+}
+
+void DWrite_UnpackCleartypeCoverageSpan(const u16* src, u32* dst, size_t count) noexcept
+{
+    activeBlendKernels().unpackCleartypeCoverageSpan(src, dst, count);
+}
+
+void DWrite_CleartypeBlendSpanPacked(const DWrite_CleartypeLevelTable& table, const u16* glyph, u32* dst, size_t count) noexcept
+{
+    activeBlendKernels().cleartypeBlendSpanPacked(table, glyph, dst, count);
+}
@@ -0,0 +1,584 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+
+#include "dwrite.h"
+#include "dwrite_math.h"
+#include "util.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DWRITE_BLEND_X86 1
+#else
+#define DWRITE_BLEND_X86 0
+#endif
+
+// The SIMD kernels are compiled without any special compiler flags, so that the inline functions
+// in this header don't get compiled with instructions that the CPU might not support.
+// MSVC allows the use of any intrinsic anyway, but GCC and clang need to be told per function.
+#if defined(__GNUC__) || defined(__clang__)
+#define DWRITE_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define DWRITE_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define DWRITE_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c")))
+#define DWRITE_FORCEINLINE inline __attribute__((always_inline))
+#else
+#define DWRITE_TARGET_SSE41
+#define DWRITE_TARGET_AVX2
+#define DWRITE_TARGET_AVX512
+#define DWRITE_FORCEINLINE __forceinline
+#endif
+
+// This is a CPU port of dwrite.hlsl. The per-pixel functions below are 1:1 translations of their
+// HLSL counterparts (same names, same order of operations) and should be kept in sync with them.
+// The *Span() functions at the bottom apply them to entire rows of pixels, which allows you
+// to composite text without a GPU, for instance for headless rendering or for testing.
+//
+// Unless noted otherwise, all colors are premultiplied and in the same color space as your shader would see them.
+// Pixel buffers use the same layout as DXGI_FORMAT_B8G8R8A8_UNORM (a u32 of 0xAARRGGBB on little endian)
+// and DXGI_FORMAT_A8_UNORM (a u8) respectively.
+
+// DWrite_Saturate(), DWrite_UnpremultiplyColor(), DWrite_ApplyLightOnDarkContrastAdjustment() and
+// DWrite_CalcColorIntensity() are in dwrite_math.h, because dwrite.cpp needs them too.
+
+inline f32 DWrite_EnhanceContrast(f32 alpha, f32 k) noexcept
+{
+    return alpha * (k + 1.0f) / (alpha * k + 1.0f);
+}
+
+inline f32x3 DWrite_EnhanceContrast3(const f32x3& alpha, f32 k) noexcept
+{
+    return {
+        DWrite_EnhanceContrast(alpha.r, k),
+        DWrite_EnhanceContrast(alpha.g, k),
+        DWrite_EnhanceContrast(alpha.b, k),
+    };
+}
+
+inline f32 DWrite_ApplyAlphaCorrection(f32 a, f32 f, const f32x4& g) noexcept
+{
+    return a + a * (1 - a) * ((g.x * f + g.y) * a + (g.z * f + g.w));
+}
+
+inline f32x3 DWrite_ApplyAlphaCorrection3(const f32x3& a, const f32x3& f, const f32x4& g) noexcept
+{
+    return {
+        DWrite_ApplyAlphaCorrection(a.r, f.r, g),
+        DWrite_ApplyAlphaCorrection(a.g, f.g, g),
+        DWrite_ApplyAlphaCorrection(a.b, f.b, g),
+    };
+}
+
+// See DWrite_GrayscaleBlend in dwrite.hlsl for documentation.
+inline f32x4 DWrite_GrayscaleBlend(const f32x4& gammaRatios, f32 grayscaleEnhancedContrast, bool isThinFont, const f32x4& foregroundColor, f32 glyphAlpha) noexcept
+{
+    const auto foregroundStraight = DWrite_UnpremultiplyColor(foregroundColor);
+    const auto contrastBoost = isThinFont ? 0.5f : 0.0f;
+    const auto blendEnhancedContrast = contrastBoost + DWrite_ApplyLightOnDarkContrastAdjustment(grayscaleEnhancedContrast, foregroundStraight);
+    const auto intensity = DWrite_CalcColorIntensity({ foregroundColor.r, foregroundColor.g, foregroundColor.b });
+    const auto contrasted = DWrite_EnhanceContrast(glyphAlpha, blendEnhancedContrast);
+    const auto alphaCorrected = DWrite_ApplyAlphaCorrection(contrasted, intensity, gammaRatios);
+    return {
+        foregroundColor.r * alphaCorrected,
+        foregroundColor.g * alphaCorrected,
+        foregroundColor.b * alphaCorrected,
+        foregroundColor.a * alphaCorrected,
+    };
+}
+
+// See DWrite_CleartypeBlend in dwrite.hlsl for documentation.
+inline f32x4 DWrite_CleartypeBlend(const f32x4& gammaRatios, f32 enhancedContrast, bool isThinFont, const f32x4& backgroundColor, const f32x4& foregroundColor, const f32x4& glyphColor) noexcept
+{
+    const auto foregroundStraight = DWrite_UnpremultiplyColor(foregroundColor);
+    const auto contrastBoost = isThinFont ? 0.5f : 0.0f;
+    const auto blendEnhancedContrast = contrastBoost + DWrite_ApplyLightOnDarkContrastAdjustment(enhancedContrast, foregroundStraight);
+    const auto contrasted = DWrite_EnhanceContrast3({ glyphColor.r, glyphColor.g, glyphColor.b }, blendEnhancedContrast);
+    const auto alphaCorrected = DWrite_ApplyAlphaCorrection3(contrasted, foregroundStraight, gammaRatios);
+    // lerp(x, y, s) = x + s * (y - x)
+    return {
+        backgroundColor.r + alphaCorrected.r * foregroundColor.a * (foregroundStraight.r - backgroundColor.r),
+        backgroundColor.g + alphaCorrected.g * foregroundColor.a * (foregroundStraight.g - backgroundColor.g),
+        backgroundColor.b + alphaCorrected.b * foregroundColor.a * (foregroundStraight.b - backgroundColor.b),
+        1.0f,
+    };
+}
+
+// DWrite_GrayscaleBlend with the per-color math precomputed by DWrite_GetGrayscaleBlendConstants().
+// What's left per pixel is DWrite_EnhanceContrast and DWrite_ApplyAlphaCorrection.
+inline f32x4 DWrite_GrayscaleBlend(const DWrite_BlendConstants& c, f32 glyphAlpha) noexcept
+{
+    const auto contrasted = glyphAlpha * c.contrast[1] / (glyphAlpha * c.contrast[0] + 1.0f);
+    const auto alphaCorrected = contrasted + contrasted * (1 - contrasted) * (c.gamma0[0] * contrasted + c.gamma1[0]);
+    return {
+        c.color[0] * alphaCorrected,
+        c.color[1] * alphaCorrected,
+        c.color[2] * alphaCorrected,
+        c.color[3] * alphaCorrected,
+    };
+}
+
+// DWrite_CleartypeBlend with the per-color math precomputed by DWrite_GetCleartypeBlendConstants().
+inline f32x4 DWrite_CleartypeBlend(const DWrite_BlendConstants& c, const f32x4& backgroundColor, const f32x4& glyphColor) noexcept
+{
+    const auto channel = [&](int i, f32 alpha, f32 background) noexcept {
+        const auto contrasted = alpha * c.contrast[1] / (alpha * c.contrast[0] + 1.0f);
+        const auto alphaCorrected = contrasted + contrasted * (1 - contrasted) * (c.gamma0[i] * contrasted + c.gamma1[i]);
+        return background + alphaCorrected * c.color[3] * (c.color[i] - background);
+    };
+    return {
+        channel(0, glyphColor.r, backgroundColor.r),
+        channel(1, glyphColor.g, backgroundColor.g),
+        channel(2, glyphColor.b, backgroundColor.b),
+        1.0f,
+    };
+}
+
+// The per-pixel blends for a linear scRGB target. See DWrite_GrayscaleBlendScRgb in dwrite.hlsl for documentation.
+inline f32x4 DWrite_GrayscaleBlendScRgb(const DWrite_BlendConstants& c, f32 sdrWhiteLevel, const f32x4& backgroundColor, f32 glyphAlpha) noexcept
+{
+    const auto top = DWrite_GrayscaleBlend(c, glyphAlpha);
+    const auto ia = 1 - top.a;
+    return {
+        backgroundColor.r * ia + top.r * sdrWhiteLevel,
+        backgroundColor.g * ia + top.g * sdrWhiteLevel,
+        backgroundColor.b * ia + top.b * sdrWhiteLevel,
+        backgroundColor.a * ia + top.a,
+    };
+}
+
+inline f32x4 DWrite_CleartypeBlendScRgb(const DWrite_BlendConstants& c, f32 sdrWhiteLevel, const f32x4& backgroundColor, const f32x4& glyphColor) noexcept
+{
+    const auto channel = [&](int i, f32 alpha, f32 background) noexcept {
+        const auto contrasted = alpha * c.contrast[1] / (alpha * c.contrast[0] + 1.0f);
+        const auto alphaCorrected = contrasted + contrasted * (1 - contrasted) * (c.gamma0[i] * contrasted + c.gamma1[i]);
+        return background + alphaCorrected * c.color[3] * (c.color[i] * sdrWhiteLevel - background);
+    };
+    return {
+        channel(0, glyphColor.r, backgroundColor.r),
+        channel(1, glyphColor.g, backgroundColor.g),
+        channel(2, glyphColor.b, backgroundColor.b),
+        1.0f,
+    };
+}
+
+// Same as alphaBlendPremultiplied() in main_ps.hlsl.
+inline f32x4 DWrite_AlphaBlendPremultiplied(const f32x4& bottom, const f32x4& top) noexcept
+{
+    const auto ia = 1 - top.a;
+    return {
+        bottom.r * ia + top.r,
+        bottom.g * ia + top.g,
+        bottom.b * ia + top.b,
+        bottom.a * ia + top.a,
+    };
+}
+
+// The sRGB transfer functions (IEC 61966-2-1), as used by DXGI_FORMAT_B8G8R8A8_UNORM_SRGB.
+inline f32 DWrite_SrgbToLinear(f32 c) noexcept
+{
+    return c <= 0.04045f ? c * (1.0f / 12.92f) : std::pow((c + 0.055f) * (1.0f / 1.055f), 2.4f);
+}
+
+inline f32 DWrite_LinearToSrgb(f32 c) noexcept
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// Conversions between DXGI_FORMAT_B8G8R8A8_UNORM pixels and f32x4 colors.
+// Float to UNORM conversions round to nearest, like the D3D11 specification requires.
+inline f32x4 DWrite_UnpackColor(u32 bgra) noexcept
+{
+    return {
+        static_cast<f32>((bgra >> 16) & 0xff) * (1.0f / 255.0f),
+        static_cast<f32>((bgra >> 8) & 0xff) * (1.0f / 255.0f),
+        static_cast<f32>(bgra & 0xff) * (1.0f / 255.0f),
+        static_cast<f32>(bgra >> 24) * (1.0f / 255.0f),
+    };
+}
+
+inline u32 DWrite_PackColor(const f32x4& color) noexcept
+{
+    const auto r = static_cast<u32>(DWrite_Saturate(color.r) * 255.0f + 0.5f);
+    const auto g = static_cast<u32>(DWrite_Saturate(color.g) * 255.0f + 0.5f);
+    const auto b = static_cast<u32>(DWrite_Saturate(color.b) * 255.0f + 0.5f);
+    const auto a = static_cast<u32>(DWrite_Saturate(color.a) * 255.0f + 0.5f);
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+// The parameters shared by all span functions. They mirror the ConstantBuffer in main.cpp.
+struct DWrite_BlendParams
+{
+    // The output of DWrite_GetGammaRatiosForEncodedTarget() or DWrite_GetGammaRatiosForLinearTarget().
+    f32 gammaRatios[4]{};
+    // The outputs of DWrite_GetRenderParams().
+    f32 cleartypeEnhancedContrast = 0.5f;
+    f32 grayscaleEnhancedContrast = 1.0f;
+    // See DWrite_IsThinFontFamily().
+    bool isThinFont = false;
+    // The text color (premultiplied).
+    f32x4 foregroundColor;
+};
+
+// DWrite_GetGrayscaleBlendConstants() and DWrite_GetCleartypeBlendConstants() for the given params.
+inline DWrite_BlendConstants DWrite_GetGrayscaleBlendConstants(const DWrite_BlendParams& params) noexcept
+{
+    const auto& fg = params.foregroundColor;
+    const f32 foregroundColor[4]{ fg.r, fg.g, fg.b, fg.a };
+    DWrite_BlendConstants c;
+    DWrite_GetGrayscaleBlendConstants(params.gammaRatios, params.grayscaleEnhancedContrast, params.isThinFont, foregroundColor, c);
+    return c;
+}
+
+inline DWrite_BlendConstants DWrite_GetCleartypeBlendConstants(const DWrite_BlendParams& params) noexcept
+{
+    const auto& fg = params.foregroundColor;
+    const f32 foregroundColor[4]{ fg.r, fg.g, fg.b, fg.a };
+    DWrite_BlendConstants c;
+    DWrite_GetCleartypeBlendConstants(params.gammaRatios, params.cleartypeEnhancedContrast, params.isThinFont, foregroundColor, c);
+    return c;
+}
+
+// Blends a row of grayscale anti-aliased glyph coverage (A8) into a premultiplied B8G8R8A8 destination:
+//   dst = alphaBlendPremultiplied(dst, DWrite_GrayscaleBlend(..., glyphAlpha[i]))
+// This is what main_ps.hlsl does in the "DWrite Grayscale" mode.
+//
+// This function forwards to the fastest implementation the CPU supports. See DWrite_SetBlendIsa().
+void DWrite_GrayscaleBlendSpan(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+
+// Blends a row of ClearType glyph coverage (B8G8R8A8, alpha is ignored) into an opaque B8G8R8A8 destination:
+//   dst = DWrite_CleartypeBlend(..., dst, ..., glyphColor[i])
+// This is what main_ps.hlsl does in the "DWrite ClearType" mode.
+//
+// This function forwards to the fastest implementation the CPU supports. See DWrite_SetBlendIsa().
+void DWrite_CleartypeBlendSpan(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept;
+
+// The instruction set tiers the span functions are implemented for, from slowest to fastest.
+// Each tier is guaranteed to produce results within 1 LSB of the Scalar one.
+enum class DWrite_BlendIsa : u32
+{
+    Scalar, // Plain C++, calling the functions above for every pixel. This is the reference implementation.
+    SSE41, // 4 pixels per iteration.
+    AVX2, // 8 pixels per iteration. Requires AVX2 and FMA.
+    AVX512, // 16 pixels per iteration. Requires AVX-512 F, BW and VL.
+};
+
+struct DWrite_FixedBlendParams;
+struct DWrite_GrayscaleLut;
+struct DWrite_CleartypeLevelTable;
+
+// The function-pointer table used by the dispatching span functions. color.h, palette.h and diff.h
+// have their own tables, which follow the tier picked here.
+struct DWrite_BlendKernels
+{
+    void (*grayscaleBlendSpan)(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+    void (*cleartypeBlendSpan)(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept;
+    // The fixed-point pipeline only has a Scalar and an AVX2 implementation. The other tiers use the closest one.
+    void (*grayscaleBlendSpanFixed)(const DWrite_FixedBlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+    void (*cleartypeBlendSpanFixed)(const DWrite_FixedBlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept;
+    // Same for the table-based blends.
+    void (*grayscaleBlendSpanLut)(const DWrite_GrayscaleLut& lut, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+    void (*cleartypeBlendSpanLevels)(const DWrite_CleartypeLevelTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept;
+    // The scRGB blends. Scalar and AVX2 (F16C) only.
+    void (*grayscaleBlendSpanScRgb)(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u8* glyphAlpha, f16x4* dst, size_t count) noexcept;
+    void (*cleartypeBlendSpanScRgb)(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u32* glyphColor, f16x4* dst, size_t count) noexcept;
+    // The packed ClearType coverage functions. Scalar and AVX2 only.
+    void (*packCleartypeCoverageSpan)(const u32* src, u16* dst, size_t count) noexcept;
+    void (*unpackCleartypeCoverageSpan)(const u16* src, u32* dst, size_t count) noexcept;
+    void (*cleartypeBlendSpanPacked)(const DWrite_CleartypeLevelTable& table, const u16* glyph, u32* dst, size_t count) noexcept;
+};
+
+// Returns the fastest tier the current CPU (and OS) supports. CPUID is only queried once.
+DWrite_BlendIsa DWrite_GetSupportedBlendIsa() noexcept;
+// Returns the tier the dispatching span functions currently use.
+// On the first call this is DWrite_GetSupportedBlendIsa(), unless the DWRITE_BLEND_ISA environment
+// variable is set to one of "scalar", "sse41", "avx2" or "avx512", which is useful for benchmarking.
+DWrite_BlendIsa DWrite_GetBlendIsa() noexcept;
+// Forces the dispatching span functions (including those of color.h, palette.h and diff.h) to use the given tier,
+// for instance for benchmarking or to bisect regressions. Tiers that the CPU doesn't support are clamped to
+// DWrite_GetSupportedBlendIsa().
+// Returns the tier that is now in use.
+DWrite_BlendIsa DWrite_SetBlendIsa(DWrite_BlendIsa isa) noexcept;
+// Returns the kernels for the given tier. The tier is clamped like in DWrite_SetBlendIsa().
+const DWrite_BlendKernels& DWrite_GetBlendKernels(DWrite_BlendIsa isa) noexcept;
+
+// The individual implementations. Unless you want to compare them,
+// you should use the dispatching functions above instead.
+void DWrite_GrayscaleBlendSpan_Scalar(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpan_Scalar(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept;
+#if DWRITE_BLEND_X86
+void DWrite_GrayscaleBlendSpan_SSE41(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpan_SSE41(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept;
+void DWrite_GrayscaleBlendSpan_AVX2(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpan_AVX2(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept;
+void DWrite_GrayscaleBlendSpan_AVX512(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpan_AVX512(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept;
+#endif
+
+// A fixed-point variant of the span functions. All math happens in 16-bit integer lanes,
+// which means that an AVX2 register holds 16 values instead of 8. The only division in the
+// algorithm, DWrite_EnhanceContrast, is turned into a 256-entry table per foreground color.
+//
+// Numbers in the range [-2, 2) are stored in Q2.14, because the alpha correction is signed
+// and can overshoot [0, 1]. Color channels are stored as 0-255 in 8.6 fixed point.
+// Use DWrite_MeasureFixedBlendAccuracy to see how much this deviates from the float version.
+//
+// Despite the wider lanes this is not the fast path: the contrast tables are read with gathers, and the pixels
+// have to be widened to 16-bit lanes and packed back, which costs more than the float version's divisions.
+// On a Xeon with AVX-512, tests/fixed_blend_bench measured the AVX2 version at 0.80 Gpx/s vs. 1.18 for the
+// float one for grayscale and 0.73 vs. 0.83 for ClearType, and the SSE41 tier falls back to the Scalar version.
+// Prefer the float span functions, unless you measured otherwise on your target hardware.
+struct DWrite_FixedBlendParams
+{
+    // DWrite_EnhanceContrast() for every 8-bit coverage value in Q2.14. These are i32 so that SIMD code can gather from them.
+    alignas(64) i32 grayscaleContrast[256];
+    alignas(64) i32 cleartypeContrast[256];
+    // The alpha correction's {gammaRatios.x * f + gammaRatios.y, gammaRatios.z * f + gammaRatios.w} in Q2.14.
+    // For grayscale, f is the color intensity and for ClearType it's the straight color per channel (b, g, r).
+    i16 grayscaleGamma[2];
+    i16 cleartypeGamma[3][2];
+    // The premultiplied foreground color (b, g, r, a) and the straight one (b, g, r) in 8.6.
+    i16 foreground[4];
+    i16 foregroundStraight[3];
+    // The foreground alpha in Q2.14.
+    i16 foregroundAlpha;
+};
+
+// Prepares the fixed-point parameters. This performs 512 divisions, so you should do this once per foreground color.
+void DWrite_GetFixedBlendParams(const DWrite_BlendParams& params, DWrite_FixedBlendParams& out) noexcept;
+
+// Fixed-point versions of DWrite_GrayscaleBlendSpan and DWrite_CleartypeBlendSpan.
+// They forward to the implementation picked by DWrite_SetBlendIsa(), all of which produce bit-identical results.
+void DWrite_GrayscaleBlendSpanFixed(const DWrite_FixedBlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanFixed(const DWrite_FixedBlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept;
+
+void DWrite_GrayscaleBlendSpanFixed_Scalar(const DWrite_FixedBlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanFixed_Scalar(const DWrite_FixedBlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept;
+#if DWRITE_BLEND_X86
+void DWrite_GrayscaleBlendSpanFixed_AVX2(const DWrite_FixedBlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanFixed_AVX2(const DWrite_FixedBlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept;
+#endif
+
+// How far the fixed-point results are off from the float ones, in 8-bit steps (LSB) per color channel.
+struct DWrite_FixedBlendAccuracy
+{
+    u64 samples = 0;
+    u32 maxError = 0;
+    f32 meanError = 0;
+    // histogram[i] counts the channels that are off by i LSB. The last bucket counts everything >= 3.
+    u64 histogram[4]{};
+};
+
+// Compares the fixed-point against the float implementation for the given parameters by blending every
+// possible coverage value against a range of backgrounds (opaque and translucent grays for grayscale,
+// opaque grays for ClearType, with each subpixel channel's coverage varied independently).
+DWrite_FixedBlendAccuracy DWrite_MeasureFixedBlendAccuracy(const DWrite_BlendParams& params, bool cleartype) noexcept;
+
+// For a given set of DWrite_BlendParams, DWrite_GrayscaleBlend() maps each of the 256 possible
+// coverage values to exactly one output. This table caches that mapping, which turns the per-pixel
+// work into a table lookup plus one multiply-add per channel, without any divisions.
+struct DWrite_GrayscaleLut
+{
+    // DWrite_ApplyAlphaCorrection(DWrite_EnhanceContrast(coverage / 255, ...), ...) for every coverage value.
+    alignas(64) f32 corrected[256];
+    // 1 - foregroundColor.a * corrected[i], which is the weight of the destination in alphaBlendPremultiplied().
+    alignas(64) f32 inverseAlpha[256];
+    // The premultiplied foreground color the table was built for.
+    f32x4 foregroundColor;
+};
+
+// Builds the table for the given parameters. This costs about as much as blending 256 pixels with DWrite_GrayscaleBlendSpan_Scalar.
+void DWrite_BuildGrayscaleLut(const DWrite_BlendParams& params, DWrite_GrayscaleLut& out) noexcept;
+
+// Same as DWrite_GrayscaleBlendSpan, but using a prebuilt table. The results are identical to the Scalar
+// implementation of DWrite_GrayscaleBlendSpan and within 1 LSB for the SIMD ones.
+// This forwards to the implementation picked by DWrite_SetBlendIsa().
+void DWrite_GrayscaleBlendSpanLut(const DWrite_GrayscaleLut& lut, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+
+void DWrite_GrayscaleBlendSpanLut_Scalar(const DWrite_GrayscaleLut& lut, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+#if DWRITE_BLEND_X86
+void DWrite_GrayscaleBlendSpanLut_AVX2(const DWrite_GrayscaleLut& lut, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+#endif
+
+// A small cache of DWrite_GrayscaleLut tables, keyed by foreground color. Terminals and editors
+// typically only use a handful of colors, so this lets them pay for building a table once per color.
+// The gamma ratios, contrast and thin font flag are expected to change rarely (e.g. on DPI or
+// settings changes) and doing so flushes the entire cache.
+//
+// The cache isn't thread-safe. Use one per thread (or per render target) instead.
+struct DWrite_GrayscaleLutCache
+{
+    static constexpr u32 capacity = 8;
+
+    // The parameters the cached tables were built for, apart from the foreground color.
+    f32 gammaRatios[4]{};
+    f32 grayscaleEnhancedContrast = 0;
+    bool isThinFont = false;
+
+    DWrite_GrayscaleLut entries[capacity];
+    // The value of `clock` when the entry was last used. 0 marks an empty entry.
+    u64 lastUsed[capacity]{};
+    u64 clock = 0;
+};
+
+// Returns the table for the given parameters, building it if needed and evicting the least recently used
+// entry if the cache is full. The reference stays valid until the next call with the same cache.
+const DWrite_GrayscaleLut& DWrite_GetGrayscaleLut(DWrite_GrayscaleLutCache& cache, const DWrite_BlendParams& params) noexcept;
+
+// 6x1 overscaled ClearType only produces 7 distinct coverage levels per subpixel (see DWrite_CleartypeBlend in dwrite.hlsl).
+// For a single foreground/background pair, each subpixel channel of DWrite_CleartypeBlend() thus only has 7 possible
+// outputs, which allows us to replace the entire blend with 3 table lookups per pixel.
+//
+// Returns the level (0-6) of an 8-bit coverage value, rounded to nearest.
+// A 6x1 overscaled glyph atlas contains the values 0, 43, 85, 128, 170, 213 and 255.
+inline u32 DWrite_CleartypeCoverageLevel(u32 coverage) noexcept
+{
+    return (coverage * 6 + 127) / 255;
+}
+
+// Computes DWrite_CleartypeBlend() for all 7 coverage levels. Since each channel only depends on its own
+// coverage, out[i].r is the result for a red coverage of level i, out[i].g for a green one and so on.
+// The coverage of each level is the value stored in an 8-bit atlas (e.g. 43/255 instead of 1/6), so that the
+// results are identical to blending the atlas directly. This is also the layout of the cleartypeLevels shader
+// constants used by DWrite_CleartypeBlendLevels in dwrite.hlsl.
+void DWrite_GetCleartypeLevelColors(const DWrite_BlendParams& params, const f32x4& backgroundColor, f32x4 (&out)[7]) noexcept;
+
+struct DWrite_CleartypeLevelTable
+{
+    // DWrite_PackColor() of the DWrite_GetCleartypeLevelColors() results. The 8th entry repeats the 7th, which
+    // pads the table to exactly one AVX2 register. This is also the layout of a row of the DXGI_FORMAT_B8G8R8A8_UNORM
+    // texture used by DWrite_CleartypeBlendLevelTexture in dwrite.hlsl.
+    alignas(32) u32 levels[8];
+};
+
+// Builds the table for the params.foregroundColor and the given opaque B8G8R8A8 background color.
+void DWrite_BuildCleartypeLevelTable(const DWrite_BlendParams& params, u32 background, DWrite_CleartypeLevelTable& out) noexcept;
+
+// Blends a row of ClearType glyph coverage onto the table's background color and writes the result to dst.
+// Unlike DWrite_CleartypeBlendSpan, dst is never read. For glyphs whose coverage is quantized to the 7 levels
+// this produces the same results as DWrite_CleartypeBlendSpan_Scalar on a dst filled with the background color.
+// This forwards to the implementation picked by DWrite_SetBlendIsa().
+void DWrite_CleartypeBlendSpanLevels(const DWrite_CleartypeLevelTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept;
+
+void DWrite_CleartypeBlendSpanLevels_Scalar(const DWrite_CleartypeLevelTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept;
+#if DWRITE_BLEND_X86
+void DWrite_CleartypeBlendSpanLevels_AVX2(const DWrite_CleartypeLevelTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept;
+#endif
+
+// Since 6x1 overscaled ClearType glyphs only have 7 levels per subpixel, their coverage fits into 9 bits:
+// the DWrite_CleartypeCoverageLevel() of blue in bits 0-2, green in bits 3-5 and red in bits 6-8 (the byte order
+// of B8G8R8A8). Storing glyphs like this (e.g. as DXGI_FORMAT_R16_UINT) halves the atlas size and upload bandwidth
+// compared to B8G8R8A8, without any loss. See DWrite_UnpackCleartypeCoverage in dwrite.hlsl for the shader side.
+inline u16 DWrite_PackCleartypeCoverage(u32 bgra) noexcept
+{
+    const auto b = DWrite_CleartypeCoverageLevel(bgra & 0xff);
+    const auto g = DWrite_CleartypeCoverageLevel((bgra >> 8) & 0xff);
+    const auto r = DWrite_CleartypeCoverageLevel((bgra >> 16) & 0xff);
+    return static_cast<u16>(b | g << 3 | r << 6);
+}
+
+// The 8-bit atlas value of each level (see DWrite_GetCleartypeLevelColors). The 8th entry clamps invalid levels.
+inline constexpr u8 DWrite_CleartypeLevelCoverage[8]{ 0, 43, 85, 128, 170, 213, 255, 255 };
+
+// Turns packed coverage back into the B8G8R8A8 glyph color that DWrite_CleartypeBlendSpan expects. Alpha is 0.
+inline u32 DWrite_UnpackCleartypeCoverage(u16 packed) noexcept
+{
+    const u32 b = DWrite_CleartypeLevelCoverage[packed & 7];
+    const u32 g = DWrite_CleartypeLevelCoverage[(packed >> 3) & 7];
+    const u32 r = DWrite_CleartypeLevelCoverage[(packed >> 6) & 7];
+    return r << 16 | g << 8 | b;
+}
+
+// DWrite_PackCleartypeCoverage() and DWrite_UnpackCleartypeCoverage() for entire rows, for instance for filling an atlas.
+// They forward to the implementation picked by DWrite_SetBlendIsa(), all of which produce identical results.
+void DWrite_PackCleartypeCoverageSpan(const u32* src, u16* dst, size_t count) noexcept;
+void DWrite_UnpackCleartypeCoverageSpan(const u16* src, u32* dst, size_t count) noexcept;
+
+// Same as DWrite_CleartypeBlendSpanLevels, but for packed coverage. The results are identical to calling
+// DWrite_CleartypeBlendSpanLevels with the unpacked coverage. Each lookup is just a shift, since the levels
+// don't need to be computed anymore.
+void DWrite_CleartypeBlendSpanPacked(const DWrite_CleartypeLevelTable& table, const u16* glyph, u32* dst, size_t count) noexcept;
+
+void DWrite_PackCleartypeCoverageSpan_Scalar(const u32* src, u16* dst, size_t count) noexcept;
+void DWrite_UnpackCleartypeCoverageSpan_Scalar(const u16* src, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanPacked_Scalar(const DWrite_CleartypeLevelTable& table, const u16* glyph, u32* dst, size_t count) noexcept;
+#if DWRITE_BLEND_X86
+void DWrite_PackCleartypeCoverageSpan_AVX2(const u32* src, u16* dst, size_t count) noexcept;
+void DWrite_UnpackCleartypeCoverageSpan_AVX2(const u16* src, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanPacked_AVX2(const DWrite_CleartypeLevelTable& table, const u16* glyph, u32* dst, size_t count) noexcept;
+#endif
+
+// The blend modes of main_ps.hlsl. The values match its `mode` shader constant.
+enum class DWrite_BlendMode : u32
+{
+    Grayscale, // DWrite_GrayscaleBlend + alphaBlendPremultiplied
+    ClearType, // DWrite_CleartypeBlend
+    ClearTypeLevels, // DWrite_CleartypeBlendLevels
+    Primitive, // alphaBlendPremultiplied(dst, foregroundColor * glyphColor)
+};
+
+// How the render target stores colors.
+enum class DWrite_TargetEncoding : u32
+{
+    // Blending happens on the stored values directly, for instance with DXGI_FORMAT_B8G8R8A8_UNORM.
+    // DWrite_BlendParams::gammaRatios should come from DWrite_GetGammaRatiosForEncodedTarget().
+    Encoded,
+    // The target stores sRGB encoded values, but blending happens in linear space, for instance with
+    // DXGI_FORMAT_B8G8R8A8_UNORM_SRGB. The span functions decode dst before blending and encode the result
+    // with the tables from color.h (see DWrite_EncodeSrgbSpan for the accuracy).
+    // DWrite_BlendParams::gammaRatios and foregroundColor should be linear and come from DWrite_GetGammaRatiosForLinearTarget().
+    Linear,
+};
+
+// Blends a row of glyph coverage into a linear scRGB destination (DXGI_FORMAT_R16G16B16A16_FLOAT), which is what
+// swap chains on HDR displays (and DWM itself) use. Unlike with an Encoded or Linear B8G8R8A8 target, there's no
+// quantization to 8 bits, the background may exceed 1.0 and no conversion pass is needed before presentation.
+//
+// params.foregroundColor must be linear and premultiplied, with SDR white at 1.0, and params.gammaRatios should
+// come from DWrite_GetGammaRatiosForLinearTarget(). The foreground color is scaled by sdrWhiteLevel (1.0 = 80 nits,
+// see DISPLAYCONFIG_SDR_WHITE_LEVEL) so that text matches the brightness of other SDR content. The coverage weights
+// don't depend on it, so for sdrWhiteLevel = 1 the results are the linear equivalent of DWrite_GrayscaleBlendSpan
+// and DWrite_CleartypeBlendSpan, minus the 8-bit rounding.
+//
+//   Grayscale: dst = DWrite_GrayscaleBlendScRgb(..., dst, glyphAlpha[i])
+//   ClearType: dst = DWrite_CleartypeBlendScRgb(..., dst, glyphColor[i]) (dst must be opaque, alpha is set to 1)
+//
+// These are main_ps.hlsl's "DWrite Grayscale" and "DWrite ClearType" modes with the "scRGB" target. They forward to
+// the implementation picked by DWrite_SetBlendIsa(). The AVX2 ones use F16C for the conversions and are within
+// 1 f16 ULP of the Scalar ones.
+void DWrite_GrayscaleBlendSpanScRgb(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u8* glyphAlpha, f16x4* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanScRgb(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u32* glyphColor, f16x4* dst, size_t count) noexcept;
+
+void DWrite_GrayscaleBlendSpanScRgb_Scalar(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u8* glyphAlpha, f16x4* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanScRgb_Scalar(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u32* glyphColor, f16x4* dst, size_t count) noexcept;
+#if DWRITE_BLEND_X86
+void DWrite_GrayscaleBlendSpanScRgb_AVX2(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u8* glyphAlpha, f16x4* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanScRgb_AVX2(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u32* glyphColor, f16x4* dst, size_t count) noexcept;
+#endif
+
+// The glyph atlas pixel type for each blend mode: A8 for grayscale and B8G8R8A8 for everything else.
+template<DWrite_BlendMode Mode>
+using DWrite_GlyphPixel = std::conditional_t<Mode == DWrite_BlendMode::Grayscale, u8, u32>;
+
+// A family of span functions that have the blend mode, the thin-font flag and the target encoding baked in
+// at compile time. Each combination compiles to a branch-free inner loop, with all per-span math hoisted out
+// of it. The isThinFont member of params is ignored in favor of IsThinFont.
+//
+// These are portable C++ without explicit SIMD. For Encoded targets the dispatching DWrite_*BlendSpan functions
+// above are faster, but only these support Linear targets and the Primitive mode.
+//
+// The template is explicitly instantiated in blend_template.cpp for the Grayscale and ClearType modes with every
+// IsThinFont/Encoding combination and for the Primitive mode with IsThinFont = false. DWrite_BlendMode::ClearTypeLevels
+// isn't supported, because it requires a DWrite_CleartypeLevelTable. Use DWrite_CleartypeBlendSpanLevels instead.
+template<DWrite_BlendMode Mode, bool IsThinFont, DWrite_TargetEncoding Encoding>
+void DWrite_BlendSpan(const DWrite_BlendParams& params, const DWrite_GlyphPixel<Mode>* glyphs, u32* dst, size_t count) noexcept;
+
+// A type-erased DWrite_BlendSpan instantiation. glyphs points to DWrite_GlyphPixel<mode> values.
+using DWrite_BlendSpanFunc = void (*)(const DWrite_BlendParams& params, const void* glyphs, u32* dst, size_t count) noexcept;
+
+// Returns the DWrite_BlendSpan instantiation for the given runtime parameters. Call this once per draw batch
+// (i.e. whenever the mode, font or render target changes) and then call the result for each span.
+// For the Primitive mode isThinFont is ignored. Returns nullptr for DWrite_BlendMode::ClearTypeLevels.
+DWrite_BlendSpanFunc DWrite_GetBlendSpan(DWrite_BlendMode mode, bool isThinFont, DWrite_TargetEncoding encoding) noexcept;
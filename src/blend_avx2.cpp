@@ -0,0 +1,396 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "blend.h"
+
+#if DWRITE_BLEND_X86
+
+#include <cstring>
+
+#include <immintrin.h>
+
+// The per-span part of DWrite_GrayscaleBlend, broadcast into AVX2 registers.
+// Everything here only depends on the foreground color, which means that
+// the per-pixel work is just DWrite_EnhanceContrast + DWrite_ApplyAlphaCorrection.
+struct GrayscaleConstantsAVX2
+{
+    __m256 k; // blendEnhancedContrast / 255
+    __m256 k1; // (blendEnhancedContrast + 1) / 255
+    __m256 g0; // gammaRatios.x * intensity + gammaRatios.y
+    __m256 g1; // gammaRatios.z * intensity + gammaRatios.w
+    // The premultiplied foreground color, scaled to 0-255.
+    __m256 r;
+    __m256 g;
+    __m256 b;
+    __m256 a;
+    // The unscaled foreground alpha.
+    __m256 alpha;
+};
+
+DWRITE_TARGET_AVX2 static GrayscaleConstantsAVX2 getGrayscaleConstants(const DWrite_BlendParams& params) noexcept
+{
+    const auto c = DWrite_GetGrayscaleBlendConstants(params);
+
+    return {
+        .k = _mm256_set1_ps(c.contrast[0] / 255.0f),
+        .k1 = _mm256_set1_ps(c.contrast[1] / 255.0f),
+        .g0 = _mm256_set1_ps(c.gamma0[0]),
+        .g1 = _mm256_set1_ps(c.gamma1[0]),
+        .r = _mm256_set1_ps(c.color[0] * 255.0f),
+        .g = _mm256_set1_ps(c.color[1] * 255.0f),
+        .b = _mm256_set1_ps(c.color[2] * 255.0f),
+        .a = _mm256_set1_ps(c.color[3] * 255.0f),
+        .alpha = _mm256_set1_ps(c.color[3]),
+    };
+}
+
+// The per-span part of DWrite_CleartypeBlend. Since ClearType uses the straight foreground color
+// per subpixel for alpha correction, the gamma coefficients exist once per color channel.
+struct CleartypeConstantsAVX2
+{
+    __m256 k; // blendEnhancedContrast / 255
+    __m256 k1; // (blendEnhancedContrast + 1) / 255
+    // gammaRatios.x * foregroundStraight + gammaRatios.y
+    __m256 g0r;
+    __m256 g0g;
+    __m256 g0b;
+    // gammaRatios.z * foregroundStraight + gammaRatios.w
+    __m256 g1r;
+    __m256 g1g;
+    __m256 g1b;
+    // The straight foreground color, scaled to 0-255.
+    __m256 r;
+    __m256 g;
+    __m256 b;
+    // The unscaled foreground alpha.
+    __m256 alpha;
+};
+
+DWRITE_TARGET_AVX2 static CleartypeConstantsAVX2 getCleartypeConstants(const DWrite_BlendParams& params) noexcept
+{
+    const auto c = DWrite_GetCleartypeBlendConstants(params);
+
+    return {
+        .k = _mm256_set1_ps(c.contrast[0] / 255.0f),
+        .k1 = _mm256_set1_ps(c.contrast[1] / 255.0f),
+        .g0r = _mm256_set1_ps(c.gamma0[0]),
+        .g0g = _mm256_set1_ps(c.gamma0[1]),
+        .g0b = _mm256_set1_ps(c.gamma0[2]),
+        .g1r = _mm256_set1_ps(c.gamma1[0]),
+        .g1g = _mm256_set1_ps(c.gamma1[1]),
+        .g1b = _mm256_set1_ps(c.gamma1[2]),
+        .r = _mm256_set1_ps(c.color[0] * 255.0f),
+        .g = _mm256_set1_ps(c.color[1] * 255.0f),
+        .b = _mm256_set1_ps(c.color[2] * 255.0f),
+        .alpha = _mm256_set1_ps(c.color[3]),
+    };
+}
+
+// Approximates 1 / x with _mm256_rcp_ps (12 bits precision) followed by one Newton-Raphson step (~23 bits).
+// This is accurate enough for 8-bit output and about 3x the throughput of _mm256_div_ps.
+DWRITE_TARGET_AVX2 static __m256 reciprocal(__m256 x) noexcept
+{
+    const auto r = _mm256_rcp_ps(x);
+    return _mm256_mul_ps(r, _mm256_fnmadd_ps(x, r, _mm256_set1_ps(2.0f)));
+}
+
+// Converts the lower 8 bytes into 8 floats in the range [0, 255].
+DWRITE_TARGET_AVX2 static __m256 unpackCoverage(__m128i coverage) noexcept
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(coverage));
+}
+
+// Extracts the 8-bit channel at the given bit offset from 8 B8G8R8A8 pixels as floats in the range [0, 255].
+template<int Shift>
+DWRITE_TARGET_AVX2 static __m256 unpackChannel(__m256i pixels) noexcept
+{
+    return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, Shift), _mm256_set1_epi32(0xff)));
+}
+
+// The inverse of unpackChannel for all 4 channels at once: Rounds to nearest and clamps to [0, 255].
+// The saturating packs turn the 4x8 floats into 32 bytes in "planar" order per 128-bit lane
+// (bbbbggggrrrraaaa) and the final shuffle interleaves them back into B8G8R8A8 pixels.
+DWRITE_TARGET_AVX2 static __m256i packPixels(__m256 b, __m256 g, __m256 r, __m256 a) noexcept
+{
+    const auto bg = _mm256_packus_epi32(_mm256_cvtps_epi32(b), _mm256_cvtps_epi32(g));
+    const auto ra = _mm256_packus_epi32(_mm256_cvtps_epi32(r), _mm256_cvtps_epi32(a));
+    const auto planar = _mm256_packus_epi16(bg, ra);
+    const auto shuffle = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15, 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    return _mm256_shuffle_epi8(planar, shuffle);
+}
+
+// DWrite_GrayscaleBlend + alphaBlendPremultiplied for 8 pixels.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i grayscaleBlend8(const GrayscaleConstantsAVX2& c, __m128i coverage, __m256i dst) noexcept
+{
+    const auto one = _mm256_set1_ps(1.0f);
+    const auto alpha = unpackCoverage(coverage);
+
+    // DWrite_EnhanceContrast (c.k and c.k1 are premultiplied with 1/255 to normalize the coverage)
+    const auto contrasted = _mm256_mul_ps(_mm256_mul_ps(alpha, c.k1), reciprocal(_mm256_fmadd_ps(alpha, c.k, one)));
+    // DWrite_ApplyAlphaCorrection
+    const auto correction = _mm256_fmadd_ps(c.g0, contrasted, c.g1);
+    const auto corrected = _mm256_fmadd_ps(_mm256_mul_ps(contrasted, _mm256_sub_ps(one, contrasted)), correction, contrasted);
+    // alphaBlendPremultiplied(dst, foregroundColor * corrected)
+    const auto ia = _mm256_fnmadd_ps(c.alpha, corrected, one);
+
+    const auto b = _mm256_fmadd_ps(unpackChannel<0>(dst), ia, _mm256_mul_ps(c.b, corrected));
+    const auto g = _mm256_fmadd_ps(unpackChannel<8>(dst), ia, _mm256_mul_ps(c.g, corrected));
+    const auto r = _mm256_fmadd_ps(unpackChannel<16>(dst), ia, _mm256_mul_ps(c.r, corrected));
+    const auto a = _mm256_fmadd_ps(unpackChannel<24>(dst), ia, _mm256_mul_ps(c.a, corrected));
+
+    return packPixels(b, g, r, a);
+}
+
+// DWrite_EnhanceContrast3 + DWrite_ApplyAlphaCorrection3 for a single channel of 8 pixels.
+// coverage is expected to be in the range [0, 255]. The result is multiplied by the foreground alpha.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 cleartypeAlpha(const CleartypeConstantsAVX2& c, __m256 coverage, __m256 g0, __m256 g1) noexcept
+{
+    const auto one = _mm256_set1_ps(1.0f);
+    const auto contrasted = _mm256_mul_ps(_mm256_mul_ps(coverage, c.k1), reciprocal(_mm256_fmadd_ps(coverage, c.k, one)));
+    const auto correction = _mm256_fmadd_ps(g0, contrasted, g1);
+    const auto corrected = _mm256_fmadd_ps(_mm256_mul_ps(contrasted, _mm256_sub_ps(one, contrasted)), correction, contrasted);
+    return _mm256_mul_ps(corrected, c.alpha);
+}
+
+// DWrite_CleartypeBlend for 8 pixels, using dst as the background color.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i cleartypeBlend8(const CleartypeConstantsAVX2& c, __m256i glyph, __m256i dst) noexcept
+{
+    const auto ab = cleartypeAlpha(c, unpackChannel<0>(glyph), c.g0b, c.g1b);
+    const auto ag = cleartypeAlpha(c, unpackChannel<8>(glyph), c.g0g, c.g1g);
+    const auto ar = cleartypeAlpha(c, unpackChannel<16>(glyph), c.g0r, c.g1r);
+
+    // lerp(background, foregroundStraight, alpha) = background + alpha * (foregroundStraight - background)
+    const auto db = unpackChannel<0>(dst);
+    const auto dg = unpackChannel<8>(dst);
+    const auto dr = unpackChannel<16>(dst);
+    const auto b = _mm256_fmadd_ps(ab, _mm256_sub_ps(c.b, db), db);
+    const auto g = _mm256_fmadd_ps(ag, _mm256_sub_ps(c.g, dg), dg);
+    const auto r = _mm256_fmadd_ps(ar, _mm256_sub_ps(c.r, dr), dr);
+
+    return packPixels(b, g, r, _mm256_set1_ps(255.0f));
+}
+
+// Returns a mask for _mm256_maskload_epi32/_mm256_maskstore_epi32 with the first n (< 8) lanes set.
+DWRITE_TARGET_AVX2 static __m256i tailMask(size_t n) noexcept
+{
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(n)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+DWRITE_TARGET_AVX2 void DWrite_GrayscaleBlendSpan_AVX2(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    const auto c = getGrayscaleConstants(params);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto coverage = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(glyphAlpha + i));
+        // Most of a glyph's bounding box is empty and blending with 0 coverage leaves dst unchanged.
+        if (_mm_testz_si128(coverage, coverage))
+        {
+            continue;
+        }
+
+        const auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), grayscaleBlend8(c, coverage, d));
+    }
+
+    if (const auto remaining = count - i)
+    {
+        // There's no masked load for bytes, but copying <8 bytes into a register is just as good.
+        u8 bytes[8]{};
+        memcpy(&bytes[0], glyphAlpha + i, remaining);
+
+        const auto coverage = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&bytes[0]));
+        const auto mask = tailMask(remaining);
+        const auto d = _mm256_maskload_epi32(reinterpret_cast<const int*>(dst + i), mask);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), mask, grayscaleBlend8(c, coverage, d));
+    }
+}
+
+DWRITE_TARGET_AVX2 void DWrite_CleartypeBlendSpan_AVX2(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    const auto c = getCleartypeConstants(params);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto glyph = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(glyphColor + i));
+        const auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), cleartypeBlend8(c, glyph, d));
+    }
+
+    if (const auto remaining = count - i)
+    {
+        const auto mask = tailMask(remaining);
+        const auto glyph = _mm256_maskload_epi32(reinterpret_cast<const int*>(glyphColor + i), mask);
+        const auto d = _mm256_maskload_epi32(reinterpret_cast<const int*>(dst + i), mask);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), mask, cleartypeBlend8(c, glyph, d));
+    }
+}
+
+// Same as grayscaleBlend8, but with DWrite_EnhanceContrast + DWrite_ApplyAlphaCorrection replaced by two table lookups.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i grayscaleBlendLut8(const DWrite_GrayscaleLut& lut, const __m256* fg, __m128i coverage, __m256i dst) noexcept
+{
+    const auto idx = _mm256_cvtepu8_epi32(coverage);
+    const auto corrected = _mm256_i32gather_ps(&lut.corrected[0], idx, 4);
+    const auto ia = _mm256_i32gather_ps(&lut.inverseAlpha[0], idx, 4);
+
+    const auto b = _mm256_fmadd_ps(unpackChannel<0>(dst), ia, _mm256_mul_ps(fg[0], corrected));
+    const auto g = _mm256_fmadd_ps(unpackChannel<8>(dst), ia, _mm256_mul_ps(fg[1], corrected));
+    const auto r = _mm256_fmadd_ps(unpackChannel<16>(dst), ia, _mm256_mul_ps(fg[2], corrected));
+    const auto a = _mm256_fmadd_ps(unpackChannel<24>(dst), ia, _mm256_mul_ps(fg[3], corrected));
+
+    return packPixels(b, g, r, a);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_GrayscaleBlendSpanLut_AVX2(const DWrite_GrayscaleLut& lut, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    // The premultiplied foreground color (b, g, r, a), scaled to 0-255.
+    const __m256 fg[4]{
+        _mm256_set1_ps(lut.foregroundColor.b * 255.0f),
+        _mm256_set1_ps(lut.foregroundColor.g * 255.0f),
+        _mm256_set1_ps(lut.foregroundColor.r * 255.0f),
+        _mm256_set1_ps(lut.foregroundColor.a * 255.0f),
+    };
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto coverage = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(glyphAlpha + i));
+        if (_mm_testz_si128(coverage, coverage))
+        {
+            continue;
+        }
+
+        const auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), grayscaleBlendLut8(lut, &fg[0], coverage, d));
+    }
+
+    if (const auto remaining = count - i)
+    {
+        u8 bytes[8]{};
+        memcpy(&bytes[0], glyphAlpha + i, remaining);
+
+        const auto coverage = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&bytes[0]));
+        const auto mask = tailMask(remaining);
+        const auto d = _mm256_maskload_epi32(reinterpret_cast<const int*>(dst + i), mask);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), mask, grayscaleBlendLut8(lut, &fg[0], coverage, d));
+    }
+}
+
+// Turns the 16-bit lanes of x (each in the range [0, 255]) into DWrite_CleartypeCoverageLevel().
+// (c * 6 + 127) / 255 is computed as ((c * 6 + 128) * 257) >> 16, which is exact for all 8-bit inputs.
+DWRITE_TARGET_AVX2 static __m256i coverageLevel16(__m256i x) noexcept
+{
+    const auto t = _mm256_add_epi16(_mm256_mullo_epi16(x, _mm256_set1_epi16(6)), _mm256_set1_epi16(128));
+    return _mm256_mulhi_epu16(t, _mm256_set1_epi16(257));
+}
+
+// DWrite_CleartypeBlendSpanLevels for 8 pixels. The 8-entry table fits into a single register,
+// which means that each lookup is a single _mm256_permutevar8x32_epi32 (it only uses the lowest 3 bits of the index).
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i cleartypeBlendLevels8(__m256i table, __m256i glyph) noexcept
+{
+    const auto mask = _mm256_set1_epi32(0x00ff00ff);
+    // The low 16 bits of each pixel contain the blue level and the high ones the red level.
+    const auto levelBR = coverageLevel16(_mm256_and_si256(glyph, mask));
+    // Same for green and alpha. The latter is ignored.
+    const auto levelGA = coverageLevel16(_mm256_and_si256(_mm256_srli_epi32(glyph, 8), mask));
+
+    const auto b = _mm256_and_si256(_mm256_permutevar8x32_epi32(table, levelBR), _mm256_set1_epi32(0x0000ff));
+    const auto g = _mm256_and_si256(_mm256_permutevar8x32_epi32(table, levelGA), _mm256_set1_epi32(0x00ff00));
+    const auto r = _mm256_and_si256(_mm256_permutevar8x32_epi32(table, _mm256_srli_epi32(levelBR, 16)), _mm256_set1_epi32(0xff0000));
+    return _mm256_or_si256(_mm256_or_si256(b, g), _mm256_or_si256(r, _mm256_set1_epi32(0xff000000)));
+}
+
+DWRITE_TARGET_AVX2 void DWrite_CleartypeBlendSpanLevels_AVX2(const DWrite_CleartypeLevelTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    const auto levels = _mm256_load_si256(reinterpret_cast<const __m256i*>(&table.levels[0]));
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto glyph = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(glyphColor + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), cleartypeBlendLevels8(levels, glyph));
+    }
+
+    if (const auto remaining = count - i)
+    {
+        const auto mask = tailMask(remaining);
+        const auto glyph = _mm256_maskload_epi32(reinterpret_cast<const int*>(glyphColor + i), mask);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), mask, cleartypeBlendLevels8(levels, glyph));
+    }
+}
+
+DWRITE_TARGET_AVX2 void DWrite_PackCleartypeCoverageSpan_AVX2(const u32* src, u16* dst, size_t count) noexcept
+{
+    const auto mask = _mm256_set1_epi32(0x00ff00ff);
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i packed[2];
+        for (int j = 0; j < 2; ++j)
+        {
+            const auto glyph = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + j * 8));
+            // Blue and red levels in the low and high 16 bits, just like in cleartypeBlendLevels8.
+            const auto levelBR = coverageLevel16(_mm256_and_si256(glyph, mask));
+            const auto levelG = _mm256_and_si256(coverageLevel16(_mm256_and_si256(_mm256_srli_epi32(glyph, 8), mask)), _mm256_set1_epi32(0xffff));
+            const auto b = _mm256_and_si256(levelBR, _mm256_set1_epi32(0xffff));
+            const auto r = _mm256_srli_epi32(levelBR, 16);
+            packed[j] = _mm256_or_si256(_mm256_or_si256(b, _mm256_slli_epi32(levelG, 3)), _mm256_slli_epi32(r, 6));
+        }
+        // packus works within 128-bit lanes, which interleaves the two halves. The permute restores the order.
+        const auto words = _mm256_permute4x64_epi64(_mm256_packus_epi32(packed[0], packed[1]), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), words);
+    }
+
+    DWrite_PackCleartypeCoverageSpan_Scalar(src + i, dst + i, count - i);
+}
+
+// Looks up the 3-bit levels of 8 packed pixels (zero-extended to 32 bits) in an 8-entry table.
+// _mm256_permutevar8x32_epi32 only uses the lowest 3 bits of each index, which saves us from masking.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i lookupPacked8(__m256i table, __m256i packed) noexcept
+{
+    const auto b = _mm256_and_si256(_mm256_permutevar8x32_epi32(table, packed), _mm256_set1_epi32(0x0000ff));
+    const auto g = _mm256_and_si256(_mm256_permutevar8x32_epi32(table, _mm256_srli_epi32(packed, 3)), _mm256_set1_epi32(0x00ff00));
+    const auto r = _mm256_and_si256(_mm256_permutevar8x32_epi32(table, _mm256_srli_epi32(packed, 6)), _mm256_set1_epi32(0xff0000));
+    return _mm256_or_si256(_mm256_or_si256(b, g), r);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_UnpackCleartypeCoverageSpan_AVX2(const u16* src, u32* dst, size_t count) noexcept
+{
+    // Each level's coverage in all 3 color channels, so that lookupPacked8 can pick the channel it needs.
+    alignas(32) u32 levels[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        levels[i] = DWrite_CleartypeLevelCoverage[i] * 0x010101u;
+    }
+
+    const auto table = _mm256_load_si256(reinterpret_cast<const __m256i*>(&levels[0]));
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto packed = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), lookupPacked8(table, packed));
+    }
+
+    DWrite_UnpackCleartypeCoverageSpan_Scalar(src + i, dst + i, count - i);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_CleartypeBlendSpanPacked_AVX2(const DWrite_CleartypeLevelTable& table, const u16* glyph, u32* dst, size_t count) noexcept
+{
+    const auto levels = _mm256_load_si256(reinterpret_cast<const __m256i*>(&table.levels[0]));
+    const auto alpha = _mm256_set1_epi32(0xff000000);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto packed = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(glyph + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(lookupPacked8(levels, packed), alpha));
+    }
+
+    DWrite_CleartypeBlendSpanPacked_Scalar(table, glyph + i, dst + i, count - i);
+}
+
+#endif
@@ -0,0 +1,191 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "blend.h"
+
+#if DWRITE_BLEND_X86
+
+#include <immintrin.h>
+
+// This is the same algorithm as blend_avx2.cpp, but with 16 pixels per iteration.
+// AVX-512BW/VL additionally allow us to use masked byte loads for the tail.
+
+struct GrayscaleConstantsAVX512
+{
+    __m512 k; // blendEnhancedContrast / 255
+    __m512 k1; // (blendEnhancedContrast + 1) / 255
+    __m512 g0; // gammaRatios.x * intensity + gammaRatios.y
+    __m512 g1; // gammaRatios.z * intensity + gammaRatios.w
+    // The premultiplied foreground color, scaled to 0-255.
+    __m512 r;
+    __m512 g;
+    __m512 b;
+    __m512 a;
+    // The unscaled foreground alpha.
+    __m512 alpha;
+};
+
+struct CleartypeConstantsAVX512
+{
+    __m512 k; // blendEnhancedContrast / 255
+    __m512 k1; // (blendEnhancedContrast + 1) / 255
+    // gammaRatios.x * foregroundStraight + gammaRatios.y
+    __m512 g0r;
+    __m512 g0g;
+    __m512 g0b;
+    // gammaRatios.z * foregroundStraight + gammaRatios.w
+    __m512 g1r;
+    __m512 g1g;
+    __m512 g1b;
+    // The straight foreground color, scaled to 0-255.
+    __m512 r;
+    __m512 g;
+    __m512 b;
+    // The unscaled foreground alpha.
+    __m512 alpha;
+};
+
+DWRITE_TARGET_AVX512 static GrayscaleConstantsAVX512 getGrayscaleConstants(const DWrite_BlendParams& params) noexcept
+{
+    const auto c = DWrite_GetGrayscaleBlendConstants(params);
+
+    return {
+        .k = _mm512_set1_ps(c.contrast[0] / 255.0f),
+        .k1 = _mm512_set1_ps(c.contrast[1] / 255.0f),
+        .g0 = _mm512_set1_ps(c.gamma0[0]),
+        .g1 = _mm512_set1_ps(c.gamma1[0]),
+        .r = _mm512_set1_ps(c.color[0] * 255.0f),
+        .g = _mm512_set1_ps(c.color[1] * 255.0f),
+        .b = _mm512_set1_ps(c.color[2] * 255.0f),
+        .a = _mm512_set1_ps(c.color[3] * 255.0f),
+        .alpha = _mm512_set1_ps(c.color[3]),
+    };
+}
+
+DWRITE_TARGET_AVX512 static CleartypeConstantsAVX512 getCleartypeConstants(const DWrite_BlendParams& params) noexcept
+{
+    const auto c = DWrite_GetCleartypeBlendConstants(params);
+
+    return {
+        .k = _mm512_set1_ps(c.contrast[0] / 255.0f),
+        .k1 = _mm512_set1_ps(c.contrast[1] / 255.0f),
+        .g0r = _mm512_set1_ps(c.gamma0[0]),
+        .g0g = _mm512_set1_ps(c.gamma0[1]),
+        .g0b = _mm512_set1_ps(c.gamma0[2]),
+        .g1r = _mm512_set1_ps(c.gamma1[0]),
+        .g1g = _mm512_set1_ps(c.gamma1[1]),
+        .g1b = _mm512_set1_ps(c.gamma1[2]),
+        .r = _mm512_set1_ps(c.color[0] * 255.0f),
+        .g = _mm512_set1_ps(c.color[1] * 255.0f),
+        .b = _mm512_set1_ps(c.color[2] * 255.0f),
+        .alpha = _mm512_set1_ps(c.color[3]),
+    };
+}
+
+// _mm512_rcp14_ps (14 bits precision) followed by one Newton-Raphson step.
+DWRITE_TARGET_AVX512 static __m512 reciprocal(__m512 x) noexcept
+{
+    const auto r = _mm512_rcp14_ps(x);
+    return _mm512_mul_ps(r, _mm512_fnmadd_ps(x, r, _mm512_set1_ps(2.0f)));
+}
+
+template<int Shift>
+DWRITE_TARGET_AVX512 static __m512 unpackChannel(__m512i pixels) noexcept
+{
+    return _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(pixels, Shift), _mm512_set1_epi32(0xff)));
+}
+
+DWRITE_TARGET_AVX512 static __m512i packPixels(__m512 b, __m512 g, __m512 r, __m512 a) noexcept
+{
+    const auto bg = _mm512_packus_epi32(_mm512_cvtps_epi32(b), _mm512_cvtps_epi32(g));
+    const auto ra = _mm512_packus_epi32(_mm512_cvtps_epi32(r), _mm512_cvtps_epi32(a));
+    const auto planar = _mm512_packus_epi16(bg, ra);
+    const auto shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15));
+    return _mm512_shuffle_epi8(planar, shuffle);
+}
+
+DWRITE_TARGET_AVX512 static __m512 enhanceAndCorrect(__m512 coverage, __m512 k, __m512 k1, __m512 g0, __m512 g1) noexcept
+{
+    const auto one = _mm512_set1_ps(1.0f);
+    const auto contrasted = _mm512_mul_ps(_mm512_mul_ps(coverage, k1), reciprocal(_mm512_fmadd_ps(coverage, k, one)));
+    const auto correction = _mm512_fmadd_ps(g0, contrasted, g1);
+    return _mm512_fmadd_ps(_mm512_mul_ps(contrasted, _mm512_sub_ps(one, contrasted)), correction, contrasted);
+}
+
+DWRITE_TARGET_AVX512 DWRITE_FORCEINLINE static __m512i grayscaleBlend16(const GrayscaleConstantsAVX512& c, __m128i coverage, __m512i dst) noexcept
+{
+    const auto corrected = enhanceAndCorrect(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(coverage)), c.k, c.k1, c.g0, c.g1);
+    const auto ia = _mm512_fnmadd_ps(c.alpha, corrected, _mm512_set1_ps(1.0f));
+
+    const auto b = _mm512_fmadd_ps(unpackChannel<0>(dst), ia, _mm512_mul_ps(c.b, corrected));
+    const auto g = _mm512_fmadd_ps(unpackChannel<8>(dst), ia, _mm512_mul_ps(c.g, corrected));
+    const auto r = _mm512_fmadd_ps(unpackChannel<16>(dst), ia, _mm512_mul_ps(c.r, corrected));
+    const auto a = _mm512_fmadd_ps(unpackChannel<24>(dst), ia, _mm512_mul_ps(c.a, corrected));
+
+    return packPixels(b, g, r, a);
+}
+
+DWRITE_TARGET_AVX512 DWRITE_FORCEINLINE static __m512i cleartypeBlend16(const CleartypeConstantsAVX512& c, __m512i glyph, __m512i dst) noexcept
+{
+    const auto ab = _mm512_mul_ps(enhanceAndCorrect(unpackChannel<0>(glyph), c.k, c.k1, c.g0b, c.g1b), c.alpha);
+    const auto ag = _mm512_mul_ps(enhanceAndCorrect(unpackChannel<8>(glyph), c.k, c.k1, c.g0g, c.g1g), c.alpha);
+    const auto ar = _mm512_mul_ps(enhanceAndCorrect(unpackChannel<16>(glyph), c.k, c.k1, c.g0r, c.g1r), c.alpha);
+
+    const auto db = unpackChannel<0>(dst);
+    const auto dg = unpackChannel<8>(dst);
+    const auto dr = unpackChannel<16>(dst);
+    const auto b = _mm512_fmadd_ps(ab, _mm512_sub_ps(c.b, db), db);
+    const auto g = _mm512_fmadd_ps(ag, _mm512_sub_ps(c.g, dg), dg);
+    const auto r = _mm512_fmadd_ps(ar, _mm512_sub_ps(c.r, dr), dr);
+
+    return packPixels(b, g, r, _mm512_set1_ps(255.0f));
+}
+
+DWRITE_TARGET_AVX512 void DWrite_GrayscaleBlendSpan_AVX512(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    const auto c = getGrayscaleConstants(params);
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        const auto coverage = _mm_loadu_si128(reinterpret_cast<const __m128i*>(glyphAlpha + i));
+        if (_mm_testz_si128(coverage, coverage))
+        {
+            continue;
+        }
+
+        const auto d = _mm512_loadu_si512(dst + i);
+        _mm512_storeu_si512(dst + i, grayscaleBlend16(c, coverage, d));
+    }
+
+    if (const auto remaining = count - i)
+    {
+        const auto mask = static_cast<__mmask16>((1u << remaining) - 1);
+        const auto coverage = _mm_maskz_loadu_epi8(mask, glyphAlpha + i);
+        const auto d = _mm512_maskz_loadu_epi32(mask, dst + i);
+        _mm512_mask_storeu_epi32(dst + i, mask, grayscaleBlend16(c, coverage, d));
+    }
+}
+
+DWRITE_TARGET_AVX512 void DWrite_CleartypeBlendSpan_AVX512(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    const auto c = getCleartypeConstants(params);
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        const auto glyph = _mm512_loadu_si512(glyphColor + i);
+        const auto d = _mm512_loadu_si512(dst + i);
+        _mm512_storeu_si512(dst + i, cleartypeBlend16(c, glyph, d));
+    }
+
+    if (const auto remaining = count - i)
+    {
+        const auto mask = static_cast<__mmask16>((1u << remaining) - 1);
+        const auto glyph = _mm512_maskz_loadu_epi32(mask, glyphColor + i);
+        const auto d = _mm512_maskz_loadu_epi32(mask, dst + i);
+        _mm512_mask_storeu_epi32(dst + i, mask, cleartypeBlend16(c, glyph, d));
+    }
+}
+
+#endif
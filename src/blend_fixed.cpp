@@ -0,0 +1,389 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "blend.h"
+
+#include <cmath>
+#include <cstring>
+
+#if DWRITE_BLEND_X86
+#include <immintrin.h>
+#endif
+
+// The scalar code below emulates the AVX2 instructions 1:1, so that both produce bit-identical results:
+// * mulhrs() is _mm256_mulhrs_epi16: a * b / 2^15, rounded.
+// * mulQ14() multiplies two Q2.14 numbers: _mm256_slli_epi16(_mm256_mulhrs_epi16(a, b), 1).
+// * Channels are blended as "8.6 * Q2.14" via mulhrs(), which yields 8.5 fixed point,
+//   which gets rounded back to 8 bits using (x + 16) >> 5.
+static constexpr i32 one = 1 << 14;
+
+static i32 mulhrs(i32 a, i32 b) noexcept
+{
+    return (a * b + 0x4000) >> 15;
+}
+
+static i32 mulQ14(i32 a, i32 b) noexcept
+{
+    return mulhrs(a, b) * 2;
+}
+
+static u32 roundChannel(i32 v) noexcept
+{
+    v = (v + 16) >> 5;
+    return static_cast<u32>(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static i16 toQ14(f32 v) noexcept
+{
+    const auto i = std::lround(v * one);
+    return static_cast<i16>(i < -32768 ? -32768 : (i > 32767 ? 32767 : i));
+}
+
+static i16 to8d6(f32 v) noexcept
+{
+    const auto i = std::lround(DWrite_Saturate(v) * (255 << 6));
+    return static_cast<i16>(i);
+}
+
+void DWrite_GetFixedBlendParams(const DWrite_BlendParams& params, DWrite_FixedBlendParams& out) noexcept
+{
+    const auto& fg = params.foregroundColor;
+    const auto& gr = params.gammaRatios;
+    const auto foregroundStraight = DWrite_UnpremultiplyColor(fg);
+    const auto contrastBoost = params.isThinFont ? 0.5f : 0.0f;
+    const auto grayscaleContrast = contrastBoost + DWrite_ApplyLightOnDarkContrastAdjustment(params.grayscaleEnhancedContrast, foregroundStraight);
+    const auto cleartypeContrast = contrastBoost + DWrite_ApplyLightOnDarkContrastAdjustment(params.cleartypeEnhancedContrast, foregroundStraight);
+    const auto intensity = DWrite_CalcColorIntensity({ fg.r, fg.g, fg.b });
+
+    for (int i = 0; i < 256; ++i)
+    {
+        const auto alpha = static_cast<f32>(i) * (1.0f / 255.0f);
+        out.grayscaleContrast[i] = toQ14(DWrite_EnhanceContrast(alpha, grayscaleContrast));
+        out.cleartypeContrast[i] = toQ14(DWrite_EnhanceContrast(alpha, cleartypeContrast));
+    }
+
+    out.grayscaleGamma[0] = toQ14(gr[0] * intensity + gr[1]);
+    out.grayscaleGamma[1] = toQ14(gr[2] * intensity + gr[3]);
+
+    const f32 straight[3]{ foregroundStraight.b, foregroundStraight.g, foregroundStraight.r };
+    for (int i = 0; i < 3; ++i)
+    {
+        out.cleartypeGamma[i][0] = toQ14(gr[0] * straight[i] + gr[1]);
+        out.cleartypeGamma[i][1] = toQ14(gr[2] * straight[i] + gr[3]);
+        out.foregroundStraight[i] = to8d6(straight[i]);
+    }
+
+    out.foreground[0] = to8d6(fg.b);
+    out.foreground[1] = to8d6(fg.g);
+    out.foreground[2] = to8d6(fg.r);
+    out.foreground[3] = to8d6(fg.a);
+    out.foregroundAlpha = toQ14(fg.a);
+}
+
+// DWrite_ApplyAlphaCorrection in Q2.14.
+static i32 applyAlphaCorrection(i32 c, i32 g0, i32 g1) noexcept
+{
+    const auto t = mulQ14(g0, c) + g1;
+    const auto cc = mulQ14(c, one - c);
+    return c + mulQ14(cc, t);
+}
+
+void DWrite_GrayscaleBlendSpanFixed_Scalar(const DWrite_FixedBlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto corrected = applyAlphaCorrection(params.grayscaleContrast[glyphAlpha[i]], params.grayscaleGamma[0], params.grayscaleGamma[1]);
+        const auto ia = one - mulQ14(params.foregroundAlpha, corrected);
+        const auto d = dst[i];
+        u32 result = 0;
+
+        for (int ch = 0; ch < 4; ++ch)
+        {
+            const auto x = static_cast<i32>((d >> (ch * 8)) & 0xff);
+            result |= roundChannel(mulhrs(x << 6, ia) + mulhrs(params.foreground[ch], corrected)) << (ch * 8);
+        }
+
+        dst[i] = result;
+    }
+}
+
+void DWrite_CleartypeBlendSpanFixed_Scalar(const DWrite_FixedBlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto glyph = glyphColor[i];
+        const auto d = dst[i];
+        u32 result = 0xff000000;
+
+        for (int ch = 0; ch < 3; ++ch)
+        {
+            const auto coverage = params.cleartypeContrast[(glyph >> (ch * 8)) & 0xff];
+            const auto corrected = applyAlphaCorrection(coverage, params.cleartypeGamma[ch][0], params.cleartypeGamma[ch][1]);
+            const auto alpha = mulQ14(corrected, params.foregroundAlpha);
+            const auto x = static_cast<i32>((d >> (ch * 8)) & 0xff);
+            // lerp(background, foregroundStraight, alpha)
+            result |= roundChannel((x << 5) + mulhrs(params.foregroundStraight[ch] - (x << 6), alpha)) << (ch * 8);
+        }
+
+        dst[i] = result;
+    }
+}
+
+#if DWRITE_BLEND_X86
+
+DWRITE_TARGET_AVX2 static __m256i mulQ14(__m256i a, __m256i b) noexcept
+{
+    return _mm256_slli_epi16(_mm256_mulhrs_epi16(a, b), 1);
+}
+
+DWRITE_TARGET_AVX2 static __m256i applyAlphaCorrection(__m256i c, __m256i g0, __m256i g1) noexcept
+{
+    const auto t = _mm256_add_epi16(mulQ14(g0, c), g1);
+    const auto cc = mulQ14(c, _mm256_sub_epi16(_mm256_set1_epi16(one), c));
+    return _mm256_add_epi16(c, mulQ14(cc, t));
+}
+
+DWRITE_TARGET_AVX2 static __m256i roundChannel(__m256i v) noexcept
+{
+    v = _mm256_srai_epi16(_mm256_add_epi16(v, _mm256_set1_epi16(16)), 5);
+    return _mm256_min_epi16(_mm256_max_epi16(v, _mm256_setzero_si256()), _mm256_set1_epi16(255));
+}
+
+// Looks up 2x8 indices in a 256 entry table and returns them as 16 i16.
+// NOTE: The result is in the lane order of _mm256_packs_epi32, which is [0-3, 8-11, 4-7, 12-15].
+// This is exactly the order that _mm256_unpacklo/hi_epi16 need to produce pixel-pairs for [0-7] and [8-15].
+DWRITE_TARGET_AVX2 static __m256i gather16(const i32* table, __m256i idx0, __m256i idx1) noexcept
+{
+    return _mm256_packs_epi32(_mm256_i32gather_epi32(table, idx0, 4), _mm256_i32gather_epi32(table, idx1, 4));
+}
+
+DWRITE_TARGET_AVX2 static __m256i tailMask(int n) noexcept
+{
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+// Every B8G8R8A8 pixel is split into two 16-bit pairs: [b, r] = d & 0x00ff00ff and [g, a] = d >> 8.
+// This allows us to process them in 16-bit lanes without any shuffles.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i grayscaleBlend8(__m256i d, __m256i ia, __m256i corrected, __m256i fgBR, __m256i fgGA) noexcept
+{
+    const auto br = _mm256_and_si256(d, _mm256_set1_epi32(0x00ff00ff));
+    const auto ga = _mm256_srli_epi16(d, 8);
+    const auto outBR = roundChannel(_mm256_add_epi16(_mm256_mulhrs_epi16(_mm256_slli_epi16(br, 6), ia), _mm256_mulhrs_epi16(fgBR, corrected)));
+    const auto outGA = roundChannel(_mm256_add_epi16(_mm256_mulhrs_epi16(_mm256_slli_epi16(ga, 6), ia), _mm256_mulhrs_epi16(fgGA, corrected)));
+    return _mm256_or_si256(outBR, _mm256_slli_epi16(outGA, 8));
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static void grayscaleBlend16(const DWrite_FixedBlendParams& p, __m128i coverage, __m256i& d0, __m256i& d1) noexcept
+{
+    const auto idx0 = _mm256_cvtepu8_epi32(coverage);
+    const auto idx1 = _mm256_cvtepu8_epi32(_mm_srli_si128(coverage, 8));
+    const auto c = gather16(&p.grayscaleContrast[0], idx0, idx1);
+    const auto corrected = applyAlphaCorrection(c, _mm256_set1_epi16(p.grayscaleGamma[0]), _mm256_set1_epi16(p.grayscaleGamma[1]));
+    const auto ia = _mm256_sub_epi16(_mm256_set1_epi16(one), mulQ14(_mm256_set1_epi16(p.foregroundAlpha), corrected));
+
+    const auto fgBR = _mm256_set1_epi32(static_cast<u16>(p.foreground[0]) | static_cast<u16>(p.foreground[2]) << 16);
+    const auto fgGA = _mm256_set1_epi32(static_cast<u16>(p.foreground[1]) | static_cast<u16>(p.foreground[3]) << 16);
+    d0 = grayscaleBlend8(d0, _mm256_unpacklo_epi16(ia, ia), _mm256_unpacklo_epi16(corrected, corrected), fgBR, fgGA);
+    d1 = grayscaleBlend8(d1, _mm256_unpackhi_epi16(ia, ia), _mm256_unpackhi_epi16(corrected, corrected), fgBR, fgGA);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_GrayscaleBlendSpanFixed_AVX2(const DWrite_FixedBlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        const auto coverage = _mm_loadu_si128(reinterpret_cast<const __m128i*>(glyphAlpha + i));
+        if (_mm_testz_si128(coverage, coverage))
+        {
+            continue;
+        }
+
+        auto d0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        auto d1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i + 8));
+        grayscaleBlend16(params, coverage, d0, d1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), d0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), d1);
+    }
+
+    if (const auto remaining = count - i)
+    {
+        u8 bytes[16]{};
+        memcpy(&bytes[0], glyphAlpha + i, remaining);
+
+        const auto coverage = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&bytes[0]));
+        const auto mask0 = tailMask(static_cast<int>(remaining));
+        const auto mask1 = tailMask(static_cast<int>(remaining) - 8);
+        auto d0 = _mm256_maskload_epi32(reinterpret_cast<const int*>(dst + i), mask0);
+        auto d1 = _mm256_maskload_epi32(reinterpret_cast<const int*>(dst + i + 8), mask1);
+        grayscaleBlend16(params, coverage, d0, d1);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), mask0, d0);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i + 8), mask1, d1);
+    }
+}
+
+// Returns DWrite_ApplyAlphaCorrection(...) * foregroundAlpha for the channel at the given bit offset.
+template<int Shift>
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i cleartypeAlpha(const DWrite_FixedBlendParams& p, __m256i glyph0, __m256i glyph1) noexcept
+{
+    const auto mask = _mm256_set1_epi32(0xff);
+    const auto idx0 = _mm256_and_si256(_mm256_srli_epi32(glyph0, Shift), mask);
+    const auto idx1 = _mm256_and_si256(_mm256_srli_epi32(glyph1, Shift), mask);
+    const auto c = gather16(&p.cleartypeContrast[0], idx0, idx1);
+    const auto& gamma = p.cleartypeGamma[Shift / 8];
+    const auto corrected = applyAlphaCorrection(c, _mm256_set1_epi16(gamma[0]), _mm256_set1_epi16(gamma[1]));
+    return mulQ14(corrected, _mm256_set1_epi16(p.foregroundAlpha));
+}
+
+// lerp(background, foregroundStraight, alpha) for [b, r] or [g, a] pairs. See grayscaleBlend8.
+DWRITE_TARGET_AVX2 static __m256i cleartypeLerp(__m256i x, __m256i fg, __m256i alpha) noexcept
+{
+    return roundChannel(_mm256_add_epi16(_mm256_slli_epi16(x, 5), _mm256_mulhrs_epi16(_mm256_sub_epi16(fg, _mm256_slli_epi16(x, 6)), alpha)));
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i cleartypeBlend8(__m256i d, __m256i alphaBR, __m256i alphaGA, __m256i fgBR, __m256i fgGA) noexcept
+{
+    const auto br = _mm256_and_si256(d, _mm256_set1_epi32(0x00ff00ff));
+    const auto ga = _mm256_srli_epi16(d, 8);
+    const auto outBR = cleartypeLerp(br, fgBR, alphaBR);
+    const auto outGA = cleartypeLerp(ga, fgGA, alphaGA);
+    return _mm256_or_si256(_mm256_or_si256(outBR, _mm256_slli_epi16(outGA, 8)), _mm256_set1_epi32(0xff000000));
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static void cleartypeBlend16(const DWrite_FixedBlendParams& p, __m256i glyph0, __m256i glyph1, __m256i& d0, __m256i& d1) noexcept
+{
+    const auto ab = cleartypeAlpha<0>(p, glyph0, glyph1);
+    const auto ag = cleartypeAlpha<8>(p, glyph0, glyph1);
+    const auto ar = cleartypeAlpha<16>(p, glyph0, glyph1);
+    // The alpha channel is overwritten with 0xff anyways, so we just lerp it with 0.
+    const auto zero = _mm256_setzero_si256();
+
+    const auto fgBR = _mm256_set1_epi32(static_cast<u16>(p.foregroundStraight[0]) | static_cast<u16>(p.foregroundStraight[2]) << 16);
+    const auto fgGA = _mm256_set1_epi32(static_cast<u16>(p.foregroundStraight[1]));
+    d0 = cleartypeBlend8(d0, _mm256_unpacklo_epi16(ab, ar), _mm256_unpacklo_epi16(ag, zero), fgBR, fgGA);
+    d1 = cleartypeBlend8(d1, _mm256_unpackhi_epi16(ab, ar), _mm256_unpackhi_epi16(ag, zero), fgBR, fgGA);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_CleartypeBlendSpanFixed_AVX2(const DWrite_FixedBlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        const auto glyph0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(glyphColor + i));
+        const auto glyph1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(glyphColor + i + 8));
+        auto d0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        auto d1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i + 8));
+        cleartypeBlend16(params, glyph0, glyph1, d0, d1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), d0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), d1);
+    }
+
+    if (const auto remaining = count - i)
+    {
+        const auto mask0 = tailMask(static_cast<int>(remaining));
+        const auto mask1 = tailMask(static_cast<int>(remaining) - 8);
+        const auto glyph0 = _mm256_maskload_epi32(reinterpret_cast<const int*>(glyphColor + i), mask0);
+        const auto glyph1 = _mm256_maskload_epi32(reinterpret_cast<const int*>(glyphColor + i + 8), mask1);
+        auto d0 = _mm256_maskload_epi32(reinterpret_cast<const int*>(dst + i), mask0);
+        auto d1 = _mm256_maskload_epi32(reinterpret_cast<const int*>(dst + i + 8), mask1);
+        cleartypeBlend16(params, glyph0, glyph1, d0, d1);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), mask0, d0);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i + 8), mask1, d1);
+    }
+}
+
+#endif
+
+static void accumulateError(DWrite_FixedBlendAccuracy& acc, u32 expected, u32 actual, u64& errorSum) noexcept
+{
+    for (int ch = 0; ch < 32; ch += 8)
+    {
+        const auto e = static_cast<i32>((expected >> ch) & 0xff);
+        const auto a = static_cast<i32>((actual >> ch) & 0xff);
+        const auto error = static_cast<u32>(e > a ? e - a : a - e);
+        acc.maxError = error > acc.maxError ? error : acc.maxError;
+        acc.histogram[error < 3 ? error : 3]++;
+        acc.samples++;
+        errorSum += error;
+    }
+}
+
+DWrite_FixedBlendAccuracy DWrite_MeasureFixedBlendAccuracy(const DWrite_BlendParams& params, bool cleartype) noexcept
+{
+    DWrite_FixedBlendParams fixedParams;
+    DWrite_GetFixedBlendParams(params, fixedParams);
+
+    DWrite_FixedBlendAccuracy acc;
+    u64 errorSum = 0;
+    u32 expected[256];
+    u32 actual[256];
+
+    if (cleartype)
+    {
+        // Every coverage value for each subpixel (the other two are set to different values
+        // to catch channel mix-ups) against every opaque gray background.
+        u32 glyph[256];
+        for (u32 i = 0; i < 256; ++i)
+        {
+            glyph[i] = i | ((255 - i) << 8) | ((i * 7 & 0xff) << 16);
+        }
+
+        for (u32 rotation = 0; rotation < 3; ++rotation)
+        {
+            for (u32 i = 0; i < 256; ++i)
+            {
+                const auto g = glyph[i];
+                glyph[i] = ((g << 8) | (g >> 16)) & 0xffffff;
+            }
+
+            for (u32 background = 0; background < 256; ++background)
+            {
+                for (auto& p : expected)
+                {
+                    p = 0xff000000 | background * 0x010101;
+                }
+                memcpy(&actual[0], &expected[0], sizeof(expected));
+
+                DWrite_CleartypeBlendSpan_Scalar(params, &glyph[0], &expected[0], 256);
+                DWrite_CleartypeBlendSpanFixed(fixedParams, &glyph[0], &actual[0], 256);
+
+                for (u32 i = 0; i < 256; ++i)
+                {
+                    accumulateError(acc, expected[i], actual[i], errorSum);
+                }
+            }
+        }
+    }
+    else
+    {
+        // Every coverage value against every opaque gray and every 50% transparent (premultiplied) gray.
+        u8 coverage[256];
+        for (u32 i = 0; i < 256; ++i)
+        {
+            coverage[i] = static_cast<u8>(i);
+        }
+
+        for (u32 background = 0; background < 512; ++background)
+        {
+            const auto value = background & 0xff;
+            const auto pixel = background < 256 ? 0xff000000 | value * 0x010101 : 0x80000000 | (value >> 1) * 0x010101;
+            for (auto& p : expected)
+            {
+                p = pixel;
+            }
+            memcpy(&actual[0], &expected[0], sizeof(expected));
+
+            DWrite_GrayscaleBlendSpan_Scalar(params, &coverage[0], &expected[0], 256);
+            DWrite_GrayscaleBlendSpanFixed(fixedParams, &coverage[0], &actual[0], 256);
+
+            for (u32 i = 0; i < 256; ++i)
+            {
+                accumulateError(acc, expected[i], actual[i], errorSum);
+            }
+        }
+    }
+
+    acc.meanError = acc.samples ? static_cast<f32>(static_cast<double>(errorSum) / static_cast<double>(acc.samples)) : 0.0f;
+    return acc;
+}
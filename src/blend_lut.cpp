@@ -0,0 +1,153 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "blend.h"
+
+#include <cstring>
+
+void DWrite_BuildGrayscaleLut(const DWrite_BlendParams& params, DWrite_GrayscaleLut& out) noexcept
+{
+    const f32x4 gammaRatios{ params.gammaRatios[0], params.gammaRatios[1], params.gammaRatios[2], params.gammaRatios[3] };
+    const auto& fg = params.foregroundColor;
+
+    // The per-foreground part of DWrite_GrayscaleBlend().
+    const auto foregroundStraight = DWrite_UnpremultiplyColor(fg);
+    const auto contrastBoost = params.isThinFont ? 0.5f : 0.0f;
+    const auto blendEnhancedContrast = contrastBoost + DWrite_ApplyLightOnDarkContrastAdjustment(params.grayscaleEnhancedContrast, foregroundStraight);
+    const auto intensity = DWrite_CalcColorIntensity({ fg.r, fg.g, fg.b });
+
+    for (int i = 0; i < 256; ++i)
+    {
+        const auto alpha = static_cast<f32>(i) * (1.0f / 255.0f);
+        const auto contrasted = DWrite_EnhanceContrast(alpha, blendEnhancedContrast);
+        const auto corrected = DWrite_ApplyAlphaCorrection(contrasted, intensity, gammaRatios);
+        out.corrected[i] = corrected;
+        // Same as the `1 - top.a` in DWrite_AlphaBlendPremultiplied().
+        out.inverseAlpha[i] = 1 - fg.a * corrected;
+    }
+
+    out.foregroundColor = fg;
+}
+
+void DWrite_GrayscaleBlendSpanLut_Scalar(const DWrite_GrayscaleLut& lut, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    const auto& fg = lut.foregroundColor;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto corrected = lut.corrected[glyphAlpha[i]];
+        const auto ia = lut.inverseAlpha[glyphAlpha[i]];
+        const auto bottom = DWrite_UnpackColor(dst[i]);
+        dst[i] = DWrite_PackColor({
+            bottom.r * ia + fg.r * corrected,
+            bottom.g * ia + fg.g * corrected,
+            bottom.b * ia + fg.b * corrected,
+            bottom.a * ia + fg.a * corrected,
+        });
+    }
+}
+
+static bool isSameLutFamily(const DWrite_GrayscaleLutCache& cache, const DWrite_BlendParams& params) noexcept
+{
+    return memcmp(&cache.gammaRatios[0], &params.gammaRatios[0], sizeof(cache.gammaRatios)) == 0 &&
+           cache.grayscaleEnhancedContrast == params.grayscaleEnhancedContrast &&
+           cache.isThinFont == params.isThinFont;
+}
+
+const DWrite_GrayscaleLut& DWrite_GetGrayscaleLut(DWrite_GrayscaleLutCache& cache, const DWrite_BlendParams& params) noexcept
+{
+    if (!isSameLutFamily(cache, params))
+    {
+        memcpy(&cache.gammaRatios[0], &params.gammaRatios[0], sizeof(cache.gammaRatios));
+        cache.grayscaleEnhancedContrast = params.grayscaleEnhancedContrast;
+        cache.isThinFont = params.isThinFont;
+        memset(&cache.lastUsed[0], 0, sizeof(cache.lastUsed));
+    }
+
+    cache.clock++;
+
+    u32 victim = 0;
+    for (u32 i = 0; i < DWrite_GrayscaleLutCache::capacity; ++i)
+    {
+        // Colors are compared bitwise, because that's cheaper and because NaN != NaN would otherwise never hit.
+        if (cache.lastUsed[i] && memcmp(&cache.entries[i].foregroundColor, &params.foregroundColor, sizeof(f32x4)) == 0)
+        {
+            cache.lastUsed[i] = cache.clock;
+            return cache.entries[i];
+        }
+        if (cache.lastUsed[i] < cache.lastUsed[victim])
+        {
+            victim = i;
+        }
+    }
+
+    auto& lut = cache.entries[victim];
+    DWrite_BuildGrayscaleLut(params, lut);
+    cache.lastUsed[victim] = cache.clock;
+    return lut;
+}
+
+void DWrite_GetCleartypeLevelColors(const DWrite_BlendParams& params, const f32x4& backgroundColor, f32x4 (&out)[7]) noexcept
+{
+    const f32x4 gammaRatios{ params.gammaRatios[0], params.gammaRatios[1], params.gammaRatios[2], params.gammaRatios[3] };
+
+    for (u32 level = 0; level < 7; ++level)
+    {
+        // The 8-bit atlas value of this level, rounded to nearest: 0, 43, 85, 128, 170, 213, 255.
+        const auto coverage = static_cast<f32>((level * 255 + 3) / 6) * (1.0f / 255.0f);
+        const f32x4 glyph{ coverage, coverage, coverage, coverage };
+        out[level] = DWrite_CleartypeBlend(gammaRatios, params.cleartypeEnhancedContrast, params.isThinFont, backgroundColor, params.foregroundColor, glyph);
+    }
+}
+
+void DWrite_BuildCleartypeLevelTable(const DWrite_BlendParams& params, u32 background, DWrite_CleartypeLevelTable& out) noexcept
+{
+    f32x4 colors[7];
+    DWrite_GetCleartypeLevelColors(params, DWrite_UnpackColor(background), colors);
+
+    for (u32 level = 0; level < 7; ++level)
+    {
+        out.levels[level] = DWrite_PackColor(colors[level]);
+    }
+    out.levels[7] = out.levels[6];
+}
+
+void DWrite_CleartypeBlendSpanLevels_Scalar(const DWrite_CleartypeLevelTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto glyph = glyphColor[i];
+        const auto b = table.levels[DWrite_CleartypeCoverageLevel(glyph & 0xff)] & 0x0000ff;
+        const auto g = table.levels[DWrite_CleartypeCoverageLevel((glyph >> 8) & 0xff)] & 0x00ff00;
+        const auto r = table.levels[DWrite_CleartypeCoverageLevel((glyph >> 16) & 0xff)] & 0xff0000;
+        dst[i] = 0xff000000 | r | g | b;
+    }
+}
+
+void DWrite_PackCleartypeCoverageSpan_Scalar(const u32* src, u16* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = DWrite_PackCleartypeCoverage(src[i]);
+    }
+}
+
+void DWrite_UnpackCleartypeCoverageSpan_Scalar(const u16* src, u32* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = DWrite_UnpackCleartypeCoverage(src[i]);
+    }
+}
+
+void DWrite_CleartypeBlendSpanPacked_Scalar(const DWrite_CleartypeLevelTable& table, const u16* glyph, u32* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto packed = glyph[i];
+        const auto b = table.levels[packed & 7] & 0x0000ff;
+        const auto g = table.levels[(packed >> 3) & 7] & 0x00ff00;
+        const auto r = table.levels[(packed >> 6) & 7] & 0xff0000;
+        dst[i] = 0xff000000 | r | g | b;
+    }
+}
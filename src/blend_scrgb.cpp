@@ -0,0 +1,133 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "blend.h"
+
+#include "color.h"
+
+#if DWRITE_BLEND_X86
+#include <immintrin.h>
+#endif
+
+static f32x4 loadF16x4(const f16x4& v) noexcept
+{
+    return { DWrite_F16ToF32(v.r), DWrite_F16ToF32(v.g), DWrite_F16ToF32(v.b), DWrite_F16ToF32(v.a) };
+}
+
+static f16x4 storeF16x4(const f32x4& v) noexcept
+{
+    return { DWrite_F32ToF16(v.r), DWrite_F32ToF16(v.g), DWrite_F32ToF16(v.b), DWrite_F32ToF16(v.a) };
+}
+
+void DWrite_GrayscaleBlendSpanScRgb_Scalar(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u8* glyphAlpha, f16x4* dst, size_t count) noexcept
+{
+    const auto constants = DWrite_GetGrayscaleBlendConstants(params);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto alpha = static_cast<f32>(glyphAlpha[i]) * (1.0f / 255.0f);
+        dst[i] = storeF16x4(DWrite_GrayscaleBlendScRgb(constants, sdrWhiteLevel, loadF16x4(dst[i]), alpha));
+    }
+}
+
+void DWrite_CleartypeBlendSpanScRgb_Scalar(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u32* glyphColor, f16x4* dst, size_t count) noexcept
+{
+    const auto constants = DWrite_GetCleartypeBlendConstants(params);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto glyph = DWrite_UnpackColor(glyphColor[i]);
+        dst[i] = storeF16x4(DWrite_CleartypeBlendScRgb(constants, sdrWhiteLevel, loadF16x4(dst[i]), glyph));
+    }
+}
+
+#if DWRITE_BLEND_X86
+
+// DWrite_EnhanceContrast + DWrite_ApplyAlphaCorrection for 8 coverage values in [0, 1].
+// The FMAs round differently than the separate multiplies and adds of the Scalar version, which is why
+// the AVX2 spans are only within 1 f16 ULP of it. Rarely, a value lands on the other side of a rounding boundary.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 correctCoverage(__m256 alpha, __m256 k, __m256 k1, __m256 g0, __m256 g1) noexcept
+{
+    const auto one = _mm256_set1_ps(1.0f);
+    const auto contrasted = _mm256_div_ps(_mm256_mul_ps(alpha, k1), _mm256_fmadd_ps(alpha, k, one));
+    const auto poly = _mm256_fmadd_ps(g0, contrasted, g1);
+    return _mm256_fmadd_ps(_mm256_mul_ps(contrasted, _mm256_sub_ps(one, contrasted)), poly, contrasted);
+}
+
+// The destination is stored as f16x4, so every ymm register holds 2 RGBA pixels. The per-pixel work is done
+// for 8 pixels at a time and then broadcast to the 4 channels of each pixel with a permute.
+DWRITE_TARGET_AVX2 void DWrite_GrayscaleBlendSpanScRgb_AVX2(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u8* glyphAlpha, f16x4* dst, size_t count) noexcept
+{
+    const auto c = DWrite_GetGrayscaleBlendConstants(params);
+    const auto k = _mm256_set1_ps(c.contrast[0]);
+    const auto k1 = _mm256_set1_ps(c.contrast[1]);
+    const auto g0 = _mm256_set1_ps(c.gamma0[0]);
+    const auto g1 = _mm256_set1_ps(c.gamma1[0]);
+    const auto alpha = _mm256_set1_ps(c.color[3]);
+    // The foreground color of 2 pixels, with RGB scaled to the SDR white level.
+    const auto color = _mm256_setr_ps(
+        c.color[0] * sdrWhiteLevel, c.color[1] * sdrWhiteLevel, c.color[2] * sdrWhiteLevel, c.color[3],
+        c.color[0] * sdrWhiteLevel, c.color[1] * sdrWhiteLevel, c.color[2] * sdrWhiteLevel, c.color[3]);
+    const auto one = _mm256_set1_ps(1.0f);
+    const auto d = reinterpret_cast<u16*>(dst);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto coverage = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(glyphAlpha + i))));
+        const auto corrected = correctCoverage(_mm256_mul_ps(coverage, _mm256_set1_ps(1.0f / 255.0f)), k, k1, g0, g1);
+        const auto inverse = _mm256_fnmadd_ps(alpha, corrected, one);
+
+        for (int j = 0; j < 4; ++j)
+        {
+            const auto index = _mm256_setr_epi32(2 * j, 2 * j, 2 * j, 2 * j, 2 * j + 1, 2 * j + 1, 2 * j + 1, 2 * j + 1);
+            const auto p = reinterpret_cast<__m128i*>(d + (i + 2 * j) * 4);
+            const auto background = _mm256_cvtph_ps(_mm_loadu_si128(p));
+            const auto top = _mm256_mul_ps(color, _mm256_permutevar8x32_ps(corrected, index));
+            const auto result = _mm256_fmadd_ps(background, _mm256_permutevar8x32_ps(inverse, index), top);
+            _mm_storeu_si128(p, _mm256_cvtps_ph(result, _MM_FROUND_TO_NEAREST_INT));
+        }
+    }
+
+    DWrite_GrayscaleBlendSpanScRgb_Scalar(params, sdrWhiteLevel, glyphAlpha + i, dst + i, count - i);
+}
+
+// ClearType has a coverage value per channel, so this works on 2 pixels at a time in RGBA order throughout.
+DWRITE_TARGET_AVX2 void DWrite_CleartypeBlendSpanScRgb_AVX2(const DWrite_BlendParams& params, f32 sdrWhiteLevel, const u32* glyphColor, f16x4* dst, size_t count) noexcept
+{
+    const auto c = DWrite_GetCleartypeBlendConstants(params);
+    const auto k = _mm256_set1_ps(c.contrast[0]);
+    const auto k1 = _mm256_set1_ps(c.contrast[1]);
+    const auto g0 = _mm256_setr_ps(c.gamma0[0], c.gamma0[1], c.gamma0[2], 0, c.gamma0[0], c.gamma0[1], c.gamma0[2], 0);
+    const auto g1 = _mm256_setr_ps(c.gamma1[0], c.gamma1[1], c.gamma1[2], 0, c.gamma1[0], c.gamma1[1], c.gamma1[2], 0);
+    const auto alpha = _mm256_set1_ps(c.color[3]);
+    const auto color = _mm256_setr_ps(
+        c.color[0] * sdrWhiteLevel, c.color[1] * sdrWhiteLevel, c.color[2] * sdrWhiteLevel, 1.0f,
+        c.color[0] * sdrWhiteLevel, c.color[1] * sdrWhiteLevel, c.color[2] * sdrWhiteLevel, 1.0f);
+    // B8G8R8A8 -> R8G8B8A8 within each pixel.
+    const auto swizzle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    const auto d = reinterpret_cast<u16*>(dst);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const auto glyph = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(glyphColor + i)), swizzle);
+
+        for (int j = 0; j < 2; ++j)
+        {
+            const auto bytes = j == 0 ? glyph : _mm_unpackhi_epi64(glyph, glyph);
+            const auto coverage = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), _mm256_set1_ps(1.0f / 255.0f));
+            const auto corrected = _mm256_mul_ps(correctCoverage(coverage, k, k1, g0, g1), alpha);
+            const auto p = reinterpret_cast<__m128i*>(d + (i + 2 * j) * 4);
+            const auto background = _mm256_cvtph_ps(_mm_loadu_si128(p));
+            // The target is opaque, so alpha is always 1, just like in DWrite_CleartypeBlendScRgb.
+            const auto blended = _mm256_fmadd_ps(corrected, _mm256_sub_ps(color, background), background);
+            const auto result = _mm256_blend_ps(blended, color, 0b10001000);
+            _mm_storeu_si128(p, _mm256_cvtps_ph(result, _MM_FROUND_TO_NEAREST_INT));
+        }
+    }
+
+    DWrite_CleartypeBlendSpanScRgb_Scalar(params, sdrWhiteLevel, glyphColor + i, dst + i, count - i);
+}
+
+#endif
@@ -0,0 +1,203 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "blend.h"
+
+#if DWRITE_BLEND_X86
+
+#include <cstring>
+
+#include <immintrin.h>
+
+// This is the same algorithm as blend_avx2.cpp, but for CPUs without AVX2.
+// Since these CPUs may also lack FMA, all multiply-adds are split up.
+
+struct GrayscaleConstantsSSE41
+{
+    __m128 k; // blendEnhancedContrast / 255
+    __m128 k1; // (blendEnhancedContrast + 1) / 255
+    __m128 g0; // gammaRatios.x * intensity + gammaRatios.y
+    __m128 g1; // gammaRatios.z * intensity + gammaRatios.w
+    // The premultiplied foreground color, scaled to 0-255.
+    __m128 r;
+    __m128 g;
+    __m128 b;
+    __m128 a;
+    // The unscaled foreground alpha.
+    __m128 alpha;
+};
+
+struct CleartypeConstantsSSE41
+{
+    __m128 k; // blendEnhancedContrast / 255
+    __m128 k1; // (blendEnhancedContrast + 1) / 255
+    // gammaRatios.x * foregroundStraight + gammaRatios.y
+    __m128 g0r;
+    __m128 g0g;
+    __m128 g0b;
+    // gammaRatios.z * foregroundStraight + gammaRatios.w
+    __m128 g1r;
+    __m128 g1g;
+    __m128 g1b;
+    // The straight foreground color, scaled to 0-255.
+    __m128 r;
+    __m128 g;
+    __m128 b;
+    // The unscaled foreground alpha.
+    __m128 alpha;
+};
+
+DWRITE_TARGET_SSE41 static GrayscaleConstantsSSE41 getGrayscaleConstants(const DWrite_BlendParams& params) noexcept
+{
+    const auto c = DWrite_GetGrayscaleBlendConstants(params);
+
+    return {
+        .k = _mm_set1_ps(c.contrast[0] / 255.0f),
+        .k1 = _mm_set1_ps(c.contrast[1] / 255.0f),
+        .g0 = _mm_set1_ps(c.gamma0[0]),
+        .g1 = _mm_set1_ps(c.gamma1[0]),
+        .r = _mm_set1_ps(c.color[0] * 255.0f),
+        .g = _mm_set1_ps(c.color[1] * 255.0f),
+        .b = _mm_set1_ps(c.color[2] * 255.0f),
+        .a = _mm_set1_ps(c.color[3] * 255.0f),
+        .alpha = _mm_set1_ps(c.color[3]),
+    };
+}
+
+DWRITE_TARGET_SSE41 static CleartypeConstantsSSE41 getCleartypeConstants(const DWrite_BlendParams& params) noexcept
+{
+    const auto c = DWrite_GetCleartypeBlendConstants(params);
+
+    return {
+        .k = _mm_set1_ps(c.contrast[0] / 255.0f),
+        .k1 = _mm_set1_ps(c.contrast[1] / 255.0f),
+        .g0r = _mm_set1_ps(c.gamma0[0]),
+        .g0g = _mm_set1_ps(c.gamma0[1]),
+        .g0b = _mm_set1_ps(c.gamma0[2]),
+        .g1r = _mm_set1_ps(c.gamma1[0]),
+        .g1g = _mm_set1_ps(c.gamma1[1]),
+        .g1b = _mm_set1_ps(c.gamma1[2]),
+        .r = _mm_set1_ps(c.color[0] * 255.0f),
+        .g = _mm_set1_ps(c.color[1] * 255.0f),
+        .b = _mm_set1_ps(c.color[2] * 255.0f),
+        .alpha = _mm_set1_ps(c.color[3]),
+    };
+}
+
+// _mm_rcp_ps (12 bits precision) followed by one Newton-Raphson step (~23 bits).
+DWRITE_TARGET_SSE41 static __m128 reciprocal(__m128 x) noexcept
+{
+    const auto r = _mm_rcp_ps(x);
+    return _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(2.0f), _mm_mul_ps(x, r)));
+}
+
+template<int Shift>
+DWRITE_TARGET_SSE41 static __m128 unpackChannel(__m128i pixels) noexcept
+{
+    return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, Shift), _mm_set1_epi32(0xff)));
+}
+
+DWRITE_TARGET_SSE41 static __m128i packPixels(__m128 b, __m128 g, __m128 r, __m128 a) noexcept
+{
+    const auto bg = _mm_packus_epi32(_mm_cvtps_epi32(b), _mm_cvtps_epi32(g));
+    const auto ra = _mm_packus_epi32(_mm_cvtps_epi32(r), _mm_cvtps_epi32(a));
+    const auto planar = _mm_packus_epi16(bg, ra);
+    return _mm_shuffle_epi8(planar, _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15));
+}
+
+DWRITE_TARGET_SSE41 static __m128 enhanceAndCorrect(__m128 coverage, __m128 k, __m128 k1, __m128 g0, __m128 g1) noexcept
+{
+    const auto one = _mm_set1_ps(1.0f);
+    const auto contrasted = _mm_mul_ps(_mm_mul_ps(coverage, k1), reciprocal(_mm_add_ps(_mm_mul_ps(coverage, k), one)));
+    const auto correction = _mm_add_ps(_mm_mul_ps(g0, contrasted), g1);
+    return _mm_add_ps(_mm_mul_ps(_mm_mul_ps(contrasted, _mm_sub_ps(one, contrasted)), correction), contrasted);
+}
+
+DWRITE_TARGET_SSE41 DWRITE_FORCEINLINE static __m128i grayscaleBlend4(const GrayscaleConstantsSSE41& c, __m128i coverage, __m128i dst) noexcept
+{
+    const auto corrected = enhanceAndCorrect(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(coverage)), c.k, c.k1, c.g0, c.g1);
+    const auto ia = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(c.alpha, corrected));
+
+    const auto b = _mm_add_ps(_mm_mul_ps(unpackChannel<0>(dst), ia), _mm_mul_ps(c.b, corrected));
+    const auto g = _mm_add_ps(_mm_mul_ps(unpackChannel<8>(dst), ia), _mm_mul_ps(c.g, corrected));
+    const auto r = _mm_add_ps(_mm_mul_ps(unpackChannel<16>(dst), ia), _mm_mul_ps(c.r, corrected));
+    const auto a = _mm_add_ps(_mm_mul_ps(unpackChannel<24>(dst), ia), _mm_mul_ps(c.a, corrected));
+
+    return packPixels(b, g, r, a);
+}
+
+DWRITE_TARGET_SSE41 DWRITE_FORCEINLINE static __m128i cleartypeBlend4(const CleartypeConstantsSSE41& c, __m128i glyph, __m128i dst) noexcept
+{
+    const auto ab = _mm_mul_ps(enhanceAndCorrect(unpackChannel<0>(glyph), c.k, c.k1, c.g0b, c.g1b), c.alpha);
+    const auto ag = _mm_mul_ps(enhanceAndCorrect(unpackChannel<8>(glyph), c.k, c.k1, c.g0g, c.g1g), c.alpha);
+    const auto ar = _mm_mul_ps(enhanceAndCorrect(unpackChannel<16>(glyph), c.k, c.k1, c.g0r, c.g1r), c.alpha);
+
+    const auto db = unpackChannel<0>(dst);
+    const auto dg = unpackChannel<8>(dst);
+    const auto dr = unpackChannel<16>(dst);
+    const auto b = _mm_add_ps(_mm_mul_ps(ab, _mm_sub_ps(c.b, db)), db);
+    const auto g = _mm_add_ps(_mm_mul_ps(ag, _mm_sub_ps(c.g, dg)), dg);
+    const auto r = _mm_add_ps(_mm_mul_ps(ar, _mm_sub_ps(c.r, dr)), dr);
+
+    return packPixels(b, g, r, _mm_set1_ps(255.0f));
+}
+
+DWRITE_TARGET_SSE41 void DWrite_GrayscaleBlendSpan_SSE41(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    const auto c = getGrayscaleConstants(params);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        int bytes;
+        memcpy(&bytes, glyphAlpha + i, 4);
+        if (!bytes)
+        {
+            continue;
+        }
+
+        const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), grayscaleBlend4(c, _mm_cvtsi32_si128(bytes), d));
+    }
+
+    // SSE has no masked loads/stores, so we bounce the tail through the stack.
+    if (const auto remaining = count - i)
+    {
+        int bytes = 0;
+        u32 pixels[4]{};
+        memcpy(&bytes, glyphAlpha + i, remaining);
+        memcpy(&pixels[0], dst + i, remaining * sizeof(u32));
+
+        const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pixels[0]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&pixels[0]), grayscaleBlend4(c, _mm_cvtsi32_si128(bytes), d));
+        memcpy(dst + i, &pixels[0], remaining * sizeof(u32));
+    }
+}
+
+DWRITE_TARGET_SSE41 void DWrite_CleartypeBlendSpan_SSE41(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    const auto c = getCleartypeConstants(params);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const auto glyph = _mm_loadu_si128(reinterpret_cast<const __m128i*>(glyphColor + i));
+        const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), cleartypeBlend4(c, glyph, d));
+    }
+
+    if (const auto remaining = count - i)
+    {
+        u32 glyphs[4]{};
+        u32 pixels[4]{};
+        memcpy(&glyphs[0], glyphColor + i, remaining * sizeof(u32));
+        memcpy(&pixels[0], dst + i, remaining * sizeof(u32));
+
+        const auto glyph = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&glyphs[0]));
+        const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pixels[0]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&pixels[0]), cleartypeBlend4(c, glyph, d));
+        memcpy(dst + i, &pixels[0], remaining * sizeof(u32));
+    }
+}
+
+#endif
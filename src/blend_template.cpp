@@ -0,0 +1,146 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "blend.h"
+
+#include "color.h"
+
+// DXGI_FORMAT_B8G8R8A8_UNORM_SRGB decodes each 8-bit color channel with DWrite_SrgbToLinear. There are only 256 of them.
+// Encoding goes through the 4096-entry table from color.h, which is within 1 of DWrite_LinearToSrgb().
+static const f32* const s_srgbToLinear = DWrite_GetSrgbDecodeTable();
+static const u8* const s_linearToSrgb = DWrite_GetSrgbEncodeTable();
+
+template<DWrite_TargetEncoding Encoding>
+static f32x4 loadColor(u32 bgra) noexcept
+{
+    if constexpr (Encoding == DWrite_TargetEncoding::Linear)
+    {
+        return {
+            s_srgbToLinear[(bgra >> 16) & 0xff],
+            s_srgbToLinear[(bgra >> 8) & 0xff],
+            s_srgbToLinear[bgra & 0xff],
+            static_cast<f32>(bgra >> 24) * (1.0f / 255.0f),
+        };
+    }
+    else
+    {
+        return DWrite_UnpackColor(bgra);
+    }
+}
+
+template<DWrite_TargetEncoding Encoding>
+static u32 storeColor(const f32x4& color) noexcept
+{
+    if constexpr (Encoding == DWrite_TargetEncoding::Linear)
+    {
+        const auto r = DWrite_EncodeSrgbChannel(s_linearToSrgb, color.r);
+        const auto g = DWrite_EncodeSrgbChannel(s_linearToSrgb, color.g);
+        const auto b = DWrite_EncodeSrgbChannel(s_linearToSrgb, color.b);
+        const auto a = static_cast<u32>(DWrite_Saturate(color.a) * 255.0f + 0.5f);
+        return (a << 24) | (r << 16) | (g << 8) | b;
+    }
+    else
+    {
+        return DWrite_PackColor(color);
+    }
+}
+
+template<DWrite_BlendMode Mode, bool IsThinFont, DWrite_TargetEncoding Encoding>
+void DWrite_BlendSpan(const DWrite_BlendParams& params, const DWrite_GlyphPixel<Mode>* glyphs, u32* dst, size_t count) noexcept
+{
+    static_assert(Mode != DWrite_BlendMode::ClearTypeLevels, "use DWrite_CleartypeBlendSpanLevels instead");
+
+    const f32x4 gammaRatios{ params.gammaRatios[0], params.gammaRatios[1], params.gammaRatios[2], params.gammaRatios[3] };
+    const auto& fg = params.foregroundColor;
+    const auto foregroundStraight = DWrite_UnpremultiplyColor(fg);
+    constexpr auto contrastBoost = IsThinFont ? 0.5f : 0.0f;
+
+    if constexpr (Mode == DWrite_BlendMode::Grayscale)
+    {
+        // The per-span part of DWrite_GrayscaleBlend.
+        const auto k = contrastBoost + DWrite_ApplyLightOnDarkContrastAdjustment(params.grayscaleEnhancedContrast, foregroundStraight);
+        const auto intensity = DWrite_CalcColorIntensity({ fg.r, fg.g, fg.b });
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto alpha = static_cast<f32>(glyphs[i]) * (1.0f / 255.0f);
+            const auto corrected = DWrite_ApplyAlphaCorrection(DWrite_EnhanceContrast(alpha, k), intensity, gammaRatios);
+            const f32x4 top{ fg.r * corrected, fg.g * corrected, fg.b * corrected, fg.a * corrected };
+            dst[i] = storeColor<Encoding>(DWrite_AlphaBlendPremultiplied(loadColor<Encoding>(dst[i]), top));
+        }
+    }
+    else if constexpr (Mode == DWrite_BlendMode::ClearType)
+    {
+        // The per-span part of DWrite_CleartypeBlend.
+        const auto k = contrastBoost + DWrite_ApplyLightOnDarkContrastAdjustment(params.cleartypeEnhancedContrast, foregroundStraight);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto glyph = DWrite_UnpackColor(glyphs[i]);
+            const auto background = loadColor<Encoding>(dst[i]);
+            const auto contrasted = DWrite_EnhanceContrast3({ glyph.r, glyph.g, glyph.b }, k);
+            const auto corrected = DWrite_ApplyAlphaCorrection3(contrasted, foregroundStraight, gammaRatios);
+            dst[i] = storeColor<Encoding>({
+                background.r + corrected.r * fg.a * (foregroundStraight.r - background.r),
+                background.g + corrected.g * fg.a * (foregroundStraight.g - background.g),
+                background.b + corrected.b * fg.a * (foregroundStraight.b - background.b),
+                1.0f,
+            });
+        }
+    }
+    else
+    {
+        static_assert(!IsThinFont, "the Primitive mode doesn't depend on IsThinFont");
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            // The atlas isn't gamma corrected (see dwrite.h), so the glyph is never decoded.
+            const auto glyph = DWrite_UnpackColor(glyphs[i]);
+            const f32x4 top{ fg.r * glyph.r, fg.g * glyph.g, fg.b * glyph.b, fg.a * glyph.a };
+            dst[i] = storeColor<Encoding>(DWrite_AlphaBlendPremultiplied(loadColor<Encoding>(dst[i]), top));
+        }
+    }
+}
+
+#define DWRITE_BLEND_SPAN_INSTANTIATE(mode, thin, encoding) \
+    template void DWrite_BlendSpan<DWrite_BlendMode::mode, thin, DWrite_TargetEncoding::encoding>(const DWrite_BlendParams&, const DWrite_GlyphPixel<DWrite_BlendMode::mode>*, u32*, size_t) noexcept;
+
+DWRITE_BLEND_SPAN_INSTANTIATE(Grayscale, false, Encoded)
+DWRITE_BLEND_SPAN_INSTANTIATE(Grayscale, false, Linear)
+DWRITE_BLEND_SPAN_INSTANTIATE(Grayscale, true, Encoded)
+DWRITE_BLEND_SPAN_INSTANTIATE(Grayscale, true, Linear)
+DWRITE_BLEND_SPAN_INSTANTIATE(ClearType, false, Encoded)
+DWRITE_BLEND_SPAN_INSTANTIATE(ClearType, false, Linear)
+DWRITE_BLEND_SPAN_INSTANTIATE(ClearType, true, Encoded)
+DWRITE_BLEND_SPAN_INSTANTIATE(ClearType, true, Linear)
+DWRITE_BLEND_SPAN_INSTANTIATE(Primitive, false, Encoded)
+DWRITE_BLEND_SPAN_INSTANTIATE(Primitive, false, Linear)
+
+#undef DWRITE_BLEND_SPAN_INSTANTIATE
+
+template<DWrite_BlendMode Mode, bool IsThinFont, DWrite_TargetEncoding Encoding>
+static void blendSpanErased(const DWrite_BlendParams& params, const void* glyphs, u32* dst, size_t count) noexcept
+{
+    DWrite_BlendSpan<Mode, IsThinFont, Encoding>(params, static_cast<const DWrite_GlyphPixel<Mode>*>(glyphs), dst, count);
+}
+
+template<DWrite_BlendMode Mode, bool IsThinFont>
+static DWrite_BlendSpanFunc getBlendSpan(DWrite_TargetEncoding encoding) noexcept
+{
+    return encoding == DWrite_TargetEncoding::Linear ? blendSpanErased<Mode, IsThinFont, DWrite_TargetEncoding::Linear> : blendSpanErased<Mode, IsThinFont, DWrite_TargetEncoding::Encoded>;
+}
+
+DWrite_BlendSpanFunc DWrite_GetBlendSpan(DWrite_BlendMode mode, bool isThinFont, DWrite_TargetEncoding encoding) noexcept
+{
+    switch (mode)
+    {
+    case DWrite_BlendMode::Grayscale:
+        return isThinFont ? getBlendSpan<DWrite_BlendMode::Grayscale, true>(encoding) : getBlendSpan<DWrite_BlendMode::Grayscale, false>(encoding);
+    case DWrite_BlendMode::ClearType:
+        return isThinFont ? getBlendSpan<DWrite_BlendMode::ClearType, true>(encoding) : getBlendSpan<DWrite_BlendMode::ClearType, false>(encoding);
+    case DWrite_BlendMode::Primitive:
+        return getBlendSpan<DWrite_BlendMode::Primitive, false>(encoding);
+    default:
+        return nullptr;
+    }
+}
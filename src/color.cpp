@@ -0,0 +1,1244 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "color.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if DWRITE_BLEND_X86
+#include <immintrin.h>
+#endif
+
+// The polynomials were fitted by Chebyshev interpolation over the non-linear part of the sRGB curve.
+// srgbToLinearPoly[i] is the coefficient of sqrt(x)^i for x^0.4 with x in [0.0904, 1] (x^2.4 = x^2 * x^0.4).
+static constexpr f32 srgbToLinearPoly[]{ 0.0372697258f, 1.32242875f, -0.753602521f, 0.67842689f, -0.372494036f, 0.087975149f };
+// linearToSrgbPoly[i] is the coefficient of q^i for 1.055 * q^(10/3) - 0.055 with q = c^0.25 in [0.2365, 1].
+static constexpr f32 linearToSrgbPoly[]{ -0.0597390114f, 0.141958263f, 1.35457265f, -0.825280017f, 0.621002284f, -0.294247637f, 0.0617343075f };
+
+static constexpr u32 encodeTableSize = 4096;
+
+const f32* DWrite_GetSrgbDecodeTable() noexcept
+{
+    static const auto table = [] {
+        struct
+        {
+            f32 data[256];
+        } t;
+        for (int i = 0; i < 256; ++i)
+        {
+            t.data[i] = DWrite_SrgbToLinear(static_cast<f32>(i) * (1.0f / 255.0f));
+        }
+        return t;
+    }();
+    return &table.data[0];
+}
+
+const u8* DWrite_GetSrgbEncodeTable() noexcept
+{
+    static const auto table = [] {
+        struct
+        {
+            u8 data[encodeTableSize + 3];
+        } t{};
+        for (u32 i = 0; i < encodeTableSize; ++i)
+        {
+            const auto c = DWrite_LinearToSrgb(static_cast<f32>(i) / static_cast<f32>(encodeTableSize - 1));
+            t.data[i] = static_cast<u8>(c * 255.0f + 0.5f);
+        }
+        return t;
+    }();
+    return &table.data[0];
+}
+
+static f32 srgbToLinear(f32 c) noexcept
+{
+    c = DWrite_Saturate(c);
+    const auto x = c * (1.0f / 1.055f) + (0.055f / 1.055f);
+    const auto s = std::sqrt(x);
+    auto p = srgbToLinearPoly[5];
+    for (int i = 4; i >= 0; --i)
+    {
+        p = p * s + srgbToLinearPoly[i];
+    }
+    return c <= 0.04045f ? c * (1.0f / 12.92f) : x * x * p;
+}
+
+static f32 linearToSrgb(f32 c) noexcept
+{
+    c = DWrite_Saturate(c);
+    const auto q = std::sqrt(std::sqrt(c));
+    auto p = linearToSrgbPoly[6];
+    for (int i = 5; i >= 0; --i)
+    {
+        p = p * q + linearToSrgbPoly[i];
+    }
+    return c <= 0.0031308f ? c * 12.92f : p;
+}
+
+void DWrite_SrgbToLinearSpan_Scalar(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto c = src[i];
+        dst[i] = { srgbToLinear(c.r), srgbToLinear(c.g), srgbToLinear(c.b), c.a };
+    }
+}
+
+void DWrite_LinearToSrgbSpan_Scalar(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto c = src[i];
+        dst[i] = { linearToSrgb(c.r), linearToSrgb(c.g), linearToSrgb(c.b), c.a };
+    }
+}
+
+void DWrite_DecodeSrgbSpan_Scalar(const u32* src, f32x4* dst, size_t count) noexcept
+{
+    const auto table = DWrite_GetSrgbDecodeTable();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto bgra = src[i];
+        dst[i] = {
+            table[(bgra >> 16) & 0xff],
+            table[(bgra >> 8) & 0xff],
+            table[bgra & 0xff],
+            static_cast<f32>(bgra >> 24) * (1.0f / 255.0f),
+        };
+    }
+}
+
+void DWrite_EncodeSrgbSpan_Scalar(const f32x4* src, u32* dst, size_t count) noexcept
+{
+    const auto table = DWrite_GetSrgbEncodeTable();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto& c = src[i];
+        const auto r = DWrite_EncodeSrgbChannel(table, c.r);
+        const auto g = DWrite_EncodeSrgbChannel(table, c.g);
+        const auto b = DWrite_EncodeSrgbChannel(table, c.b);
+        const auto a = static_cast<u32>(DWrite_Saturate(c.a) * 255.0f + 0.5f);
+        dst[i] = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+}
+
+void DWrite_PremultiplySpan_Scalar(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto c = src[i];
+        dst[i] = { c.r * c.a, c.g * c.a, c.b * c.a, c.a };
+    }
+}
+
+void DWrite_UnpremultiplySpan_Scalar(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto c = src[i];
+        const auto rgb = DWrite_UnpremultiplyColor(c);
+        dst[i] = { rgb.r, rgb.g, rgb.b, c.a };
+    }
+}
+
+// round(c * a / 255) without a division, exact for all c, a <= 255.
+static u32 premultiplyChannel(u32 c, u32 a) noexcept
+{
+    const auto t = c * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static u32 premultiplyPixel(u32 bgra) noexcept
+{
+    const auto a = bgra >> 24;
+    const auto r = premultiplyChannel((bgra >> 16) & 0xff, a);
+    const auto g = premultiplyChannel((bgra >> 8) & 0xff, a);
+    const auto b = premultiplyChannel(bgra & 0xff, a);
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+// The exact c * 255 / a is a multiple of 1/a, so it's either a tie (x.5) or at least 1/(2a) away from one.
+// Adding 0.25 / a moves the ties up, without moving any other value across a rounding boundary. The remaining
+// margin of at least 1/1020 is far larger than the error of a float reciprocal, which is why this rounds
+// exactly like the integer math, no matter whether inv is 1/a or the SIMD approximation of it.
+static u32 unpremultiplyChannel(u32 c, f32 inv) noexcept
+{
+    const auto q = (static_cast<f32>(c) * 255.0f + 0.25f) * inv;
+    return std::min(255u, static_cast<u32>(q + 0.5f));
+}
+
+static u32 unpremultiplyPixel(u32 bgra) noexcept
+{
+    const auto a = bgra >> 24;
+    // a = 0 gets a dummy value to keep the conversions below defined. The pixel is copied as is at the end.
+    const auto inv = a ? 1.0f / static_cast<f32>(a) : 0.0f;
+    const auto r = unpremultiplyChannel((bgra >> 16) & 0xff, inv);
+    const auto g = unpremultiplyChannel((bgra >> 8) & 0xff, inv);
+    const auto b = unpremultiplyChannel(bgra & 0xff, inv);
+    return a ? (a << 24) | (r << 16) | (g << 8) | b : bgra;
+}
+
+void DWrite_PremultiplyPixelSpan_Scalar(const u32* src, u32* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = premultiplyPixel(src[i]);
+    }
+}
+
+void DWrite_UnpremultiplyPixelSpan_Scalar(const u32* src, u32* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = unpremultiplyPixel(src[i]);
+    }
+}
+
+void DWrite_F32ToF16Span_Scalar(const f32x4* src, f16x4* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto c = src[i];
+        dst[i] = { DWrite_F32ToF16(c.r), DWrite_F32ToF16(c.g), DWrite_F32ToF16(c.b), DWrite_F32ToF16(c.a) };
+    }
+}
+
+void DWrite_F16ToF32Span_Scalar(const f16x4* src, f32x4* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto c = src[i];
+        dst[i] = { DWrite_F16ToF32(c.r), DWrite_F16ToF32(c.g), DWrite_F16ToF32(c.b), DWrite_F16ToF32(c.a) };
+    }
+}
+
+static u8 toUnorm8(f32 c) noexcept
+{
+    return static_cast<u8>(DWrite_Saturate(c) * 255.0f + 0.5f);
+}
+
+void DWrite_F32ToUnorm8Span_Scalar(const f32x4* src, u8x4* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto c = src[i];
+        dst[i] = { toUnorm8(c.r), toUnorm8(c.g), toUnorm8(c.b), toUnorm8(c.a) };
+    }
+}
+
+void DWrite_Unorm8ToF32Span_Scalar(const u8x4* src, f32x4* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto c = src[i];
+        dst[i] = {
+            static_cast<f32>(c.r) * (1.0f / 255.0f),
+            static_cast<f32>(c.g) * (1.0f / 255.0f),
+            static_cast<f32>(c.b) * (1.0f / 255.0f),
+            static_cast<f32>(c.a) * (1.0f / 255.0f),
+        };
+    }
+}
+
+DWrite_ColorBatch::DWrite_ColorBatch(size_t size)
+{
+    Resize(size);
+}
+
+void DWrite_ColorBatch::Resize(size_t size)
+{
+    const auto blocksPerPlane = (size + 15) / 16;
+    // make_unique value-initializes the blocks, which zeroes them.
+    _blocks = std::make_unique<Block[]>(blocksPerPlane * 4);
+    _size = size;
+    _blocksPerPlane = blocksPerPlane;
+}
+
+size_t DWrite_ColorBatch::Size() const noexcept
+{
+    return _size;
+}
+
+size_t DWrite_ColorBatch::PaddedSize() const noexcept
+{
+    return _blocksPerPlane * 16;
+}
+
+f32* DWrite_ColorBatch::Plane(u32 index) noexcept
+{
+    return _blocks ? &_blocks[index * _blocksPerPlane].values[0] : nullptr;
+}
+
+const f32* DWrite_ColorBatch::Plane(u32 index) const noexcept
+{
+    return _blocks ? &_blocks[index * _blocksPerPlane].values[0] : nullptr;
+}
+
+void DWrite_LoadColorBatch_Scalar(const f32x4* src, DWrite_ColorBatch& dst, size_t count) noexcept
+{
+    const auto r = dst.R();
+    const auto g = dst.G();
+    const auto b = dst.B();
+    const auto a = dst.A();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto c = src[i];
+        r[i] = c.r;
+        g[i] = c.g;
+        b[i] = c.b;
+        a[i] = c.a;
+    }
+}
+
+void DWrite_StoreColorBatch_Scalar(const DWrite_ColorBatch& src, f32x4* dst, size_t count) noexcept
+{
+    const auto r = src.R();
+    const auto g = src.G();
+    const auto b = src.B();
+    const auto a = src.A();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = { r[i], g[i], b[i], a[i] };
+    }
+}
+
+void DWrite_LoadColorBatchPixels_Scalar(const u32* src, DWrite_ColorBatch& dst, size_t count) noexcept
+{
+    const auto r = dst.R();
+    const auto g = dst.G();
+    const auto b = dst.B();
+    const auto a = dst.A();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto c = DWrite_UnpackColor(src[i]);
+        r[i] = c.r;
+        g[i] = c.g;
+        b[i] = c.b;
+        a[i] = c.a;
+    }
+}
+
+void DWrite_StoreColorBatchPixels_Scalar(const DWrite_ColorBatch& src, u32* dst, size_t count) noexcept
+{
+    const auto r = src.R();
+    const auto g = src.G();
+    const auto b = src.B();
+    const auto a = src.A();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = DWrite_PackColor({ r[i], g[i], b[i], a[i] });
+    }
+}
+
+void DWrite_SrgbToLinearBatch_Scalar(DWrite_ColorBatch& colors) noexcept
+{
+    for (u32 p = 0; p < 3; ++p)
+    {
+        const auto plane = colors.Plane(p);
+        for (size_t i = 0; i < colors.Size(); ++i)
+        {
+            plane[i] = srgbToLinear(plane[i]);
+        }
+    }
+}
+
+void DWrite_LinearToSrgbBatch_Scalar(DWrite_ColorBatch& colors) noexcept
+{
+    for (u32 p = 0; p < 3; ++p)
+    {
+        const auto plane = colors.Plane(p);
+        for (size_t i = 0; i < colors.Size(); ++i)
+        {
+            plane[i] = linearToSrgb(plane[i]);
+        }
+    }
+}
+
+void DWrite_PremultiplyBatch_Scalar(DWrite_ColorBatch& colors) noexcept
+{
+    const auto a = colors.A();
+
+    for (u32 p = 0; p < 3; ++p)
+    {
+        const auto plane = colors.Plane(p);
+        for (size_t i = 0; i < colors.Size(); ++i)
+        {
+            plane[i] *= a[i];
+        }
+    }
+}
+
+void DWrite_UnpremultiplyBatch_Scalar(DWrite_ColorBatch& colors) noexcept
+{
+    const auto a = colors.A();
+
+    for (u32 p = 0; p < 3; ++p)
+    {
+        const auto plane = colors.Plane(p);
+        for (size_t i = 0; i < colors.Size(); ++i)
+        {
+            // Same as DWrite_UnpremultiplyColor().
+            plane[i] = a[i] != 0 ? plane[i] / a[i] : plane[i];
+        }
+    }
+}
+
+void DWrite_GrayscaleBlendBatch_Scalar(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const f32* glyphAlpha, DWrite_ColorBatch& dst) noexcept
+{
+    const f32x4 gammaRatios{ params.gammaRatios[0], params.gammaRatios[1], params.gammaRatios[2], params.gammaRatios[3] };
+    const auto fr = foreground.R();
+    const auto fg = foreground.G();
+    const auto fb = foreground.B();
+    const auto fa = foreground.A();
+    const auto r = dst.R();
+    const auto g = dst.G();
+    const auto b = dst.B();
+    const auto a = dst.A();
+
+    for (size_t i = 0; i < dst.Size(); ++i)
+    {
+        const auto top = DWrite_GrayscaleBlend(gammaRatios, params.grayscaleEnhancedContrast, params.isThinFont, { fr[i], fg[i], fb[i], fa[i] }, glyphAlpha[i]);
+        const auto c = DWrite_AlphaBlendPremultiplied({ r[i], g[i], b[i], a[i] }, top);
+        r[i] = c.r;
+        g[i] = c.g;
+        b[i] = c.b;
+        a[i] = c.a;
+    }
+}
+
+void DWrite_CleartypeBlendBatch_Scalar(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const DWrite_ColorBatch& glyph, DWrite_ColorBatch& dst) noexcept
+{
+    const f32x4 gammaRatios{ params.gammaRatios[0], params.gammaRatios[1], params.gammaRatios[2], params.gammaRatios[3] };
+    const auto fr = foreground.R();
+    const auto fg = foreground.G();
+    const auto fb = foreground.B();
+    const auto fa = foreground.A();
+    const auto gr = glyph.R();
+    const auto gg = glyph.G();
+    const auto gb = glyph.B();
+    const auto r = dst.R();
+    const auto g = dst.G();
+    const auto b = dst.B();
+    const auto a = dst.A();
+
+    for (size_t i = 0; i < dst.Size(); ++i)
+    {
+        const auto c = DWrite_CleartypeBlend(gammaRatios, params.cleartypeEnhancedContrast, params.isThinFont, { r[i], g[i], b[i], a[i] }, { fr[i], fg[i], fb[i], fa[i] }, { gr[i], gg[i], gb[i], 0 });
+        r[i] = c.r;
+        g[i] = c.g;
+        b[i] = c.b;
+        a[i] = c.a;
+    }
+}
+
+#if DWRITE_BLEND_X86
+
+// The f32x4 spans process 2 colors per __m256. The alpha channel is every 4th float.
+static constexpr int alphaLanes = 0x88;
+
+// Same as DWrite_Saturate(): _mm256_max_ps returns the second operand if the first one is NaN.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 saturate(__m256 v) noexcept
+{
+    return _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+}
+
+// The color channel part of srgbToLinear8(): Converts all 8 floats.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 srgbToLinearCurve(__m256 v) noexcept
+{
+    const auto c = saturate(v);
+    const auto x = _mm256_fmadd_ps(c, _mm256_set1_ps(1.0f / 1.055f), _mm256_set1_ps(0.055f / 1.055f));
+    const auto s = _mm256_sqrt_ps(x);
+    auto p = _mm256_set1_ps(srgbToLinearPoly[5]);
+    for (int i = 4; i >= 0; --i)
+    {
+        p = _mm256_fmadd_ps(p, s, _mm256_set1_ps(srgbToLinearPoly[i]));
+    }
+    const auto curve = _mm256_mul_ps(_mm256_mul_ps(x, x), p);
+    const auto linear = _mm256_mul_ps(c, _mm256_set1_ps(1.0f / 12.92f));
+    return _mm256_blendv_ps(curve, linear, _mm256_cmp_ps(c, _mm256_set1_ps(0.04045f), _CMP_LE_OQ));
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 srgbToLinear8(__m256 v) noexcept
+{
+    return _mm256_blend_ps(srgbToLinearCurve(v), v, alphaLanes);
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 linearToSrgbCurve(__m256 v) noexcept
+{
+    const auto c = saturate(v);
+    const auto q = _mm256_sqrt_ps(_mm256_sqrt_ps(c));
+    auto p = _mm256_set1_ps(linearToSrgbPoly[6]);
+    for (int i = 5; i >= 0; --i)
+    {
+        p = _mm256_fmadd_ps(p, q, _mm256_set1_ps(linearToSrgbPoly[i]));
+    }
+    const auto linear = _mm256_mul_ps(c, _mm256_set1_ps(12.92f));
+    return _mm256_blendv_ps(p, linear, _mm256_cmp_ps(c, _mm256_set1_ps(0.0031308f), _CMP_LE_OQ));
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 linearToSrgb8(__m256 v) noexcept
+{
+    return _mm256_blend_ps(linearToSrgbCurve(v), v, alphaLanes);
+}
+
+template<__m256 (*Convert)(__m256)>
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static void convertColors(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    const auto s = reinterpret_cast<const f32*>(src);
+    const auto d = reinterpret_cast<f32*>(dst);
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2)
+    {
+        _mm256_storeu_ps(d + i * 4, Convert(_mm256_loadu_ps(s + i * 4)));
+    }
+
+    if (i < count)
+    {
+        // One color left: Only load and store the lower 4 floats.
+        const auto mask = _mm256_setr_epi32(-1, -1, -1, -1, 0, 0, 0, 0);
+        _mm256_maskstore_ps(d + i * 4, mask, Convert(_mm256_maskload_ps(s + i * 4, mask)));
+    }
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 premultiply8(__m256 v) noexcept
+{
+    const auto a = _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm256_mul_ps(v, _mm256_blend_ps(a, _mm256_set1_ps(1.0f), alphaLanes));
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 unpremultiply8(__m256 v) noexcept
+{
+    const auto a = _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3));
+    // rcp has a relative error of up to 1.5 * 2^-12. One Newton-Raphson step r * (2 - a * r) squares that.
+    const auto r0 = _mm256_rcp_ps(a);
+    const auto r1 = _mm256_mul_ps(r0, _mm256_fnmadd_ps(a, r0, _mm256_set1_ps(2.0f)));
+    // Colors with a = 0 are kept as is, just like DWrite_UnpremultiplyColor(). rcp(0) is inf, but that gets masked away.
+    const auto zero = _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_EQ_OQ);
+    const auto result = _mm256_blendv_ps(_mm256_mul_ps(v, r1), v, zero);
+    return _mm256_blend_ps(result, v, alphaLanes);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_SrgbToLinearSpan_AVX2(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    convertColors<srgbToLinear8>(src, dst, count);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_LinearToSrgbSpan_AVX2(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    convertColors<linearToSrgb8>(src, dst, count);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_PremultiplySpan_AVX2(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    convertColors<premultiply8>(src, dst, count);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_UnpremultiplySpan_AVX2(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    convertColors<unpremultiply8>(src, dst, count);
+}
+
+// Transposes 4 planes of 8 floats into 8 (r, g, b, a) colors and stores them.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static void storeTransposed(f32* dst, __m256 r, __m256 g, __m256 b, __m256 a) noexcept
+{
+    const auto rg0 = _mm256_unpacklo_ps(r, g); // r0 g0 r1 g1 | r4 g4 r5 g5
+    const auto rg1 = _mm256_unpackhi_ps(r, g); // r2 g2 r3 g3 | r6 g6 r7 g7
+    const auto ba0 = _mm256_unpacklo_ps(b, a);
+    const auto ba1 = _mm256_unpackhi_ps(b, a);
+    const auto c04 = _mm256_shuffle_ps(rg0, ba0, _MM_SHUFFLE(1, 0, 1, 0));
+    const auto c15 = _mm256_shuffle_ps(rg0, ba0, _MM_SHUFFLE(3, 2, 3, 2));
+    const auto c26 = _mm256_shuffle_ps(rg1, ba1, _MM_SHUFFLE(1, 0, 1, 0));
+    const auto c37 = _mm256_shuffle_ps(rg1, ba1, _MM_SHUFFLE(3, 2, 3, 2));
+    _mm256_storeu_ps(dst + 0, _mm256_permute2f128_ps(c04, c15, 0x20));
+    _mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(c26, c37, 0x20));
+    _mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(c04, c15, 0x31));
+    _mm256_storeu_ps(dst + 24, _mm256_permute2f128_ps(c26, c37, 0x31));
+}
+
+DWRITE_TARGET_AVX2 void DWrite_DecodeSrgbSpan_AVX2(const u32* src, f32x4* dst, size_t count) noexcept
+{
+    const auto table = DWrite_GetSrgbDecodeTable();
+    const auto mask = _mm256_set1_epi32(0xff);
+    const auto d = reinterpret_cast<f32*>(dst);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const auto r = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_srli_epi32(px, 16), mask), 4);
+        const auto g = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_srli_epi32(px, 8), mask), 4);
+        const auto b = _mm256_i32gather_ps(table, _mm256_and_si256(px, mask), 4);
+        const auto a = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(px, 24)), _mm256_set1_ps(1.0f / 255.0f));
+        storeTransposed(d + i * 4, r, g, b, a);
+    }
+
+    // The table lookups are exact, so the scalar tail produces identical results.
+    DWrite_DecodeSrgbSpan_Scalar(src + i, dst + i, count - i);
+}
+
+// Turns 2 colors into (r, g, b, a) integers: Table indices for the color channels and 8-bit alpha.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i encode2(const u8* table, const f32* src) noexcept
+{
+    const auto scale = _mm256_setr_ps(4095.0f, 4095.0f, 4095.0f, 255.0f, 4095.0f, 4095.0f, 4095.0f, 255.0f);
+    const auto v = _mm256_add_ps(_mm256_mul_ps(saturate(_mm256_loadu_ps(src)), scale), _mm256_set1_ps(0.5f));
+    const auto index = _mm256_cvttps_epi32(v);
+    // Gathers 32 bits at byte offsets, which is why the table is padded by 3 bytes.
+    const auto encoded = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(table), index, 1), _mm256_set1_epi32(0xff));
+    return _mm256_blend_epi32(encoded, index, alphaLanes);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_EncodeSrgbSpan_AVX2(const f32x4* src, u32* dst, size_t count) noexcept
+{
+    static_assert(encodeTableSize - 1 == 4095);
+
+    const auto table = DWrite_GetSrgbEncodeTable();
+    const auto s = reinterpret_cast<const f32*>(src);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto c01 = encode2(table, s + i * 4 + 0);
+        const auto c23 = encode2(table, s + i * 4 + 8);
+        const auto c45 = encode2(table, s + i * 4 + 16);
+        const auto c67 = encode2(table, s + i * 4 + 24);
+        // The packs operate per 128-bit lane, which results in the bytes of colors 0 2 4 6 | 1 3 5 7.
+        const auto packed = _mm256_packus_epi16(_mm256_packus_epi32(c01, c23), _mm256_packus_epi32(c45, c67));
+        // Swizzle RGBA into BGRA and restore the order of the pixels.
+        const auto bgra = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+        const auto ordered = _mm256_permutevar8x32_epi32(bgra, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), ordered);
+    }
+
+    DWrite_EncodeSrgbSpan_Scalar(src + i, dst + i, count - i);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_PremultiplyPixelSpan_AVX2(const u32* src, u32* dst, size_t count) noexcept
+{
+    // For each pixel the 16-bit lanes of B, G and R are multiplied with its alpha and the alpha lane with 255,
+    // which premultiplyChannel() turns back into alpha. The lo/hi unpacks hold pixels 0 1 4 5 and 2 3 6 7.
+    const auto alphaLo = _mm256_setr_epi8(3, -1, 3, -1, 3, -1, -1, -1, 7, -1, 7, -1, 7, -1, -1, -1, 3, -1, 3, -1, 3, -1, -1, -1, 7, -1, 7, -1, 7, -1, -1, -1);
+    const auto alphaHi = _mm256_setr_epi8(11, -1, 11, -1, 11, -1, -1, -1, 15, -1, 15, -1, 15, -1, -1, -1, 11, -1, 11, -1, 11, -1, -1, -1, 15, -1, 15, -1, 15, -1, -1, -1);
+    const auto opaque = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+    const auto half = _mm256_set1_epi16(128);
+    const auto zero = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const auto mulLo = _mm256_or_si256(_mm256_shuffle_epi8(px, alphaLo), opaque);
+        const auto mulHi = _mm256_or_si256(_mm256_shuffle_epi8(px, alphaHi), opaque);
+        const auto tLo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(px, zero), mulLo), half);
+        const auto tHi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(px, zero), mulHi), half);
+        const auto lo = _mm256_srli_epi16(_mm256_add_epi16(tLo, _mm256_srli_epi16(tLo, 8)), 8);
+        const auto hi = _mm256_srli_epi16(_mm256_add_epi16(tHi, _mm256_srli_epi16(tHi, 8)), 8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    DWrite_PremultiplyPixelSpan_Scalar(src + i, dst + i, count - i);
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i unpremultiplyChannel8(__m256i c, __m256 inv) noexcept
+{
+    // See unpremultiplyChannel(). The ties are gone, so it doesn't matter that cvtps rounds to even.
+    const auto q = _mm256_mul_ps(_mm256_fmadd_ps(_mm256_cvtepi32_ps(c), _mm256_set1_ps(255.0f), _mm256_set1_ps(0.25f)), inv);
+    return _mm256_min_epi32(_mm256_cvtps_epi32(q), _mm256_set1_epi32(255));
+}
+
+DWRITE_TARGET_AVX2 void DWrite_UnpremultiplyPixelSpan_AVX2(const u32* src, u32* dst, size_t count) noexcept
+{
+    const auto mask = _mm256_set1_epi32(0xff);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const auto ai = _mm256_srli_epi32(px, 24);
+        const auto a = _mm256_cvtepi32_ps(ai);
+        const auto r0 = _mm256_rcp_ps(a);
+        const auto inv = _mm256_mul_ps(r0, _mm256_fnmadd_ps(a, r0, _mm256_set1_ps(2.0f)));
+        const auto r = unpremultiplyChannel8(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask), inv);
+        const auto g = unpremultiplyChannel8(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask), inv);
+        const auto b = unpremultiplyChannel8(_mm256_and_si256(px, mask), inv);
+        const auto bgra = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(ai, 24), _mm256_slli_epi32(r, 16)), _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+        // Pixels with a = 0 are copied as is. For them inv is inf and the channels contain garbage.
+        const auto transparent = _mm256_cmpeq_epi32(ai, _mm256_setzero_si256());
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_blendv_epi8(bgra, px, transparent));
+    }
+
+    DWrite_UnpremultiplyPixelSpan_Scalar(src + i, dst + i, count - i);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_F32ToF16Span_AVX2(const f32x4* src, f16x4* dst, size_t count) noexcept
+{
+    const auto s = reinterpret_cast<const f32*>(src);
+    const auto d = reinterpret_cast<u16*>(dst);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const auto lo = _mm256_cvtps_ph(_mm256_loadu_ps(s + i * 4 + 0), _MM_FROUND_TO_NEAREST_INT);
+        const auto hi = _mm256_cvtps_ph(_mm256_loadu_ps(s + i * 4 + 8), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i * 4), _mm256_setr_m128i(lo, hi));
+    }
+
+    for (; i < count; ++i)
+    {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(d + i * 4), _mm_cvtps_ph(_mm_loadu_ps(s + i * 4), _MM_FROUND_TO_NEAREST_INT));
+    }
+}
+
+DWRITE_TARGET_AVX2 void DWrite_F16ToF32Span_AVX2(const f16x4* src, f32x4* dst, size_t count) noexcept
+{
+    const auto s = reinterpret_cast<const u16*>(src);
+    const auto d = reinterpret_cast<f32*>(dst);
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2)
+    {
+        _mm256_storeu_ps(d + i * 4, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i * 4))));
+    }
+
+    if (i < count)
+    {
+        _mm_storeu_ps(d + i * 4, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + i * 4))));
+    }
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i toUnorm8x8(const f32* src) noexcept
+{
+    // Same as toUnorm8(): Truncating after adding 0.5 rounds ties up, while _mm256_cvtps_epi32 would round them to even.
+    const auto v = _mm256_fmadd_ps(saturate(_mm256_loadu_ps(src)), _mm256_set1_ps(255.0f), _mm256_set1_ps(0.5f));
+    return _mm256_cvttps_epi32(v);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_F32ToUnorm8Span_AVX2(const f32x4* src, u8x4* dst, size_t count) noexcept
+{
+    const auto s = reinterpret_cast<const f32*>(src);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto c01 = toUnorm8x8(s + i * 4 + 0);
+        const auto c23 = toUnorm8x8(s + i * 4 + 8);
+        const auto c45 = toUnorm8x8(s + i * 4 + 16);
+        const auto c67 = toUnorm8x8(s + i * 4 + 24);
+        // The packs operate per 128-bit lane, which results in the colors 0 2 4 6 | 1 3 5 7.
+        const auto packed = _mm256_packus_epi16(_mm256_packus_epi32(c01, c23), _mm256_packus_epi32(c45, c67));
+        const auto ordered = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), ordered);
+    }
+
+    DWrite_F32ToUnorm8Span_Scalar(src + i, dst + i, count - i);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_Unorm8ToF32Span_AVX2(const u8x4* src, f32x4* dst, size_t count) noexcept
+{
+    const auto d = reinterpret_cast<f32*>(dst);
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2)
+    {
+        const auto c = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+        _mm256_storeu_ps(d + i * 4, _mm256_mul_ps(_mm256_cvtepi32_ps(c), _mm256_set1_ps(1.0f / 255.0f)));
+    }
+
+    DWrite_Unorm8ToF32Span_Scalar(src + i, dst + i, count - i);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_LoadColorBatch_AVX2(const f32x4* src, DWrite_ColorBatch& dst, size_t count) noexcept
+{
+    const auto s = reinterpret_cast<const f32*>(src);
+    const auto r = dst.R();
+    const auto g = dst.G();
+    const auto b = dst.B();
+    const auto a = dst.A();
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        // The inverse of storeTransposed(): Put colors 0-3 in the low and 4-7 in the high lanes and transpose each 4x4 block.
+        const auto c04 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(s + i * 4 + 0)), _mm_loadu_ps(s + i * 4 + 16), 1);
+        const auto c15 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(s + i * 4 + 4)), _mm_loadu_ps(s + i * 4 + 20), 1);
+        const auto c26 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(s + i * 4 + 8)), _mm_loadu_ps(s + i * 4 + 24), 1);
+        const auto c37 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(s + i * 4 + 12)), _mm_loadu_ps(s + i * 4 + 28), 1);
+        const auto rg01 = _mm256_unpacklo_ps(c04, c15); // r0 r1 g0 g1 | r4 r5 g4 g5
+        const auto ba01 = _mm256_unpackhi_ps(c04, c15); // b0 b1 a0 a1 | b4 b5 a4 a5
+        const auto rg23 = _mm256_unpacklo_ps(c26, c37);
+        const auto ba23 = _mm256_unpackhi_ps(c26, c37);
+        _mm256_store_ps(r + i, _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(1, 0, 1, 0)));
+        _mm256_store_ps(g + i, _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(3, 2, 3, 2)));
+        _mm256_store_ps(b + i, _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(1, 0, 1, 0)));
+        _mm256_store_ps(a + i, _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(3, 2, 3, 2)));
+    }
+
+    for (; i < count; ++i)
+    {
+        const auto c = src[i];
+        r[i] = c.r;
+        g[i] = c.g;
+        b[i] = c.b;
+        a[i] = c.a;
+    }
+}
+
+DWRITE_TARGET_AVX2 void DWrite_StoreColorBatch_AVX2(const DWrite_ColorBatch& src, f32x4* dst, size_t count) noexcept
+{
+    const auto d = reinterpret_cast<f32*>(dst);
+    const auto r = src.R();
+    const auto g = src.G();
+    const auto b = src.B();
+    const auto a = src.A();
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        storeTransposed(d + i * 4, _mm256_load_ps(r + i), _mm256_load_ps(g + i), _mm256_load_ps(b + i), _mm256_load_ps(a + i));
+    }
+
+    for (; i < count; ++i)
+    {
+        dst[i] = { r[i], g[i], b[i], a[i] };
+    }
+}
+
+DWRITE_TARGET_AVX2 void DWrite_LoadColorBatchPixels_AVX2(const u32* src, DWrite_ColorBatch& dst, size_t count) noexcept
+{
+    const auto mask = _mm256_set1_epi32(0xff);
+    const auto scale = _mm256_set1_ps(1.0f / 255.0f);
+    const auto r = dst.R();
+    const auto g = dst.G();
+    const auto b = dst.B();
+    const auto a = dst.A();
+    size_t i = 0;
+
+    // Pixels are already planar per channel, once shifted and masked. No shuffles needed.
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_store_ps(r + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask)), scale));
+        _mm256_store_ps(g + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask)), scale));
+        _mm256_store_ps(b + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(px, mask)), scale));
+        _mm256_store_ps(a + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(px, 24)), scale));
+    }
+
+    for (; i < count; ++i)
+    {
+        const auto c = DWrite_UnpackColor(src[i]);
+        r[i] = c.r;
+        g[i] = c.g;
+        b[i] = c.b;
+        a[i] = c.a;
+    }
+}
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256i toUnorm8Plane(const f32* src) noexcept
+{
+    return _mm256_cvttps_epi32(_mm256_fmadd_ps(saturate(_mm256_load_ps(src)), _mm256_set1_ps(255.0f), _mm256_set1_ps(0.5f)));
+}
+
+DWRITE_TARGET_AVX2 void DWrite_StoreColorBatchPixels_AVX2(const DWrite_ColorBatch& src, u32* dst, size_t count) noexcept
+{
+    const auto r = src.R();
+    const auto g = src.G();
+    const auto b = src.B();
+    const auto a = src.A();
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto rg = _mm256_or_si256(_mm256_slli_epi32(toUnorm8Plane(r + i), 16), _mm256_slli_epi32(toUnorm8Plane(g + i), 8));
+        const auto ba = _mm256_or_si256(toUnorm8Plane(b + i), _mm256_slli_epi32(toUnorm8Plane(a + i), 24));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(rg, ba));
+    }
+
+    for (; i < count; ++i)
+    {
+        dst[i] = DWrite_PackColor({ r[i], g[i], b[i], a[i] });
+    }
+}
+
+// The batch functions below process entire planes including the padding, which is why they don't need a tail.
+template<__m256 (*Convert)(__m256)>
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static void convertColorPlanes(DWrite_ColorBatch& colors) noexcept
+{
+    for (u32 p = 0; p < 3; ++p)
+    {
+        const auto plane = colors.Plane(p);
+        for (size_t i = 0; i < colors.PaddedSize(); i += 8)
+        {
+            _mm256_store_ps(plane + i, Convert(_mm256_load_ps(plane + i)));
+        }
+    }
+}
+
+DWRITE_TARGET_AVX2 void DWrite_SrgbToLinearBatch_AVX2(DWrite_ColorBatch& colors) noexcept
+{
+    convertColorPlanes<srgbToLinearCurve>(colors);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_LinearToSrgbBatch_AVX2(DWrite_ColorBatch& colors) noexcept
+{
+    convertColorPlanes<linearToSrgbCurve>(colors);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_PremultiplyBatch_AVX2(DWrite_ColorBatch& colors) noexcept
+{
+    const auto r = colors.R();
+    const auto g = colors.G();
+    const auto b = colors.B();
+    const auto a = colors.A();
+
+    for (size_t i = 0; i < colors.PaddedSize(); i += 8)
+    {
+        const auto alpha = _mm256_load_ps(a + i);
+        _mm256_store_ps(r + i, _mm256_mul_ps(_mm256_load_ps(r + i), alpha));
+        _mm256_store_ps(g + i, _mm256_mul_ps(_mm256_load_ps(g + i), alpha));
+        _mm256_store_ps(b + i, _mm256_mul_ps(_mm256_load_ps(b + i), alpha));
+    }
+}
+
+DWRITE_TARGET_AVX2 void DWrite_UnpremultiplyBatch_AVX2(DWrite_ColorBatch& colors) noexcept
+{
+    const auto r = colors.R();
+    const auto g = colors.G();
+    const auto b = colors.B();
+    const auto a = colors.A();
+
+    for (size_t i = 0; i < colors.PaddedSize(); i += 8)
+    {
+        // Same as unpremultiply8(), but with 8 alphas at once.
+        const auto alpha = _mm256_load_ps(a + i);
+        const auto r0 = _mm256_rcp_ps(alpha);
+        const auto r1 = _mm256_mul_ps(r0, _mm256_fnmadd_ps(alpha, r0, _mm256_set1_ps(2.0f)));
+        const auto inv = _mm256_blendv_ps(r1, _mm256_set1_ps(1.0f), _mm256_cmp_ps(alpha, _mm256_setzero_ps(), _CMP_EQ_OQ));
+        _mm256_store_ps(r + i, _mm256_mul_ps(_mm256_load_ps(r + i), inv));
+        _mm256_store_ps(g + i, _mm256_mul_ps(_mm256_load_ps(g + i), inv));
+        _mm256_store_ps(b + i, _mm256_mul_ps(_mm256_load_ps(b + i), inv));
+    }
+}
+
+// DWrite_UnpremultiplyColor() for one plane.
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 unpremultiplyPlane(__m256 c, __m256 a, __m256 zero) noexcept
+{
+    return _mm256_blendv_ps(_mm256_div_ps(c, a), c, zero);
+}
+
+// The per-foreground part of DWrite_GrayscaleBlend()/DWrite_CleartypeBlend(): contrastBoost + DWrite_ApplyLightOnDarkContrastAdjustment().
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 blendEnhancedContrast(__m256 sr, __m256 sg, __m256 sb, f32 enhancedContrast, bool isThinFont) noexcept
+{
+    auto x = _mm256_fmadd_ps(sr, _mm256_set1_ps(0.30f * -4.0f), _mm256_set1_ps(3.0f));
+    x = _mm256_fmadd_ps(sg, _mm256_set1_ps(0.59f * -4.0f), x);
+    x = _mm256_fmadd_ps(sb, _mm256_set1_ps(0.11f * -4.0f), x);
+    return _mm256_fmadd_ps(saturate(x), _mm256_set1_ps(enhancedContrast), _mm256_set1_ps(isThinFont ? 0.5f : 0.0f));
+}
+
+// DWrite_ApplyAlphaCorrection(DWrite_EnhanceContrast(alpha, k), f, g)
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static __m256 correctAlpha(__m256 alpha, __m256 k, __m256 f, const f32* g) noexcept
+{
+    const auto one = _mm256_set1_ps(1.0f);
+    const auto c = _mm256_div_ps(_mm256_mul_ps(alpha, _mm256_add_ps(k, one)), _mm256_fmadd_ps(alpha, k, one));
+    const auto g0 = _mm256_fmadd_ps(_mm256_set1_ps(g[0]), f, _mm256_set1_ps(g[1]));
+    const auto g1 = _mm256_fmadd_ps(_mm256_set1_ps(g[2]), f, _mm256_set1_ps(g[3]));
+    return _mm256_fmadd_ps(_mm256_mul_ps(c, _mm256_sub_ps(one, c)), _mm256_fmadd_ps(g0, c, g1), c);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_GrayscaleBlendBatch_AVX2(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const f32* glyphAlpha, DWrite_ColorBatch& dst) noexcept
+{
+    const auto fr = foreground.R();
+    const auto fg = foreground.G();
+    const auto fb = foreground.B();
+    const auto fa = foreground.A();
+    const auto r = dst.R();
+    const auto g = dst.G();
+    const auto b = dst.B();
+    const auto a = dst.A();
+    const auto count = dst.Size();
+
+    for (size_t i = 0; i < count; i += 8)
+    {
+        // Unlike the planes, glyphAlpha isn't padded.
+        const auto tail = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count - i < 8 ? count - i : 8)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        const auto alpha = _mm256_maskload_ps(glyphAlpha + i, tail);
+
+        const auto cr = _mm256_load_ps(fr + i);
+        const auto cg = _mm256_load_ps(fg + i);
+        const auto cb = _mm256_load_ps(fb + i);
+        const auto ca = _mm256_load_ps(fa + i);
+        const auto zero = _mm256_cmp_ps(ca, _mm256_setzero_ps(), _CMP_EQ_OQ);
+        const auto k = blendEnhancedContrast(unpremultiplyPlane(cr, ca, zero), unpremultiplyPlane(cg, ca, zero), unpremultiplyPlane(cb, ca, zero), params.grayscaleEnhancedContrast, params.isThinFont);
+        const auto intensity = _mm256_fmadd_ps(cr, _mm256_set1_ps(0.25f), _mm256_fmadd_ps(cg, _mm256_set1_ps(0.5f), _mm256_mul_ps(cb, _mm256_set1_ps(0.25f))));
+        const auto corrected = correctAlpha(alpha, k, intensity, &params.gammaRatios[0]);
+
+        // DWrite_AlphaBlendPremultiplied() with top = foreground * corrected.
+        const auto ia = _mm256_fnmadd_ps(ca, corrected, _mm256_set1_ps(1.0f));
+        _mm256_store_ps(r + i, _mm256_fmadd_ps(_mm256_load_ps(r + i), ia, _mm256_mul_ps(cr, corrected)));
+        _mm256_store_ps(g + i, _mm256_fmadd_ps(_mm256_load_ps(g + i), ia, _mm256_mul_ps(cg, corrected)));
+        _mm256_store_ps(b + i, _mm256_fmadd_ps(_mm256_load_ps(b + i), ia, _mm256_mul_ps(cb, corrected)));
+        _mm256_store_ps(a + i, _mm256_fmadd_ps(_mm256_load_ps(a + i), ia, _mm256_mul_ps(ca, corrected)));
+    }
+}
+
+DWRITE_TARGET_AVX2 void DWrite_CleartypeBlendBatch_AVX2(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const DWrite_ColorBatch& glyph, DWrite_ColorBatch& dst) noexcept
+{
+    const auto fa = foreground.A();
+    const auto a = dst.A();
+    const auto count = dst.Size();
+
+    for (size_t i = 0; i < count; i += 8)
+    {
+        // The padding has to stay 0, so only the alpha of the actual colors is set to 1.
+        const auto tail = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count - i < 8 ? count - i : 8)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        const auto ca = _mm256_load_ps(fa + i);
+        const auto zero = _mm256_cmp_ps(ca, _mm256_setzero_ps(), _CMP_EQ_OQ);
+        __m256 straight[3];
+        for (u32 p = 0; p < 3; ++p)
+        {
+            straight[p] = unpremultiplyPlane(_mm256_load_ps(foreground.Plane(p) + i), ca, zero);
+        }
+        const auto k = blendEnhancedContrast(straight[0], straight[1], straight[2], params.cleartypeEnhancedContrast, params.isThinFont);
+
+        for (u32 p = 0; p < 3; ++p)
+        {
+            const auto corrected = correctAlpha(_mm256_load_ps(glyph.Plane(p) + i), k, straight[p], &params.gammaRatios[0]);
+            // lerp(background, straight, corrected * foreground.a)
+            const auto bg = _mm256_load_ps(dst.Plane(p) + i);
+            _mm256_store_ps(dst.Plane(p) + i, _mm256_fmadd_ps(_mm256_mul_ps(corrected, ca), _mm256_sub_ps(straight[p], bg), bg));
+        }
+        _mm256_store_ps(a + i, _mm256_and_ps(_mm256_set1_ps(1.0f), _mm256_castsi256_ps(tail)));
+    }
+}
+
+#endif
+
+// Indexed by DWrite_BlendIsa.
+static constexpr DWrite_ColorKernels s_kernels[]{
+    {
+        .srgbToLinearSpan = DWrite_SrgbToLinearSpan_Scalar,
+        .linearToSrgbSpan = DWrite_LinearToSrgbSpan_Scalar,
+        .decodeSrgbSpan = DWrite_DecodeSrgbSpan_Scalar,
+        .encodeSrgbSpan = DWrite_EncodeSrgbSpan_Scalar,
+        .premultiplySpan = DWrite_PremultiplySpan_Scalar,
+        .unpremultiplySpan = DWrite_UnpremultiplySpan_Scalar,
+        .premultiplyPixelSpan = DWrite_PremultiplyPixelSpan_Scalar,
+        .unpremultiplyPixelSpan = DWrite_UnpremultiplyPixelSpan_Scalar,
+        .f32ToF16Span = DWrite_F32ToF16Span_Scalar,
+        .f16ToF32Span = DWrite_F16ToF32Span_Scalar,
+        .f32ToUnorm8Span = DWrite_F32ToUnorm8Span_Scalar,
+        .unorm8ToF32Span = DWrite_Unorm8ToF32Span_Scalar,
+        .loadColorBatch = DWrite_LoadColorBatch_Scalar,
+        .storeColorBatch = DWrite_StoreColorBatch_Scalar,
+        .loadColorBatchPixels = DWrite_LoadColorBatchPixels_Scalar,
+        .storeColorBatchPixels = DWrite_StoreColorBatchPixels_Scalar,
+        .srgbToLinearBatch = DWrite_SrgbToLinearBatch_Scalar,
+        .linearToSrgbBatch = DWrite_LinearToSrgbBatch_Scalar,
+        .premultiplyBatch = DWrite_PremultiplyBatch_Scalar,
+        .unpremultiplyBatch = DWrite_UnpremultiplyBatch_Scalar,
+        .grayscaleBlendBatch = DWrite_GrayscaleBlendBatch_Scalar,
+        .cleartypeBlendBatch = DWrite_CleartypeBlendBatch_Scalar,
+    },
+#if DWRITE_BLEND_X86
+    {
+        .srgbToLinearSpan = DWrite_SrgbToLinearSpan_Scalar,
+        .linearToSrgbSpan = DWrite_LinearToSrgbSpan_Scalar,
+        .decodeSrgbSpan = DWrite_DecodeSrgbSpan_Scalar,
+        .encodeSrgbSpan = DWrite_EncodeSrgbSpan_Scalar,
+        .premultiplySpan = DWrite_PremultiplySpan_Scalar,
+        .unpremultiplySpan = DWrite_UnpremultiplySpan_Scalar,
+        .premultiplyPixelSpan = DWrite_PremultiplyPixelSpan_Scalar,
+        .unpremultiplyPixelSpan = DWrite_UnpremultiplyPixelSpan_Scalar,
+        .f32ToF16Span = DWrite_F32ToF16Span_Scalar,
+        .f16ToF32Span = DWrite_F16ToF32Span_Scalar,
+        .f32ToUnorm8Span = DWrite_F32ToUnorm8Span_Scalar,
+        .unorm8ToF32Span = DWrite_Unorm8ToF32Span_Scalar,
+        .loadColorBatch = DWrite_LoadColorBatch_Scalar,
+        .storeColorBatch = DWrite_StoreColorBatch_Scalar,
+        .loadColorBatchPixels = DWrite_LoadColorBatchPixels_Scalar,
+        .storeColorBatchPixels = DWrite_StoreColorBatchPixels_Scalar,
+        .srgbToLinearBatch = DWrite_SrgbToLinearBatch_Scalar,
+        .linearToSrgbBatch = DWrite_LinearToSrgbBatch_Scalar,
+        .premultiplyBatch = DWrite_PremultiplyBatch_Scalar,
+        .unpremultiplyBatch = DWrite_UnpremultiplyBatch_Scalar,
+        .grayscaleBlendBatch = DWrite_GrayscaleBlendBatch_Scalar,
+        .cleartypeBlendBatch = DWrite_CleartypeBlendBatch_Scalar,
+    },
+    {
+        .srgbToLinearSpan = DWrite_SrgbToLinearSpan_AVX2,
+        .linearToSrgbSpan = DWrite_LinearToSrgbSpan_AVX2,
+        .decodeSrgbSpan = DWrite_DecodeSrgbSpan_AVX2,
+        .encodeSrgbSpan = DWrite_EncodeSrgbSpan_AVX2,
+        .premultiplySpan = DWrite_PremultiplySpan_AVX2,
+        .unpremultiplySpan = DWrite_UnpremultiplySpan_AVX2,
+        .premultiplyPixelSpan = DWrite_PremultiplyPixelSpan_AVX2,
+        .unpremultiplyPixelSpan = DWrite_UnpremultiplyPixelSpan_AVX2,
+        .f32ToF16Span = DWrite_F32ToF16Span_AVX2,
+        .f16ToF32Span = DWrite_F16ToF32Span_AVX2,
+        .f32ToUnorm8Span = DWrite_F32ToUnorm8Span_AVX2,
+        .unorm8ToF32Span = DWrite_Unorm8ToF32Span_AVX2,
+        .loadColorBatch = DWrite_LoadColorBatch_AVX2,
+        .storeColorBatch = DWrite_StoreColorBatch_AVX2,
+        .loadColorBatchPixels = DWrite_LoadColorBatchPixels_AVX2,
+        .storeColorBatchPixels = DWrite_StoreColorBatchPixels_AVX2,
+        .srgbToLinearBatch = DWrite_SrgbToLinearBatch_AVX2,
+        .linearToSrgbBatch = DWrite_LinearToSrgbBatch_AVX2,
+        .premultiplyBatch = DWrite_PremultiplyBatch_AVX2,
+        .unpremultiplyBatch = DWrite_UnpremultiplyBatch_AVX2,
+        .grayscaleBlendBatch = DWrite_GrayscaleBlendBatch_AVX2,
+        .cleartypeBlendBatch = DWrite_CleartypeBlendBatch_AVX2,
+    },
+    {
+        .srgbToLinearSpan = DWrite_SrgbToLinearSpan_AVX2,
+        .linearToSrgbSpan = DWrite_LinearToSrgbSpan_AVX2,
+        .decodeSrgbSpan = DWrite_DecodeSrgbSpan_AVX2,
+        .encodeSrgbSpan = DWrite_EncodeSrgbSpan_AVX2,
+        .premultiplySpan = DWrite_PremultiplySpan_AVX2,
+        .unpremultiplySpan = DWrite_UnpremultiplySpan_AVX2,
+        .premultiplyPixelSpan = DWrite_PremultiplyPixelSpan_AVX2,
+        .unpremultiplyPixelSpan = DWrite_UnpremultiplyPixelSpan_AVX2,
+        .f32ToF16Span = DWrite_F32ToF16Span_AVX2,
+        .f16ToF32Span = DWrite_F16ToF32Span_AVX2,
+        .f32ToUnorm8Span = DWrite_F32ToUnorm8Span_AVX2,
+        .unorm8ToF32Span = DWrite_Unorm8ToF32Span_AVX2,
+        .loadColorBatch = DWrite_LoadColorBatch_AVX2,
+        .storeColorBatch = DWrite_StoreColorBatch_AVX2,
+        .loadColorBatchPixels = DWrite_LoadColorBatchPixels_AVX2,
+        .storeColorBatchPixels = DWrite_StoreColorBatchPixels_AVX2,
+        .srgbToLinearBatch = DWrite_SrgbToLinearBatch_AVX2,
+        .linearToSrgbBatch = DWrite_LinearToSrgbBatch_AVX2,
+        .premultiplyBatch = DWrite_PremultiplyBatch_AVX2,
+        .unpremultiplyBatch = DWrite_UnpremultiplyBatch_AVX2,
+        .grayscaleBlendBatch = DWrite_GrayscaleBlendBatch_AVX2,
+        .cleartypeBlendBatch = DWrite_CleartypeBlendBatch_AVX2,
+    },
+#endif
+};
+
+// The tier is the one picked for the span functions in blend.h, which is always supported.
+static const DWrite_ColorKernels& activeKernels() noexcept
+{
+    return s_kernels[static_cast<u32>(DWrite_GetBlendIsa())];
+}
+
+const DWrite_ColorKernels& DWrite_GetColorKernels(DWrite_BlendIsa isa) noexcept
+{
+    const auto supported = DWrite_GetSupportedBlendIsa();
+    return s_kernels[static_cast<u32>(isa < supported ? isa : supported)];
+}
+
+void DWrite_SrgbToLinearSpan(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    activeKernels().srgbToLinearSpan(src, dst, count);
+}
+
+void DWrite_LinearToSrgbSpan(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    activeKernels().linearToSrgbSpan(src, dst, count);
+}
+
+void DWrite_DecodeSrgbSpan(const u32* src, f32x4* dst, size_t count) noexcept
+{
+    activeKernels().decodeSrgbSpan(src, dst, count);
+}
+
+void DWrite_EncodeSrgbSpan(const f32x4* src, u32* dst, size_t count) noexcept
+{
+    activeKernels().encodeSrgbSpan(src, dst, count);
+}
+
+void DWrite_PremultiplySpan(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    activeKernels().premultiplySpan(src, dst, count);
+}
+
+void DWrite_UnpremultiplySpan(const f32x4* src, f32x4* dst, size_t count) noexcept
+{
+    activeKernels().unpremultiplySpan(src, dst, count);
+}
+
+void DWrite_PremultiplyPixelSpan(const u32* src, u32* dst, size_t count) noexcept
+{
+    activeKernels().premultiplyPixelSpan(src, dst, count);
+}
+
+void DWrite_UnpremultiplyPixelSpan(const u32* src, u32* dst, size_t count) noexcept
+{
+    activeKernels().unpremultiplyPixelSpan(src, dst, count);
+}
+
+void DWrite_F32ToF16Span(const f32x4* src, f16x4* dst, size_t count) noexcept
+{
+    activeKernels().f32ToF16Span(src, dst, count);
+}
+
+void DWrite_F16ToF32Span(const f16x4* src, f32x4* dst, size_t count) noexcept
+{
+    activeKernels().f16ToF32Span(src, dst, count);
+}
+
+void DWrite_F32ToUnorm8Span(const f32x4* src, u8x4* dst, size_t count) noexcept
+{
+    activeKernels().f32ToUnorm8Span(src, dst, count);
+}
+
+void DWrite_Unorm8ToF32Span(const u8x4* src, f32x4* dst, size_t count) noexcept
+{
+    activeKernels().unorm8ToF32Span(src, dst, count);
+}
+
+void DWrite_LoadColorBatch(const f32x4* src, DWrite_ColorBatch& dst, size_t count) noexcept
+{
+    activeKernels().loadColorBatch(src, dst, count);
+}
+
+void DWrite_StoreColorBatch(const DWrite_ColorBatch& src, f32x4* dst, size_t count) noexcept
+{
+    activeKernels().storeColorBatch(src, dst, count);
+}
+
+void DWrite_LoadColorBatchPixels(const u32* src, DWrite_ColorBatch& dst, size_t count) noexcept
+{
+    activeKernels().loadColorBatchPixels(src, dst, count);
+}
+
+void DWrite_StoreColorBatchPixels(const DWrite_ColorBatch& src, u32* dst, size_t count) noexcept
+{
+    activeKernels().storeColorBatchPixels(src, dst, count);
+}
+
+void DWrite_SrgbToLinearBatch(DWrite_ColorBatch& colors) noexcept
+{
+    activeKernels().srgbToLinearBatch(colors);
+}
+
+void DWrite_LinearToSrgbBatch(DWrite_ColorBatch& colors) noexcept
+{
+    activeKernels().linearToSrgbBatch(colors);
+}
+
+void DWrite_PremultiplyBatch(DWrite_ColorBatch& colors) noexcept
+{
+    activeKernels().premultiplyBatch(colors);
+}
+
+void DWrite_UnpremultiplyBatch(DWrite_ColorBatch& colors) noexcept
+{
+    activeKernels().unpremultiplyBatch(colors);
+}
+
+void DWrite_GrayscaleBlendBatch(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const f32* glyphAlpha, DWrite_ColorBatch& dst) noexcept
+{
+    activeKernels().grayscaleBlendBatch(params, foreground, glyphAlpha, dst);
+}
+
+void DWrite_CleartypeBlendBatch(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const DWrite_ColorBatch& glyph, DWrite_ColorBatch& dst) noexcept
+{
+    activeKernels().cleartypeBlendBatch(params, foreground, glyph, dst);
+}
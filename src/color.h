@@ -0,0 +1,279 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <bit>
+#include <memory>
+
+#include "blend.h"
+
+// Batch color conversions for the software rendering path, for instance to decode an entire
+// DXGI_FORMAT_B8G8R8A8_UNORM_SRGB framebuffer or a 256-color palette before blending with the gamma
+// ratios from DWrite_GetGammaRatiosForLinearTarget(), and to encode the result again afterwards.
+//
+// Like DXGI's *_SRGB formats, only the color channels are converted. Alpha is always linear.
+// All of these functions forward to the fastest implementation the CPU supports, just like the span
+// functions in blend.h. The table-based ones produce identical results on all tiers, while the polynomial
+// ones may differ in the last few bits of the float, because the SIMD tiers use FMAs.
+
+// sRGB <-> linear for f32x4 colors. The color channels are saturated to [0, 1] first (NaN turns into 0),
+// while alpha is copied as is. src and dst may be the same array.
+//
+// Instead of std::pow() these use a polynomial approximation, which costs 1-2 square roots per channel:
+// * DWrite_SrgbToLinearSpan computes x^2 * p(sqrt(x)) with x = (c + 0.055) / 1.055.
+//   The max. relative error compared to DWrite_SrgbToLinear() is 2.6e-5 (max. absolute error 4.2e-6).
+// * DWrite_LinearToSrgbSpan computes p(sqrt(sqrt(c))).
+//   The max. absolute error compared to DWrite_LinearToSrgb() is 2.2e-6.
+// Both are well below the 1/65535 resolution of 16-bit UNORM targets, let alone 8-bit ones.
+void DWrite_SrgbToLinearSpan(const f32x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_LinearToSrgbSpan(const f32x4* src, f32x4* dst, size_t count) noexcept;
+
+// Decodes B8G8R8A8_UNORM_SRGB pixels into linear (r, g, b, a) colors, exactly like
+// sampling a DXGI_FORMAT_B8G8R8A8_UNORM_SRGB texture would. This uses a 256-entry table and is exact.
+void DWrite_DecodeSrgbSpan(const u32* src, f32x4* dst, size_t count) noexcept;
+
+// The inverse of DWrite_DecodeSrgbSpan. The input is saturated to [0, 1] first.
+// The color channels go through a 4096-entry table indexed by the linear value, which is at most 1 off from
+// the correctly rounded DWrite_LinearToSrgb() result (for about 1.3% of all floats in [0, 1]). It's exact for
+// the 256 decoded sRGB values though, so a DWrite_DecodeSrgbSpan + DWrite_EncodeSrgbSpan roundtrip is lossless.
+void DWrite_EncodeSrgbSpan(const f32x4* src, u32* dst, size_t count) noexcept;
+
+// Premultiplies f32x4 colors with their alpha. src and dst may be the same array.
+void DWrite_PremultiplySpan(const f32x4* src, f32x4* dst, size_t count) noexcept;
+
+// DWrite_UnpremultiplyColor() for f32x4 colors: Divides the color channels by alpha, unless alpha is 0.
+// The SIMD tiers use an approximate reciprocal refined with one Newton-Raphson step instead of a division,
+// which is within 3 ulp of the exact result. src and dst may be the same array.
+void DWrite_UnpremultiplySpan(const f32x4* src, f32x4* dst, size_t count) noexcept;
+
+// The same for B8G8R8A8 pixels. Both round to nearest (ties away from zero) like the exact integer math would:
+// * DWrite_PremultiplyPixelSpan computes c * a / 255.
+// * DWrite_UnpremultiplyPixelSpan computes min(255, c * 255 / a). Pixels with a = 0 are copied as is.
+// Both are exact and produce identical results on all tiers. src and dst may be the same array.
+void DWrite_PremultiplyPixelSpan(const u32* src, u32* dst, size_t count) noexcept;
+void DWrite_UnpremultiplyPixelSpan(const u32* src, u32* dst, size_t count) noexcept;
+
+// f32 -> f16 with round-to-nearest-even, exactly like F16C (_mm_cvtps_ph) and the GPU do it.
+// Values too large for f16 turn into infinity, tiny ones into f16 denormals and NaNs stay NaN.
+inline f16 DWrite_F32ToF16(f32 v) noexcept
+{
+    auto u = std::bit_cast<u32>(v);
+    const auto sign = (u >> 16) & 0x8000;
+    u &= 0x7fffffff;
+
+    u32 h;
+    if (u >= 0x47800000) // >= 65536: Infinity or NaN
+    {
+        // NaNs are quieted but keep the upper bits of their payload, like F16C.
+        h = u > 0x7f800000 ? 0x7e00 | ((u >> 13) & 0x3ff) : 0x7c00;
+    }
+    else if (u < 0x38800000) // < 2^-14: Denormal or zero
+    {
+        // Adding 0.5 shifts the value to the bottom of the mantissa, where the FPU rounds it for us.
+        h = std::bit_cast<u32>(std::bit_cast<f32>(u) + 0.5f) - 0x3f000000;
+    }
+    else
+    {
+        // Rebias the exponent and round to nearest even. A carry out of the mantissa correctly bumps the exponent.
+        h = (u + 0xc8000fff + ((u >> 13) & 1)) >> 13;
+    }
+
+    return { static_cast<u16>(h | sign) };
+}
+
+// f16 -> f32. This is exact and matches F16C (_mm_cvtph_ps) bit for bit.
+inline f32 DWrite_F16ToF32(f16 v) noexcept
+{
+    const u32 h = v.bits;
+    auto u = (h & 0x7fff) << 13;
+    const auto exp = u & 0x0f800000;
+
+    if (exp == 0x0f800000) // Infinity or NaN
+    {
+        u += 0x70000000;
+        // Signaling NaNs are quieted, like F16C.
+        u |= (u & 0x007fffff) ? 0x00400000 : 0;
+    }
+    else if (exp == 0) // Denormal or zero: Let the FPU normalize it.
+    {
+        u = std::bit_cast<u32>(std::bit_cast<f32>(u + 0x38800000) - 6.103515625e-05f);
+    }
+    else
+    {
+        u += 0x38000000;
+    }
+
+    return std::bit_cast<f32>(u | (h & 0x8000) << 16);
+}
+
+// f32x4 <-> f16x4 (DXGI_FORMAT_R16G16B16A16_FLOAT), using DWrite_F32ToF16() and DWrite_F16ToF32().
+// f16x4 halves the size of color arrays and per-instance data, without losing anything visible:
+// f16 has 11 bits of precision, which is enough for 8-bit sRGB colors even in linear space.
+void DWrite_F32ToF16Span(const f32x4* src, f16x4* dst, size_t count) noexcept;
+void DWrite_F16ToF32Span(const f16x4* src, f32x4* dst, size_t count) noexcept;
+
+// f32x4 <-> u8x4 (DXGI_FORMAT_R8G8B8A8_UNORM, quartering the size), like DWrite_PackColor()/DWrite_UnpackColor()
+// but in RGBA order. The input is saturated to [0, 1] and rounded to nearest.
+void DWrite_F32ToUnorm8Span(const f32x4* src, u8x4* dst, size_t count) noexcept;
+void DWrite_Unorm8ToF32Span(const u8x4* src, f32x4* dst, size_t count) noexcept;
+
+// A batch of colors in structure-of-arrays layout: Color i is (R()[i], G()[i], B()[i], A()[i]).
+// f32x4 arrays interleave the channels, so SIMD code needs shuffles to get at them, while here each
+// plane can be loaded straight into a register. This is the layout the *Batch functions below work on.
+//
+// Each plane is aligned to 64 bytes and padded with zeros to a multiple of 16 floats (one AVX-512 register),
+// so that kernels can process entire vectors without special-casing the end.
+class DWrite_ColorBatch
+{
+public:
+    DWrite_ColorBatch() = default;
+    explicit DWrite_ColorBatch(size_t size);
+
+    // Resizes the batch and sets all colors (and the padding) to 0.
+    void Resize(size_t size);
+
+    // The number of colors.
+    size_t Size() const noexcept;
+    // The number of floats per plane: Size() rounded up to a multiple of 16.
+    size_t PaddedSize() const noexcept;
+
+    // Plane 0-3 is R, G, B and A respectively.
+    f32* Plane(u32 index) noexcept;
+    const f32* Plane(u32 index) const noexcept;
+
+    f32* R() noexcept { return Plane(0); }
+    f32* G() noexcept { return Plane(1); }
+    f32* B() noexcept { return Plane(2); }
+    f32* A() noexcept { return Plane(3); }
+    const f32* R() const noexcept { return Plane(0); }
+    const f32* G() const noexcept { return Plane(1); }
+    const f32* B() const noexcept { return Plane(2); }
+    const f32* A() const noexcept { return Plane(3); }
+
+private:
+    struct alignas(64) Block
+    {
+        f32 values[16];
+    };
+
+    std::unique_ptr<Block[]> _blocks;
+    size_t _size = 0;
+    size_t _blocksPerPlane = 0;
+};
+
+// AoS <-> SoA transposes. These read or write the first count colors of the batch. count must not exceed Size().
+void DWrite_LoadColorBatch(const f32x4* src, DWrite_ColorBatch& dst, size_t count) noexcept;
+void DWrite_StoreColorBatch(const DWrite_ColorBatch& src, f32x4* dst, size_t count) noexcept;
+// The same for B8G8R8A8 pixels, like DWrite_UnpackColor() and DWrite_PackColor().
+void DWrite_LoadColorBatchPixels(const u32* src, DWrite_ColorBatch& dst, size_t count) noexcept;
+void DWrite_StoreColorBatchPixels(const DWrite_ColorBatch& src, u32* dst, size_t count) noexcept;
+
+// DWrite_SrgbToLinearSpan, DWrite_LinearToSrgbSpan, DWrite_PremultiplySpan and DWrite_UnpremultiplySpan
+// for an entire batch, in place. The results are the same as for the f32x4 versions.
+void DWrite_SrgbToLinearBatch(DWrite_ColorBatch& colors) noexcept;
+void DWrite_LinearToSrgbBatch(DWrite_ColorBatch& colors) noexcept;
+void DWrite_PremultiplyBatch(DWrite_ColorBatch& colors) noexcept;
+void DWrite_UnpremultiplyBatch(DWrite_ColorBatch& colors) noexcept;
+
+// The blend functions from blend.h with a different foreground color per element, for instance to process
+// all cells of a terminal row at once. params.foregroundColor is ignored in favor of foreground.
+// foreground (and glyph) must have at least as many colors as dst.
+//
+// Grayscale: dst[i] = DWrite_AlphaBlendPremultiplied(dst[i], DWrite_GrayscaleBlend(..., foreground[i], glyphAlpha[i]))
+// ClearType: dst[i] = DWrite_CleartypeBlend(..., dst[i], foreground[i], glyph[i]), where dst holds opaque backgrounds.
+void DWrite_GrayscaleBlendBatch(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const f32* glyphAlpha, DWrite_ColorBatch& dst) noexcept;
+void DWrite_CleartypeBlendBatch(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const DWrite_ColorBatch& glyph, DWrite_ColorBatch& dst) noexcept;
+
+// DWrite_SrgbToLinear() for each 8-bit value (the table used by DWrite_DecodeSrgbSpan).
+const f32* DWrite_GetSrgbDecodeTable() noexcept;
+// DWrite_LinearToSrgb() as 8-bit values for each multiple of 1/4095 (the table used by DWrite_EncodeSrgbSpan).
+// It's padded with 3 extra bytes, so that SIMD implementations can gather 32 bits at a time.
+const u8* DWrite_GetSrgbEncodeTable() noexcept;
+
+// Encodes a single color channel with the DWrite_GetSrgbEncodeTable() table, like DWrite_EncodeSrgbSpan does.
+inline u32 DWrite_EncodeSrgbChannel(const u8* table, f32 c) noexcept
+{
+    return table[static_cast<u32>(DWrite_Saturate(c) * 4095.0f + 0.5f)];
+}
+
+// The individual implementations. Unless you want to compare them,
+// you should use the dispatching functions above instead.
+void DWrite_SrgbToLinearSpan_Scalar(const f32x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_LinearToSrgbSpan_Scalar(const f32x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_DecodeSrgbSpan_Scalar(const u32* src, f32x4* dst, size_t count) noexcept;
+void DWrite_EncodeSrgbSpan_Scalar(const f32x4* src, u32* dst, size_t count) noexcept;
+void DWrite_PremultiplySpan_Scalar(const f32x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_UnpremultiplySpan_Scalar(const f32x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_PremultiplyPixelSpan_Scalar(const u32* src, u32* dst, size_t count) noexcept;
+void DWrite_UnpremultiplyPixelSpan_Scalar(const u32* src, u32* dst, size_t count) noexcept;
+void DWrite_F32ToF16Span_Scalar(const f32x4* src, f16x4* dst, size_t count) noexcept;
+void DWrite_F16ToF32Span_Scalar(const f16x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_F32ToUnorm8Span_Scalar(const f32x4* src, u8x4* dst, size_t count) noexcept;
+void DWrite_Unorm8ToF32Span_Scalar(const u8x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_LoadColorBatch_Scalar(const f32x4* src, DWrite_ColorBatch& dst, size_t count) noexcept;
+void DWrite_StoreColorBatch_Scalar(const DWrite_ColorBatch& src, f32x4* dst, size_t count) noexcept;
+void DWrite_LoadColorBatchPixels_Scalar(const u32* src, DWrite_ColorBatch& dst, size_t count) noexcept;
+void DWrite_StoreColorBatchPixels_Scalar(const DWrite_ColorBatch& src, u32* dst, size_t count) noexcept;
+void DWrite_SrgbToLinearBatch_Scalar(DWrite_ColorBatch& colors) noexcept;
+void DWrite_LinearToSrgbBatch_Scalar(DWrite_ColorBatch& colors) noexcept;
+void DWrite_PremultiplyBatch_Scalar(DWrite_ColorBatch& colors) noexcept;
+void DWrite_UnpremultiplyBatch_Scalar(DWrite_ColorBatch& colors) noexcept;
+void DWrite_GrayscaleBlendBatch_Scalar(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const f32* glyphAlpha, DWrite_ColorBatch& dst) noexcept;
+void DWrite_CleartypeBlendBatch_Scalar(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const DWrite_ColorBatch& glyph, DWrite_ColorBatch& dst) noexcept;
+#if DWRITE_BLEND_X86
+void DWrite_SrgbToLinearSpan_AVX2(const f32x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_LinearToSrgbSpan_AVX2(const f32x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_DecodeSrgbSpan_AVX2(const u32* src, f32x4* dst, size_t count) noexcept;
+void DWrite_EncodeSrgbSpan_AVX2(const f32x4* src, u32* dst, size_t count) noexcept;
+void DWrite_PremultiplySpan_AVX2(const f32x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_UnpremultiplySpan_AVX2(const f32x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_PremultiplyPixelSpan_AVX2(const u32* src, u32* dst, size_t count) noexcept;
+void DWrite_UnpremultiplyPixelSpan_AVX2(const u32* src, u32* dst, size_t count) noexcept;
+void DWrite_F32ToF16Span_AVX2(const f32x4* src, f16x4* dst, size_t count) noexcept;
+void DWrite_F16ToF32Span_AVX2(const f16x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_F32ToUnorm8Span_AVX2(const f32x4* src, u8x4* dst, size_t count) noexcept;
+void DWrite_Unorm8ToF32Span_AVX2(const u8x4* src, f32x4* dst, size_t count) noexcept;
+void DWrite_LoadColorBatch_AVX2(const f32x4* src, DWrite_ColorBatch& dst, size_t count) noexcept;
+void DWrite_StoreColorBatch_AVX2(const DWrite_ColorBatch& src, f32x4* dst, size_t count) noexcept;
+void DWrite_LoadColorBatchPixels_AVX2(const u32* src, DWrite_ColorBatch& dst, size_t count) noexcept;
+void DWrite_StoreColorBatchPixels_AVX2(const DWrite_ColorBatch& src, u32* dst, size_t count) noexcept;
+void DWrite_SrgbToLinearBatch_AVX2(DWrite_ColorBatch& colors) noexcept;
+void DWrite_LinearToSrgbBatch_AVX2(DWrite_ColorBatch& colors) noexcept;
+void DWrite_PremultiplyBatch_AVX2(DWrite_ColorBatch& colors) noexcept;
+void DWrite_UnpremultiplyBatch_AVX2(DWrite_ColorBatch& colors) noexcept;
+void DWrite_GrayscaleBlendBatch_AVX2(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const f32* glyphAlpha, DWrite_ColorBatch& dst) noexcept;
+void DWrite_CleartypeBlendBatch_AVX2(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const DWrite_ColorBatch& glyph, DWrite_ColorBatch& dst) noexcept;
+#endif
+
+// The function-pointer table used by the dispatching functions above. It follows the tier picked with
+// DWrite_SetBlendIsa(). There are only Scalar and AVX2 implementations, which the other tiers reuse.
+struct DWrite_ColorKernels
+{
+    void (*srgbToLinearSpan)(const f32x4* src, f32x4* dst, size_t count) noexcept;
+    void (*linearToSrgbSpan)(const f32x4* src, f32x4* dst, size_t count) noexcept;
+    void (*decodeSrgbSpan)(const u32* src, f32x4* dst, size_t count) noexcept;
+    void (*encodeSrgbSpan)(const f32x4* src, u32* dst, size_t count) noexcept;
+    void (*premultiplySpan)(const f32x4* src, f32x4* dst, size_t count) noexcept;
+    void (*unpremultiplySpan)(const f32x4* src, f32x4* dst, size_t count) noexcept;
+    void (*premultiplyPixelSpan)(const u32* src, u32* dst, size_t count) noexcept;
+    void (*unpremultiplyPixelSpan)(const u32* src, u32* dst, size_t count) noexcept;
+    // The AVX2 versions use F16C.
+    void (*f32ToF16Span)(const f32x4* src, f16x4* dst, size_t count) noexcept;
+    void (*f16ToF32Span)(const f16x4* src, f32x4* dst, size_t count) noexcept;
+    void (*f32ToUnorm8Span)(const f32x4* src, u8x4* dst, size_t count) noexcept;
+    void (*unorm8ToF32Span)(const u8x4* src, f32x4* dst, size_t count) noexcept;
+    void (*loadColorBatch)(const f32x4* src, DWrite_ColorBatch& dst, size_t count) noexcept;
+    void (*storeColorBatch)(const DWrite_ColorBatch& src, f32x4* dst, size_t count) noexcept;
+    void (*loadColorBatchPixels)(const u32* src, DWrite_ColorBatch& dst, size_t count) noexcept;
+    void (*storeColorBatchPixels)(const DWrite_ColorBatch& src, u32* dst, size_t count) noexcept;
+    void (*srgbToLinearBatch)(DWrite_ColorBatch& colors) noexcept;
+    void (*linearToSrgbBatch)(DWrite_ColorBatch& colors) noexcept;
+    void (*premultiplyBatch)(DWrite_ColorBatch& colors) noexcept;
+    void (*unpremultiplyBatch)(DWrite_ColorBatch& colors) noexcept;
+    void (*grayscaleBlendBatch)(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const f32* glyphAlpha, DWrite_ColorBatch& dst) noexcept;
+    void (*cleartypeBlendBatch)(const DWrite_BlendParams& params, const DWrite_ColorBatch& foreground, const DWrite_ColorBatch& glyph, DWrite_ColorBatch& dst) noexcept;
+};
+
+// Returns the kernels for the given tier. The tier is clamped like in DWrite_SetBlendIsa().
+const DWrite_ColorKernels& DWrite_GetColorKernels(DWrite_BlendIsa isa) noexcept;
@@ -0,0 +1,239 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "compositor.h"
+
+#include <algorithm>
+#include <vector>
+
+void DWrite_CompositeGrayscale(DWrite_ThreadPool& pool, const DWrite_BlendParams& params, const DWrite_Bitmap<const u8>& coverage, const DWrite_Bitmap<u32>& target, u32x2 tileSize) noexcept
+{
+    const auto width = std::min(coverage.width, target.width);
+    const auto height = std::min(coverage.height, target.height);
+
+    DWrite_ForEachTile(pool, width, height, tileSize, [&](const DWrite_Rect& tile) noexcept {
+        for (auto y = tile.top; y < tile.bottom; ++y)
+        {
+            DWrite_GrayscaleBlendSpan(params, coverage.Row(y) + tile.left, target.Row(y) + tile.left, tile.right - tile.left);
+        }
+    });
+}
+
+void DWrite_CompositeCleartype(DWrite_ThreadPool& pool, const DWrite_BlendParams& params, const DWrite_Bitmap<const u32>& coverage, const DWrite_Bitmap<u32>& target, u32x2 tileSize) noexcept
+{
+    const auto width = std::min(coverage.width, target.width);
+    const auto height = std::min(coverage.height, target.height);
+
+    DWrite_ForEachTile(pool, width, height, tileSize, [&](const DWrite_Rect& tile) noexcept {
+        for (auto y = tile.top; y < tile.bottom; ++y)
+        {
+            DWrite_CleartypeBlendSpan(params, coverage.Row(y) + tile.left, target.Row(y) + tile.left, tile.right - tile.left);
+        }
+    });
+}
+
+template<typename T>
+static const T* atlasRow(const DWrite_AtlasPage& page, u32 x, u32 y) noexcept
+{
+    return reinterpret_cast<const T*>(static_cast<const u8*>(page.pixels) + y * page.stride) + x;
+}
+
+// Returns true if a and b have any pixels in common within clip.
+static bool overlapsWithin(const DWrite_Rect& a, const DWrite_Rect& b, const DWrite_Rect& clip) noexcept
+{
+    const auto left = std::max({ a.left, b.left, clip.left });
+    const auto top = std::max({ a.top, b.top, clip.top });
+    const auto right = std::min({ a.right, b.right, clip.right });
+    const auto bottom = std::min({ a.bottom, b.bottom, clip.bottom });
+    return left < right && top < bottom;
+}
+
+void DWrite_BlendGlyphs(DWrite_ThreadPool& pool, const DWrite_BlendParams& params, const DWrite_AtlasPage* pages, const DWrite_GlyphInstance* glyphs, size_t count, const DWrite_Bitmap<u32>& target, u32x2 tileSize)
+{
+    if (!count || !target.width || !target.height || !tileSize.x || !tileSize.y)
+    {
+        return;
+    }
+
+    const auto tilesX = (target.width + tileSize.x - 1) / tileSize.x;
+    const auto tilesY = (target.height + tileSize.y - 1) / tileSize.y;
+
+    // Returns the range of tiles the glyph overlaps as [x0, x1) x [y0, y1). It's empty if the glyph is off-screen.
+    const auto tileRange = [&](const DWrite_Rect& dest) noexcept {
+        const auto right = std::min(dest.right, target.width);
+        const auto bottom = std::min(dest.bottom, target.height);
+        if (dest.left >= right || dest.top >= bottom)
+        {
+            return DWrite_Rect{};
+        }
+        return DWrite_Rect{
+            .left = dest.left / tileSize.x,
+            .top = dest.top / tileSize.y,
+            .right = (right - 1) / tileSize.x + 1,
+            .bottom = (bottom - 1) / tileSize.y + 1,
+        };
+    };
+
+    // Bin the glyphs by tile with a counting sort. Glyphs that straddle a tile boundary end up in multiple bins.
+    // Scattering them in submission order keeps each bin in submission order as well.
+    std::vector<u32> binStart(static_cast<size_t>(tilesX) * tilesY + 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto r = tileRange(glyphs[i].dest);
+        for (auto y = r.top; y < r.bottom; ++y)
+        {
+            for (auto x = r.left; x < r.right; ++x)
+            {
+                binStart[y * tilesX + x + 1]++;
+            }
+        }
+    }
+    for (size_t i = 1; i < binStart.size(); ++i)
+    {
+        binStart[i] += binStart[i - 1];
+    }
+
+    std::vector<u32> binned(binStart.back());
+    {
+        auto binEnd = binStart;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto r = tileRange(glyphs[i].dest);
+            for (auto y = r.top; y < r.bottom; ++y)
+            {
+                for (auto x = r.left; x < r.right; ++x)
+                {
+                    binned[binEnd[y * tilesX + x]++] = static_cast<u32>(i);
+                }
+            }
+        }
+    }
+
+    // The 7-level tables only depend on the glyph's colors, so we build them once instead of once per tile.
+    std::vector<DWrite_CleartypeLevelTable> levelTables;
+    std::vector<u32> levelTableIndex;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto& g = glyphs[i];
+        if (g.mode == DWrite_BlendMode::ClearTypeLevels && g.background)
+        {
+            if (levelTableIndex.empty())
+            {
+                levelTableIndex.resize(count);
+            }
+
+            auto p = params;
+            p.foregroundColor = g.foreground;
+            levelTableIndex[i] = static_cast<u32>(levelTables.size());
+            DWrite_BuildCleartypeLevelTable(p, g.background, levelTables.emplace_back());
+        }
+    }
+
+    const auto primitiveSpan = DWrite_GetBlendSpan(DWrite_BlendMode::Primitive, false, DWrite_TargetEncoding::Encoded);
+    // A 128x64 tile holds about 64 terminal cells, so this rarely splits a run that doesn't contain overlaps.
+    constexpr ptrdiff_t maxSortedRun = 64;
+
+    pool.ParallelFor(binStart.size() - 1, [&](size_t tileIndex) noexcept {
+        const auto begin = binned.begin() + binStart[tileIndex];
+        const auto end = binned.begin() + binStart[tileIndex + 1];
+        if (begin == end)
+        {
+            return;
+        }
+
+        const auto tileX = static_cast<u32>(tileIndex % tilesX) * tileSize.x;
+        const auto tileY = static_cast<u32>(tileIndex / tilesX) * tileSize.y;
+        const auto tileRight = std::min(tileX + tileSize.x, target.width);
+        const auto tileBottom = std::min(tileY + tileSize.y, target.height);
+        const DWrite_Rect tile{ tileX, tileY, tileRight, tileBottom };
+
+        // Grouping the glyphs by atlas page reorders them, which would change the result wherever they overlap.
+        // So the bin is split into runs of glyphs that don't overlap each other within the tile and only those
+        // are sorted. The runs are capped, because each glyph is checked against all previous ones in its run.
+        for (auto run = begin; run != end;)
+        {
+            auto runEnd = run + 1;
+            while (runEnd != end && runEnd - run < maxSortedRun && std::none_of(run, runEnd, [&](u32 i) noexcept {
+                       return overlapsWithin(glyphs[i].dest, glyphs[*runEnd].dest, tile);
+                   }))
+            {
+                ++runEnd;
+            }
+
+            std::stable_sort(run, runEnd, [&](u32 a, u32 b) noexcept {
+                return glyphs[a].atlasPage < glyphs[b].atlasPage;
+            });
+            run = runEnd;
+        }
+
+        auto p = params;
+
+        for (auto it = begin; it != end; ++it)
+        {
+            const auto& g = glyphs[*it];
+            const auto& page = pages[g.atlasPage];
+            const auto left = std::max(g.dest.left, tileX);
+            const auto top = std::max(g.dest.top, tileY);
+            const auto right = std::min(g.dest.right, tileRight);
+            const auto bottom = std::min(g.dest.bottom, tileBottom);
+            const auto width = right - left;
+            const auto atlasX = g.atlasPos.x + (left - g.dest.left);
+            const auto atlasY = g.atlasPos.y + (top - g.dest.top);
+
+            p.foregroundColor = g.foreground;
+
+            for (auto y = top; y < bottom; ++y)
+            {
+                const auto dst = target.Row(y) + left;
+                const auto ay = atlasY + (y - top);
+
+                switch (g.mode)
+                {
+                case DWrite_BlendMode::Grayscale:
+                    DWrite_GrayscaleBlendSpan(p, atlasRow<u8>(page, atlasX, ay), dst, width);
+                    break;
+                case DWrite_BlendMode::ClearTypeLevels:
+                    if (g.background)
+                    {
+                        const auto& table = levelTables[levelTableIndex[*it]];
+                        if (page.cleartypePacked)
+                        {
+                            DWrite_CleartypeBlendSpanPacked(table, atlasRow<u16>(page, atlasX, ay), dst, width);
+                        }
+                        else
+                        {
+                            DWrite_CleartypeBlendSpanLevels(table, atlasRow<u32>(page, atlasX, ay), dst, width);
+                        }
+                        break;
+                    }
+                    [[fallthrough]];
+                case DWrite_BlendMode::ClearType:
+                    if (g.background)
+                    {
+                        std::fill_n(dst, width, g.background);
+                    }
+                    if (page.cleartypePacked)
+                    {
+                        // The float blend needs B8G8R8A8 coverage, so unpack the row in chunks on the stack.
+                        const auto src = atlasRow<u16>(page, atlasX, ay);
+                        u32 unpacked[256];
+                        for (u32 x = 0; x < width; x += 256)
+                        {
+                            const auto n = std::min(width - x, 256u);
+                            DWrite_UnpackCleartypeCoverageSpan(src + x, &unpacked[0], n);
+                            DWrite_CleartypeBlendSpan(p, &unpacked[0], dst + x, n);
+                        }
+                    }
+                    else
+                    {
+                        DWrite_CleartypeBlendSpan(p, atlasRow<u32>(page, atlasX, ay), dst, width);
+                    }
+                    break;
+                case DWrite_BlendMode::Primitive:
+                    primitiveSpan(p, atlasRow<u32>(page, atlasX, ay), dst, width);
+                    break;
+                }
+            }
+        }
+    });
+}
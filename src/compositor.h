@@ -0,0 +1,112 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "blend.h"
+#include "thread_pool.h"
+
+// A software compositor for headless rendering of large framebuffers. It splits the target into
+// tiles (similar to how main_ps.hlsl repeats the glyph texture every tileSize pixels) and blends them
+// in parallel with the dispatching span functions from blend.h.
+
+// A view of a 2D pixel buffer. The stride is in elements, not bytes.
+template<typename T>
+struct DWrite_Bitmap
+{
+    T* pixels = nullptr;
+    u32 width = 0;
+    u32 height = 0;
+    size_t stride = 0;
+
+    T* Row(u32 y) const noexcept
+    {
+        return pixels + y * stride;
+    }
+};
+
+// A rectangle in pixels. right and bottom are exclusive.
+struct DWrite_Rect
+{
+    u32 left = 0;
+    u32 top = 0;
+    u32 right = 0;
+    u32 bottom = 0;
+};
+
+// 128x64 tiles are 32KiB of B8G8R8A8 pixels plus 8KiB of A8 coverage. Together with the span
+// functions' working set this stays well within the L2 cache of any CPU from the last decade.
+// The tiles are wide rather than square, because the span functions process entire rows.
+inline constexpr u32x2 DWrite_DefaultTileSize{ 128, 64 };
+
+// Calls func(const DWrite_Rect& tile) for every tile of a width x height target, in parallel.
+// Tiles are numbered row by row, so that each thread starts out with a contiguous band of the target.
+template<typename Func>
+void DWrite_ForEachTile(DWrite_ThreadPool& pool, u32 width, u32 height, u32x2 tileSize, Func&& func) noexcept
+{
+    if (!width || !height || !tileSize.x || !tileSize.y)
+    {
+        return;
+    }
+
+    const auto tilesX = (width + tileSize.x - 1) / tileSize.x;
+    const auto tilesY = (height + tileSize.y - 1) / tileSize.y;
+
+    pool.ParallelFor(static_cast<size_t>(tilesX) * tilesY, [&](size_t index) noexcept {
+        const auto x = static_cast<u32>(index % tilesX) * tileSize.x;
+        const auto y = static_cast<u32>(index / tilesX) * tileSize.y;
+        const DWrite_Rect tile{
+            .left = x,
+            .top = y,
+            .right = width - x < tileSize.x ? width : x + tileSize.x,
+            .bottom = height - y < tileSize.y ? height : y + tileSize.y,
+        };
+        func(tile);
+    });
+}
+
+// Blends a grayscale coverage layer into the target, i.e. DWrite_GrayscaleBlendSpan() for every row.
+// Only the area covered by both bitmaps is touched.
+void DWrite_CompositeGrayscale(DWrite_ThreadPool& pool, const DWrite_BlendParams& params, const DWrite_Bitmap<const u8>& coverage, const DWrite_Bitmap<u32>& target, u32x2 tileSize = DWrite_DefaultTileSize) noexcept;
+
+// Same as DWrite_CompositeGrayscale, but for a ClearType coverage layer and DWrite_CleartypeBlendSpan().
+void DWrite_CompositeCleartype(DWrite_ThreadPool& pool, const DWrite_BlendParams& params, const DWrite_Bitmap<const u32>& coverage, const DWrite_Bitmap<u32>& target, u32x2 tileSize = DWrite_DefaultTileSize) noexcept;
+
+// A page of a glyph atlas.
+struct DWrite_AtlasPage
+{
+    // A8 pixels for DWrite_BlendMode::Grayscale glyphs and B8G8R8A8 ones for all other modes.
+    const void* pixels = nullptr;
+    // The distance between rows in bytes.
+    size_t stride = 0;
+    // If true, the ClearType glyphs on this page are stored as 16-bit DWrite_PackCleartypeCoverage() values instead.
+    bool cleartypePacked = false;
+};
+
+// A single glyph quad to be drawn by DWrite_BlendGlyphs.
+struct DWrite_GlyphInstance
+{
+    // Where to draw the glyph in the target. Parts outside of the target are clipped.
+    DWrite_Rect dest;
+    // The top-left corner of the glyph in its atlas page. The glyph has the same size as dest.
+    u32x2 atlasPos;
+    u32 atlasPage = 0;
+    DWrite_BlendMode mode = DWrite_BlendMode::Grayscale;
+    // The text color (premultiplied).
+    f32x4 foreground;
+    // The opaque B8G8R8A8 color behind the glyph for the ClearType modes, like the backgroundColor of
+    // DWrite_CleartypeBlend in dwrite.hlsl. If it's 0 (transparent) the target pixels are used instead,
+    // which means that DWrite_BlendMode::ClearTypeLevels falls back to DWrite_BlendMode::ClearType.
+    // The Grayscale and Primitive modes ignore this and blend onto the target.
+    u32 background = 0;
+};
+
+// Draws an entire frame's worth of glyphs in one call.
+//
+// Drawing glyphs one by one jumps all over the target and the atlas. Instead, this function bins the glyphs
+// by the target tiles they overlap and then processes the tiles in parallel. Within each tile, runs of glyphs
+// that don't overlap each other are sorted by atlas page, so that each page is read in one go while the tile
+// stays in the cache. Overlapping glyphs are always drawn in submission order.
+//
+// params provides everything but the foreground color, which comes from each glyph instead.
+void DWrite_BlendGlyphs(DWrite_ThreadPool& pool, const DWrite_BlendParams& params, const DWrite_AtlasPage* pages, const DWrite_GlyphInstance* glyphs, size_t count, const DWrite_Bitmap<u32>& target, u32x2 tileSize = DWrite_DefaultTileSize);
@@ -0,0 +1,491 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "concurrent_glyph_atlas.h"
+
+#include <algorithm>
+
+static constexpr u32 initialCapacity = 64;
+
+DWrite_ConcurrentGlyphAtlas::Table::Table(u32 capacity) :
+    entries{ std::make_unique<Entry[]>(capacity) },
+    capacity{ capacity }
+{
+}
+
+DWrite_ConcurrentGlyphAtlas::DWrite_ConcurrentGlyphAtlas(u32 width, u32 height, u32 pageCount, u32 threadCount) :
+    _width{ width },
+    _height{ height },
+    _pageCount{ std::max(pageCount, 2u) },
+    _threadCount{ std::max(threadCount, 1u) },
+    _segmentWidth{ std::clamp(width / 16, 32u, 256u) },
+    _pages{ std::make_unique<Page[]>(_pageCount) },
+    _threads{ std::make_unique<Thread[]>(_threadCount) },
+    _shards{ std::make_unique<Shard[]>(shardCount) },
+    _ownedTable{ std::make_unique<Table>(initialCapacity) }
+{
+    const auto heightClasses = heightClass(height) + 1;
+
+    for (u32 i = 0; i < _pageCount; ++i)
+    {
+        _pages[i].rows.resize(heightClasses);
+    }
+    for (u32 i = 0; i < _threadCount; ++i)
+    {
+        _threads[i].shelves.resize(heightClasses);
+    }
+
+    _table.store(_ownedTable.get());
+}
+
+DWrite_ConcurrentGlyphAtlas::~DWrite_ConcurrentGlyphAtlas() = default;
+
+u32 DWrite_ConcurrentGlyphAtlas::Width() const noexcept
+{
+    return _width;
+}
+
+u32 DWrite_ConcurrentGlyphAtlas::Height() const noexcept
+{
+    return _height;
+}
+
+u32 DWrite_ConcurrentGlyphAtlas::PageCount() const noexcept
+{
+    return _pageCount;
+}
+
+u32 DWrite_ConcurrentGlyphAtlas::ThreadCount() const noexcept
+{
+    return _threadCount;
+}
+
+u64 DWrite_ConcurrentGlyphAtlas::Frame() const noexcept
+{
+    return _frame.load(std::memory_order_relaxed);
+}
+
+bool DWrite_ConcurrentGlyphAtlas::Find(u32 thread, const DWrite_GlyphKey& key, DWrite_AtlasGlyph& glyph) noexcept
+{
+    auto& t = _threads[thread];
+    const auto hash = DWrite_HashGlyphKey(key);
+    // If Publish() moved the glyph from its shard into the map between the first two lookups, neither of them
+    // saw it. Publish() fills the map before it empties the shard, so looking at the map again finds it.
+    // This only costs anything on a miss, which is followed by an Insert() anyway.
+    const auto found = findPublished(t, key, hash, glyph) || findPending(key, hash, glyph) || findPublished(t, key, hash, glyph);
+
+    if (found)
+    {
+        touch(glyph);
+    }
+
+    auto& counter = found ? t.hits : t.misses;
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return found;
+}
+
+DWrite_AtlasInsertResult DWrite_ConcurrentGlyphAtlas::Insert(u32 thread, const DWrite_GlyphKey& key, u32 width, u32 height, DWrite_AtlasGlyph& glyph)
+{
+    auto& t = _threads[thread];
+    const auto hash = DWrite_HashGlyphKey(key);
+
+    // Publish() doesn't run concurrently, so if the glyph isn't published now, it won't be until this returns.
+    if (findPublished(t, key, hash, glyph))
+    {
+        touch(glyph);
+        return DWrite_AtlasInsertResult::Existing;
+    }
+
+    auto& shard = shardFor(hash);
+    const std::lock_guard lock{ shard.mutex };
+
+    for (const auto& p : shard.glyphs)
+    {
+        if (p.hash == hash && p.key == key)
+        {
+            glyph = p.glyph;
+            touch(glyph);
+            return DWrite_AtlasInsertResult::Existing;
+        }
+    }
+
+    if (!allocate(t, width, height, glyph))
+    {
+        t.failures.store(t.failures.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return DWrite_AtlasInsertResult::Failed;
+    }
+
+    shard.glyphs.push_back({ .key = key, .glyph = glyph, .hash = hash });
+    shard.count.store(static_cast<u32>(shard.glyphs.size()), std::memory_order_release);
+    touch(glyph);
+    t.insertions.store(t.insertions.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return DWrite_AtlasInsertResult::Inserted;
+}
+
+void DWrite_ConcurrentGlyphAtlas::Publish()
+{
+    u32 pending = 0;
+    for (u32 i = 0; i < shardCount; ++i)
+    {
+        pending += _shards[i].count.load(std::memory_order_relaxed);
+    }
+
+    if (pending)
+    {
+        // Keep the load factor at or below 50%, like DWrite_GlyphAtlas.
+        const auto size = _size.load(std::memory_order_relaxed) + pending;
+        auto capacity = _ownedTable->capacity;
+        while (size * 2 > capacity)
+        {
+            capacity *= 2;
+        }
+        if (capacity != _ownedTable->capacity)
+        {
+            auto table = std::make_unique<Table>(capacity);
+            copyEntries(*table, none);
+            replaceTable(std::move(table));
+        }
+
+        // Readers may be probing the table right now. That's fine, because insertEntry() only fills empty slots.
+        for (u32 i = 0; i < shardCount; ++i)
+        {
+            auto& shard = _shards[i];
+            const std::lock_guard lock{ shard.mutex };
+
+            for (const auto& p : shard.glyphs)
+            {
+                insertEntry(*_ownedTable, p.key, p.glyph, p.hash);
+            }
+
+            shard.glyphs.clear();
+            shard.count.store(0, std::memory_order_release);
+        }
+
+        _size.store(size, std::memory_order_relaxed);
+    }
+
+    const auto endedFrame = _frame.fetch_add(1, std::memory_order_relaxed);
+
+    // Evict the least recently used page, unless one is still empty or all were used during the ending frame.
+    auto lru = none;
+    for (u32 i = 0; i < _pageCount; ++i)
+    {
+        const auto& p = _pages[i];
+        if (!p.nextY)
+        {
+            lru = none;
+            break;
+        }
+
+        const auto lastUsed = p.lastUsed.load(std::memory_order_relaxed);
+        if (lastUsed < endedFrame && (lru == none || lastUsed < _pages[lru].lastUsed.load(std::memory_order_relaxed)))
+        {
+            lru = i;
+        }
+    }
+    if (lru != none)
+    {
+        evictPage(lru);
+    }
+
+    reclaim();
+}
+
+bool DWrite_ConcurrentGlyphAtlas::IsValid(const DWrite_AtlasGlyph& glyph) const noexcept
+{
+    if (glyph.page == emptyPage)
+    {
+        return true;
+    }
+    return glyph.page < _pageCount && glyph.generation == _pages[glyph.page].generation.load(std::memory_order_acquire);
+}
+
+const std::vector<DWrite_GlyphKey>& DWrite_ConcurrentGlyphAtlas::EvictedGlyphs() const noexcept
+{
+    return _evicted;
+}
+
+void DWrite_ConcurrentGlyphAtlas::ClearEvictedGlyphs() noexcept
+{
+    _evicted.clear();
+}
+
+u32 DWrite_ConcurrentGlyphAtlas::Size() const noexcept
+{
+    return _size.load(std::memory_order_relaxed);
+}
+
+DWrite_GlyphAtlasStats DWrite_ConcurrentGlyphAtlas::Stats() const noexcept
+{
+    DWrite_GlyphAtlasStats stats{
+        .evictedPages = _evictedPages,
+        .evictedGlyphs = _evictedGlyphs,
+    };
+    for (u32 i = 0; i < _threadCount; ++i)
+    {
+        const auto& t = _threads[i];
+        stats.hits += t.hits.load(std::memory_order_relaxed);
+        stats.misses += t.misses.load(std::memory_order_relaxed);
+        stats.insertions += t.insertions.load(std::memory_order_relaxed);
+        stats.failures += t.failures.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+u32 DWrite_ConcurrentGlyphAtlas::makeTag(u64 hash) noexcept
+{
+    return static_cast<u32>(hash >> 32) | 1;
+}
+
+// Only called by Publish(), which is the only writer, and only for keys that aren't in the table yet.
+void DWrite_ConcurrentGlyphAtlas::insertEntry(Table& table, const DWrite_GlyphKey& key, const DWrite_AtlasGlyph& glyph, u64 hash) noexcept
+{
+    const auto mask = table.capacity - 1;
+
+    for (auto i = static_cast<u32>(hash) & mask;; i = (i + 1) & mask)
+    {
+        auto& e = table.entries[i];
+        if (!e.tag.load(std::memory_order_relaxed))
+        {
+            e.key = key;
+            e.glyph = glyph;
+            // Publishes the key and glyph to readers that acquire the tag.
+            e.tag.store(makeTag(hash), std::memory_order_release);
+            return;
+        }
+    }
+}
+
+// A reader announces the epoch it's in before loading the table pointer. replaceTable() swaps the pointer
+// before it increments the epoch, so a reader that announced a later epoch can't have seen the old table.
+bool DWrite_ConcurrentGlyphAtlas::findPublished(Thread& thread, const DWrite_GlyphKey& key, u64 hash, DWrite_AtlasGlyph& glyph) noexcept
+{
+    thread.epoch.store(_epoch.load(std::memory_order_acquire));
+    const auto table = _table.load();
+
+    const auto mask = table->capacity - 1;
+    const auto tag = makeTag(hash);
+    auto found = false;
+
+    for (auto i = static_cast<u32>(hash) & mask;; i = (i + 1) & mask)
+    {
+        const auto& e = table->entries[i];
+        const auto t = e.tag.load(std::memory_order_acquire);
+        if (!t)
+        {
+            break;
+        }
+        if (t == tag && e.key == key)
+        {
+            glyph = e.glyph;
+            found = true;
+            break;
+        }
+    }
+
+    thread.epoch.store(0, std::memory_order_release);
+    return found;
+}
+
+bool DWrite_ConcurrentGlyphAtlas::findPending(const DWrite_GlyphKey& key, u64 hash, DWrite_AtlasGlyph& glyph) noexcept
+{
+    auto& shard = shardFor(hash);
+    if (!shard.count.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    const std::lock_guard lock{ shard.mutex };
+    for (const auto& p : shard.glyphs)
+    {
+        if (p.hash == hash && p.key == key)
+        {
+            glyph = p.glyph;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The table uses the lower bits of the hash, so the shards use the upper ones.
+DWrite_ConcurrentGlyphAtlas::Shard& DWrite_ConcurrentGlyphAtlas::shardFor(u64 hash) const noexcept
+{
+    return _shards[(hash >> 40) & (shardCount - 1)];
+}
+
+u32 DWrite_ConcurrentGlyphAtlas::heightClass(u32 height) const noexcept
+{
+    return (height + heightGranularity - 1) / heightGranularity;
+}
+
+// Bump-allocates the glyph from the thread's shelf for its height class. Empty glyphs (like whitespace)
+// don't take up any space and go to emptyPage, which no eviction ever touches.
+bool DWrite_ConcurrentGlyphAtlas::allocate(Thread& thread, u32 width, u32 height, DWrite_AtlasGlyph& glyph)
+{
+    if (width > _width || height > _height)
+    {
+        return false;
+    }
+
+    if (!width || !height)
+    {
+        glyph = {
+            .rect = {},
+            .page = emptyPage,
+            .generation = 0,
+        };
+        return true;
+    }
+
+    const auto cls = heightClass(height);
+    auto& shelf = thread.shelves[cls];
+    if (shelf.page == none || shelf.right - shelf.x < width)
+    {
+        if (!reserveShelf(cls, width, shelf))
+        {
+            return false;
+        }
+    }
+
+    glyph = {
+        .rect = { shelf.x, shelf.y, shelf.x + width, shelf.y + height },
+        .page = shelf.page,
+        .generation = _pages[shelf.page].generation.load(std::memory_order_relaxed),
+    };
+    shelf.x += width;
+    return true;
+}
+
+// Reserves a segment of a row for the height class, opening a new row if the current one is full.
+// The rest of the thread's previous shelf is abandoned, which wastes at most one segment per thread and class.
+bool DWrite_ConcurrentGlyphAtlas::reserveShelf(u32 heightClass, u32 width, Shelf& shelf)
+{
+    const auto rowHeight = std::min(heightClass * heightGranularity, _height);
+    const auto segment = std::min(std::max(_segmentWidth, width), _width);
+    const std::lock_guard lock{ _allocMutex };
+
+    for (u32 i = 0; i < _pageCount; ++i)
+    {
+        const auto page = (_allocPage + i) % _pageCount;
+        auto& p = _pages[page];
+        auto& row = p.rows[heightClass];
+
+        if (row.y == none || _width - row.x < width)
+        {
+            if (_height - p.nextY < rowHeight)
+            {
+                continue;
+            }
+            row = { .y = p.nextY, .x = 0 };
+            p.nextY += rowHeight;
+        }
+
+        const auto right = row.x + std::min(segment, _width - row.x);
+        shelf = { .page = page, .x = row.x, .y = row.y, .right = right };
+        row.x = right;
+        _allocPage = page;
+        return true;
+    }
+
+    return false;
+}
+
+// Marks the glyph's page as used. The store is skipped if it wouldn't change anything,
+// which keeps the cache line from bouncing between the threads that use the same page.
+void DWrite_ConcurrentGlyphAtlas::touch(const DWrite_AtlasGlyph& glyph) noexcept
+{
+    if (glyph.rect.right == glyph.rect.left)
+    {
+        return;
+    }
+
+    auto& lastUsed = _pages[glyph.page].lastUsed;
+    const auto frame = _frame.load(std::memory_order_relaxed);
+    if (lastUsed.load(std::memory_order_relaxed) != frame)
+    {
+        lastUsed.store(frame, std::memory_order_relaxed);
+    }
+}
+
+// Copies all entries of the current table into table, except for the ones on the given page.
+// skipPage is none when the table grows. It's the same value as emptyPage, so it has to be checked explicitly.
+void DWrite_ConcurrentGlyphAtlas::copyEntries(Table& table, u32 skipPage)
+{
+    const auto& current = *_ownedTable;
+
+    for (u32 i = 0; i < current.capacity; ++i)
+    {
+        const auto& e = current.entries[i];
+        if (!e.tag.load(std::memory_order_relaxed))
+        {
+            continue;
+        }
+        if (skipPage != none && e.glyph.page == skipPage)
+        {
+            _evicted.push_back(e.key);
+            continue;
+        }
+        insertEntry(table, e.key, e.glyph, DWrite_HashGlyphKey(e.key));
+    }
+}
+
+void DWrite_ConcurrentGlyphAtlas::replaceTable(std::unique_ptr<Table> table)
+{
+    auto old = std::move(_ownedTable);
+    _ownedTable = std::move(table);
+    _table.store(_ownedTable.get());
+    // The old table may be freed once every reader has announced an epoch past the current one.
+    const auto epoch = _epoch.fetch_add(1);
+    _retired.push_back({ .table = std::move(old), .epoch = epoch });
+}
+
+// Removes all glyphs on the page and resets it. Only called by Publish(), so no Insert() is running.
+void DWrite_ConcurrentGlyphAtlas::evictPage(u32 page)
+{
+    auto& p = _pages[page];
+
+    // Readers that still find the glyphs in the old table will see that they're no longer valid.
+    p.generation.fetch_add(1, std::memory_order_release);
+    p.lastUsed.store(0, std::memory_order_relaxed);
+    p.nextY = 0;
+    std::fill(p.rows.begin(), p.rows.end(), Row{});
+
+    for (u32 i = 0; i < _threadCount; ++i)
+    {
+        for (auto& shelf : _threads[i].shelves)
+        {
+            if (shelf.page == page)
+            {
+                shelf = {};
+            }
+        }
+    }
+
+    const auto evictedBefore = _evicted.size();
+    auto table = std::make_unique<Table>(_ownedTable->capacity);
+    copyEntries(*table, page);
+    replaceTable(std::move(table));
+
+    const auto count = static_cast<u32>(_evicted.size() - evictedBefore);
+    _size.store(_size.load(std::memory_order_relaxed) - count, std::memory_order_relaxed);
+    _evictedPages++;
+    _evictedGlyphs += count;
+}
+
+// Frees the retired tables that no reader can still be using.
+void DWrite_ConcurrentGlyphAtlas::reclaim() noexcept
+{
+    auto oldest = UINT64_MAX;
+    for (u32 i = 0; i < _threadCount; ++i)
+    {
+        const auto epoch = _threads[i].epoch.load();
+        if (epoch && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+
+    std::erase_if(_retired, [&](const Retired& r) {
+        return r.epoch < oldest;
+    });
+}
@@ -0,0 +1,218 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "glyph_atlas.h"
+
+// A glyph atlas that several rasterizer threads (e.g. one per pane or tab) can use at the same time.
+// DWrite_GlyphAtlas behind a mutex would serialize all of them, even though nearly all accesses are lookups
+// of glyphs that were inserted in an earlier frame. This class is built around that:
+//
+// * Published glyphs live in an insert-only open-addressing hash map. Find() reads it without any locks or
+//   atomic read-modify-write operations. When the map has to grow or an eviction removes glyphs, a new map
+//   replaces the old one, which is freed once no thread can still be reading it (epoch-based reclamation).
+// * Glyphs inserted during the current frame are kept in one of several mutex-protected shards by key,
+//   so that two threads inserting the same glyph get the same location. Find() only looks at the shards
+//   if they aren't empty.
+// * Each thread allocates its glyphs from its own shelves: horizontal strips of an atlas page, one per glyph
+//   height class, which are reserved from the page in segments. Only reserving a new segment takes a lock.
+// * Publish() is called once per frame from a single thread. It moves the new glyphs into the hash map
+//   and evicts the least recently used page if no page is completely free anymore.
+//
+// Since the maps are replaced while other threads read them, glyphs are returned by value.
+
+// The result of DWrite_ConcurrentGlyphAtlas::Insert().
+enum class DWrite_AtlasInsertResult : u32
+{
+    // The glyph got a new location. The caller has to upload its pixels.
+    Inserted,
+    // Another thread inserted the glyph first. Its pixels are uploaded by that thread.
+    Existing,
+    // There's no room for the glyph until Publish() evicted a page, or it's larger than a page.
+    Failed,
+};
+
+class DWrite_ConcurrentGlyphAtlas
+{
+public:
+    // The page of empty glyphs (e.g. whitespace). They don't take up any space, so evictions never affect them.
+    static constexpr u32 emptyPage = ~0u;
+
+    // The size of each page in pixels, the number of pages (at least 2, see Publish()) and the number
+    // of threads that call Find() and Insert(). Each of them passes its own index in [0, threadCount).
+    DWrite_ConcurrentGlyphAtlas(u32 width, u32 height, u32 pageCount, u32 threadCount);
+    ~DWrite_ConcurrentGlyphAtlas();
+
+    DWrite_ConcurrentGlyphAtlas(const DWrite_ConcurrentGlyphAtlas&) = delete;
+    DWrite_ConcurrentGlyphAtlas& operator=(const DWrite_ConcurrentGlyphAtlas&) = delete;
+
+    u32 Width() const noexcept;
+    u32 Height() const noexcept;
+    u32 PageCount() const noexcept;
+    u32 ThreadCount() const noexcept;
+    u64 Frame() const noexcept;
+
+    // Returns true and the glyph if it was inserted before, and marks its page as used.
+    // Can be called concurrently with any other member function, including Publish(). A glyph found while
+    // Publish() is running may have been evicted by it, which IsValid() tells. Glyphs that Publish() moves
+    // into the hash map at the same time are still found.
+    bool Find(u32 thread, const DWrite_GlyphKey& key, DWrite_AtlasGlyph& glyph) noexcept;
+    // Allocates a width x height rectangle for the glyph from the thread's shelves.
+    // Can be called concurrently with Find() and Insert(), but not with Publish().
+    DWrite_AtlasInsertResult Insert(u32 thread, const DWrite_GlyphKey& key, u32 width, u32 height, DWrite_AtlasGlyph& glyph);
+    // Ends the frame. New glyphs become visible to Find() without taking any locks. If no page is completely
+    // free, the least recently used one that wasn't used during the ending frame is evicted, so that the next
+    // frame has room for new glyphs. This means that one page is usually kept free.
+    // Must only be called from one thread at a time and not concurrently with Insert().
+    void Publish();
+
+    // Returns true if the glyph is still stored where it was when Find() or Insert() returned it.
+    // This is always the case for empty glyphs.
+    bool IsValid(const DWrite_AtlasGlyph& glyph) const noexcept;
+    // The keys of the glyphs evicted by Publish() since the last call to ClearEvictedGlyphs().
+    // Must only be used by the thread that calls Publish().
+    const std::vector<DWrite_GlyphKey>& EvictedGlyphs() const noexcept;
+    void ClearEvictedGlyphs() noexcept;
+
+    // The number of published glyphs.
+    u32 Size() const noexcept;
+    // The sum of all threads' statistics. Like EvictedGlyphs(), this must only be used by the thread that calls Publish().
+    DWrite_GlyphAtlasStats Stats() const noexcept;
+
+private:
+    static constexpr u32 none = ~0u;
+    // The number of Insert() shards. A power of 2 well above any reasonable thread count.
+    static constexpr u32 shardCount = 64;
+    // Shelf heights are rounded up to a multiple of this.
+    static constexpr u32 heightGranularity = 4;
+
+    // A slot of the published hash map. The key and glyph are written before the tag is set
+    // and never change afterwards, so readers may access them once they've seen a non-zero tag.
+    struct Entry
+    {
+        std::atomic<u32> tag{ 0 };
+        DWrite_GlyphKey key;
+        DWrite_AtlasGlyph glyph;
+    };
+
+    struct Table
+    {
+        explicit Table(u32 capacity);
+
+        std::unique_ptr<Entry[]> entries;
+        // A power of 2.
+        u32 capacity = 0;
+    };
+
+    struct Retired
+    {
+        std::unique_ptr<Table> table;
+        // The value of _epoch when the table was replaced.
+        u64 epoch = 0;
+    };
+
+    struct Pending
+    {
+        DWrite_GlyphKey key;
+        DWrite_AtlasGlyph glyph;
+        u64 hash = 0;
+    };
+
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::vector<Pending> glyphs;
+        // glyphs.size(), so that Find() can skip the lock if it's 0.
+        std::atomic<u32> count{ 0 };
+    };
+
+    // A segment of a row of glyphs of the same height class.
+    struct Shelf
+    {
+        u32 page = none;
+        u32 x = 0;
+        u32 y = 0;
+        u32 right = 0;
+    };
+
+    struct alignas(64) Thread
+    {
+        // The epoch this thread entered Find() in, or 0 if it's outside of it.
+        std::atomic<u64> epoch{ 0 };
+        // Indexed by height class.
+        std::vector<Shelf> shelves;
+        // Only ever written by the owning thread.
+        std::atomic<u64> hits{ 0 };
+        std::atomic<u64> misses{ 0 };
+        std::atomic<u64> insertions{ 0 };
+        std::atomic<u64> failures{ 0 };
+    };
+
+    // The open row of a height class on a page.
+    struct Row
+    {
+        u32 y = none;
+        u32 x = 0;
+    };
+
+    struct alignas(64) Page
+    {
+        std::atomic<u32> generation{ 0 };
+        std::atomic<u64> lastUsed{ 0 };
+        // The following are protected by _allocMutex.
+        // The top of the area that no row has been reserved from yet.
+        u32 nextY = 0;
+        // Indexed by height class.
+        std::vector<Row> rows;
+    };
+
+    static u32 makeTag(u64 hash) noexcept;
+    static void insertEntry(Table& table, const DWrite_GlyphKey& key, const DWrite_AtlasGlyph& glyph, u64 hash) noexcept;
+    bool findPublished(Thread& thread, const DWrite_GlyphKey& key, u64 hash, DWrite_AtlasGlyph& glyph) noexcept;
+    bool findPending(const DWrite_GlyphKey& key, u64 hash, DWrite_AtlasGlyph& glyph) noexcept;
+    Shard& shardFor(u64 hash) const noexcept;
+    u32 heightClass(u32 height) const noexcept;
+    bool allocate(Thread& thread, u32 width, u32 height, DWrite_AtlasGlyph& glyph);
+    bool reserveShelf(u32 heightClass, u32 width, Shelf& shelf);
+    void touch(const DWrite_AtlasGlyph& glyph) noexcept;
+    void copyEntries(Table& table, u32 skipPage);
+    void replaceTable(std::unique_ptr<Table> table);
+    void evictPage(u32 page);
+    void reclaim() noexcept;
+
+    u32 _width = 0;
+    u32 _height = 0;
+    u32 _pageCount = 0;
+    u32 _threadCount = 0;
+    // The width of the shelf segments that threads reserve at once. Wider segments mean fewer
+    // locks, but each thread may leave up to one segment per height class unused.
+    u32 _segmentWidth = 0;
+    std::unique_ptr<Page[]> _pages;
+    std::unique_ptr<Thread[]> _threads;
+    std::unique_ptr<Shard[]> _shards;
+
+    // The current map. It's owned by _ownedTable and only replaced by Publish().
+    std::atomic<Table*> _table{ nullptr };
+    std::unique_ptr<Table> _ownedTable;
+    std::vector<Retired> _retired;
+    // Starts at 1, so that a Thread::epoch of 0 means "not reading".
+    std::atomic<u64> _epoch{ 1 };
+    std::atomic<u32> _size{ 0 };
+
+    // Protects the rows of all pages.
+    std::mutex _allocMutex;
+    // The page reserveShelf() tries first.
+    u32 _allocPage = 0;
+
+    // Starts at 1, so that a lastUsed of 0 means "never".
+    std::atomic<u64> _frame{ 1 };
+    std::vector<DWrite_GlyphKey> _evicted;
+    u64 _evictedPages = 0;
+    u64 _evictedGlyphs = 0;
+};
@@ -0,0 +1,267 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "diff.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <vector>
+
+#if DWRITE_BLEND_X86
+#include <immintrin.h>
+#endif
+
+static const std::array<u32, 256>& heatmapTable() noexcept
+{
+    static const auto table = [] {
+        // The colors at t = 0, 0.25, 0.5, 0.75 and 1.
+        static constexpr f32 stops[5][3]{
+            { 0, 0, 128 },
+            { 0, 160, 255 },
+            { 0, 255, 0 },
+            { 255, 255, 0 },
+            { 255, 0, 0 },
+        };
+
+        std::array<u32, 256> t{};
+        t[0] = 0xff000000;
+
+        for (u32 e = 1; e < 256; ++e)
+        {
+            // 1 maps to 0 and 255 to almost 1, with each power of 2 taking up an equal share.
+            const auto k = static_cast<u32>(std::bit_width(e)) - 1;
+            const auto frac = static_cast<f32>(e - (1u << k)) / static_cast<f32>(1u << k);
+            const auto pos = (static_cast<f32>(k) + frac) / 8.0f * 4.0f;
+            const auto i = std::min(static_cast<u32>(pos), 3u);
+            const auto f = pos - static_cast<f32>(i);
+
+            u32 rgb = 0;
+            for (u32 c = 0; c < 3; ++c)
+            {
+                const auto v = stops[i][c] + (stops[i + 1][c] - stops[i][c]) * f;
+                rgb = (rgb << 8) | static_cast<u32>(v + 0.5f);
+            }
+            t[e] = 0xff000000 | rgb;
+        }
+
+        return t;
+    }();
+    return table;
+}
+
+u32 DWrite_DiffHeatmapColor(u32 e) noexcept
+{
+    return heatmapTable()[std::min(e, 255u)];
+}
+
+void DWrite_DiffRow_Scalar(const u32* reference, const u32* actual, u32* heatmap, size_t count, DWrite_DiffAccumulator& acc) noexcept
+{
+    const auto& table = heatmapTable();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        u32 m = 0;
+
+        for (u32 c = 0; c < 4; ++c)
+        {
+            const auto x = (reference[i] >> (c * 8)) & 0xff;
+            const auto y = (actual[i] >> (c * 8)) & 0xff;
+            const auto d = x > y ? x - y : y - x;
+            acc.sum[c] += d;
+            acc.sumOfSquares[c] += d * d;
+            acc.max[c] = std::max(acc.max[c], d);
+            m = std::max(m, d);
+        }
+
+        acc.histogram[m]++;
+        if (heatmap)
+        {
+            heatmap[i] = table[m];
+        }
+    }
+}
+
+#if DWRITE_BLEND_X86
+
+DWRITE_TARGET_AVX2 DWRITE_FORCEINLINE static u64 sumEpi32(__m256i v) noexcept
+{
+    alignas(32) u32 lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(&lanes[0]), v);
+    u64 sum = 0;
+    for (const auto l : lanes)
+    {
+        sum += l;
+    }
+    return sum;
+}
+
+DWRITE_TARGET_AVX2 void DWrite_DiffRow_AVX2(const u32* reference, const u32* actual, u32* heatmap, size_t count, DWrite_DiffAccumulator& acc) noexcept
+{
+    // The per-lane sums are flushed into acc every this many pixels. 8192 squares per lane
+    // are at most 8192 * 255^2 < 2^32, so the 32-bit lanes can't overflow in between.
+    static constexpr size_t chunkSize = 8 * 8192;
+
+    const auto table = reinterpret_cast<const int*>(heatmapTable().data());
+    const auto mask = _mm256_set1_epi32(0xff);
+    size_t i = 0;
+
+    while (i + 8 <= count)
+    {
+        const auto chunkEnd = std::min(count, i + chunkSize);
+        __m256i sum[4]{};
+        __m256i sumOfSquares[4]{};
+        auto maxBytes = _mm256_setzero_si256();
+
+        for (; i + 8 <= chunkEnd; i += 8)
+        {
+            const auto r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(reference + i));
+            const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(actual + i));
+            // |r - a| per byte, since one of the two saturating differences is always 0.
+            const auto diff = _mm256_or_si256(_mm256_subs_epu8(r, a), _mm256_subs_epu8(a, r));
+            maxBytes = _mm256_max_epu8(maxBytes, diff);
+
+            for (int c = 0; c < 4; ++c)
+            {
+                const auto d = _mm256_and_si256(_mm256_srli_epi32(diff, c * 8), mask);
+                sum[c] = _mm256_add_epi32(sum[c], d);
+                // The upper 16 bits of each lane are 0, so this is d * d + 0 * 0.
+                sumOfSquares[c] = _mm256_add_epi32(sumOfSquares[c], _mm256_madd_epi16(d, d));
+            }
+
+            // The largest channel error of each pixel.
+            auto m = _mm256_max_epu8(diff, _mm256_srli_epi32(diff, 8));
+            m = _mm256_and_si256(_mm256_max_epu8(m, _mm256_srli_epi32(m, 16)), mask);
+
+            // Identical pixels are by far the most common case, so they're counted in one go.
+            const auto zero = static_cast<u32>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(m, _mm256_setzero_si256()))));
+            acc.histogram[0] += std::popcount(zero);
+            if (zero != 0xff)
+            {
+                alignas(32) u32 lanes[8];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(&lanes[0]), m);
+                for (auto bits = ~zero & 0xff; bits; bits &= bits - 1)
+                {
+                    acc.histogram[lanes[std::countr_zero(bits)]]++;
+                }
+            }
+
+            if (heatmap)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(heatmap + i), _mm256_i32gather_epi32(table, m, 4));
+            }
+        }
+
+        alignas(32) u8 maxLanes[32];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(&maxLanes[0]), maxBytes);
+        for (u32 j = 0; j < 32; ++j)
+        {
+            acc.max[j % 4] = std::max<u32>(acc.max[j % 4], maxLanes[j]);
+        }
+        for (int c = 0; c < 4; ++c)
+        {
+            acc.sum[c] += sumEpi32(sum[c]);
+            acc.sumOfSquares[c] += sumEpi32(sumOfSquares[c]);
+        }
+    }
+
+    DWrite_DiffRow_Scalar(reference + i, actual + i, heatmap ? heatmap + i : nullptr, count - i, acc);
+}
+
+#endif
+
+// Indexed by DWrite_BlendIsa.
+static constexpr DWrite_DiffKernels s_kernels[]{
+    {
+        .diffRow = DWrite_DiffRow_Scalar,
+    },
+#if DWRITE_BLEND_X86
+    {
+        .diffRow = DWrite_DiffRow_Scalar,
+    },
+    {
+        .diffRow = DWrite_DiffRow_AVX2,
+    },
+    {
+        .diffRow = DWrite_DiffRow_AVX2,
+    },
+#endif
+};
+
+// The tier is the one picked for the span functions in blend.h, which is always supported.
+static const DWrite_DiffKernels& activeKernels() noexcept
+{
+    return s_kernels[static_cast<u32>(DWrite_GetBlendIsa())];
+}
+
+const DWrite_DiffKernels& DWrite_GetDiffKernels(DWrite_BlendIsa isa) noexcept
+{
+    const auto supported = DWrite_GetSupportedBlendIsa();
+    return s_kernels[static_cast<u32>(isa < supported ? isa : supported)];
+}
+
+void DWrite_DiffRow(const u32* reference, const u32* actual, u32* heatmap, size_t count, DWrite_DiffAccumulator& acc) noexcept
+{
+    activeKernels().diffRow(reference, actual, heatmap, count, acc);
+}
+
+DWrite_DiffStats DWrite_DiffImages(DWrite_ThreadPool& pool, const DWrite_Bitmap<const u32>& reference, const DWrite_Bitmap<const u32>& actual, const DWrite_Bitmap<u32>* heatmap)
+{
+    auto width = std::min(reference.width, actual.width);
+    auto height = std::min(reference.height, actual.height);
+    if (heatmap)
+    {
+        width = std::min(width, heatmap->width);
+        height = std::min(height, heatmap->height);
+    }
+
+    DWrite_DiffStats stats;
+    if (!width || !height)
+    {
+        return stats;
+    }
+
+    // A few bands per thread, so that work stealing can even out the load.
+    const auto bands = std::min<size_t>(height, static_cast<size_t>(pool.ThreadCount()) * 8);
+    std::vector<DWrite_DiffAccumulator> partials(bands);
+
+    pool.ParallelFor(bands, [&](size_t band) noexcept {
+        const auto top = static_cast<u32>(height * band / bands);
+        const auto bottom = static_cast<u32>(height * (band + 1) / bands);
+        auto& acc = partials[band];
+
+        for (auto y = top; y < bottom; ++y)
+        {
+            DWrite_DiffRow(reference.Row(y), actual.Row(y), heatmap ? heatmap->Row(y) : nullptr, width, acc);
+        }
+    });
+
+    DWrite_DiffAccumulator total;
+    for (const auto& p : partials)
+    {
+        for (u32 c = 0; c < 4; ++c)
+        {
+            total.sum[c] += p.sum[c];
+            total.sumOfSquares[c] += p.sumOfSquares[c];
+            total.max[c] = std::max(total.max[c], p.max[c]);
+        }
+        for (u32 e = 0; e < 256; ++e)
+        {
+            total.histogram[e] += p.histogram[e];
+        }
+    }
+
+    stats.pixelCount = static_cast<u64>(width) * height;
+    for (u32 c = 0; c < 4; ++c)
+    {
+        auto& channel = stats.channels[c];
+        channel.max = total.max[c];
+        channel.mean = static_cast<f64>(total.sum[c]) / static_cast<f64>(stats.pixelCount);
+        channel.rms = std::sqrt(static_cast<f64>(total.sumOfSquares[c]) / static_cast<f64>(stats.pixelCount));
+        stats.maxError = std::max(stats.maxError, channel.max);
+    }
+    std::copy_n(&total.histogram[0], 256, &stats.histogram[0]);
+    stats.differingPixels = stats.pixelCount - stats.histogram[0];
+    return stats;
+}
@@ -0,0 +1,72 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "compositor.h"
+
+// Compares two B8G8R8A8 images pixel by pixel, for instance the Direct2D reference against the output of
+// the blend functions. All errors are absolute differences in 8-bit units (LSB).
+
+struct DWrite_DiffChannelStats
+{
+    u32 max = 0;
+    f64 mean = 0;
+    // The root mean square error.
+    f64 rms = 0;
+};
+
+struct DWrite_DiffStats
+{
+    // In B, G, R, A order, like the bytes of a B8G8R8A8 pixel.
+    DWrite_DiffChannelStats channels[4];
+    // The largest error of any channel.
+    u32 maxError = 0;
+    u64 pixelCount = 0;
+    // The number of pixels with a non-zero error in any channel.
+    u64 differingPixels = 0;
+    // histogram[e] is the number of pixels whose largest channel error is e.
+    u64 histogram[256]{};
+};
+
+// Returns the B8G8R8A8 heatmap color for a pixel whose largest channel error is e. 0 is black, and
+// errors go from dark blue (1 LSB) over cyan, green and yellow to red (255) on a log2 scale, because the
+// interesting differences between blend kernels are usually just a few LSB.
+u32 DWrite_DiffHeatmapColor(u32 e) noexcept;
+
+// The per-row accumulator of DWrite_DiffRow. The sums are exact, so the result doesn't depend on how
+// an image is split up between threads. Each one is cache line aligned, because every thread updates its own.
+struct alignas(64) DWrite_DiffAccumulator
+{
+    u64 sum[4]{};
+    u64 sumOfSquares[4]{};
+    u32 max[4]{};
+    u64 histogram[256]{};
+};
+
+// Compares count pixels and adds them to acc. If heatmap isn't null, DWrite_DiffHeatmapColor() of
+// each pixel is written to it. Forwards to the implementation picked by DWrite_SetBlendIsa().
+void DWrite_DiffRow(const u32* reference, const u32* actual, u32* heatmap, size_t count, DWrite_DiffAccumulator& acc) noexcept;
+
+void DWrite_DiffRow_Scalar(const u32* reference, const u32* actual, u32* heatmap, size_t count, DWrite_DiffAccumulator& acc) noexcept;
+#if DWRITE_BLEND_X86
+void DWrite_DiffRow_AVX2(const u32* reference, const u32* actual, u32* heatmap, size_t count, DWrite_DiffAccumulator& acc) noexcept;
+#endif
+
+// The function-pointer table used by DWrite_DiffRow(). It follows the tier picked with DWrite_SetBlendIsa().
+// There are only Scalar and AVX2 implementations, which the other tiers reuse.
+struct DWrite_DiffKernels
+{
+    void (*diffRow)(const u32* reference, const u32* actual, u32* heatmap, size_t count, DWrite_DiffAccumulator& acc) noexcept;
+};
+
+// Returns the kernels for the given tier. The tier is clamped like in DWrite_SetBlendIsa().
+const DWrite_DiffKernels& DWrite_GetDiffKernels(DWrite_BlendIsa isa) noexcept;
+
+// Compares the area covered by both images in parallel and returns the statistics. If heatmap isn't null,
+// it receives DWrite_DiffHeatmapColor() for every compared pixel it covers.
+//
+// Unlike DWrite_CompositeGrayscale this works on horizontal bands instead of tiles: every pixel is only read
+// once, so there's no cache reuse to be had, and full rows keep the hardware prefetchers busy. Each band
+// reduces into its own DWrite_DiffAccumulator, which are summed up at the end.
+DWrite_DiffStats DWrite_DiffImages(DWrite_ThreadPool& pool, const DWrite_Bitmap<const u32>& reference, const DWrite_Bitmap<const u32>& actual, const DWrite_Bitmap<u32>* heatmap = nullptr);
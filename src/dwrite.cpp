@@ -3,7 +3,15 @@
 
 #include "dwrite.h"
 
+#include "dwrite_math.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cwchar>
+
+#ifdef _WIN32
 #include <wil/com.h>
+#endif
 
 #pragma warning(disable : 26429) // Symbol '...' is never tested for nullness, it can be marked as not_null (f.23).
 
@@ -13,6 +21,7 @@ constexpr T clamp(T v, T min, T max) noexcept
     return std::max(min, std::min(max, v));
 }
 
+#ifdef _WIN32
 void DWrite_GetRenderParams(IDWriteFactory1* factory, float* gamma, float* cleartypeEnhancedContrast, float* grayscaleEnhancedContrast, IDWriteRenderingParams1** linearParams)
 {
     // If you're concerned with crash resilience don't use reinterpret_cast
@@ -26,6 +35,7 @@ void DWrite_GetRenderParams(IDWriteFactory1* factory, float* gamma, float* clear
 
     THROW_IF_FAILED(factory->CreateCustomRenderingParams(1.0f, 0.0f, 0.0f, defaultParams->GetClearTypeLevel(), defaultParams->GetPixelGeometry(), defaultParams->GetRenderingMode(), linearParams));
 }
+#endif
 
 // The following tables are taken from directly from DirectWrite and were not modified.
 //
@@ -93,6 +103,42 @@ void DWrite_GetGammaRatiosForEncodedTarget(float gamma, float (&out)[4]) noexcep
     DWrite_GetGammaRatios(gamma, out, sc_gammaIncorrectTargetRatios);
 }
 
+// These use the same inline functions (dwrite_math.h) as the CPU port of DWrite_GrayscaleBlend/DWrite_CleartypeBlend
+// in blend.h, which guarantees that the DWrite_BlendConstants overloads produce bit-identical results.
+void DWrite_GetGrayscaleBlendConstants(const float (&gammaRatios)[4], float grayscaleEnhancedContrast, bool isThinFont, const float (&foregroundColor)[4], DWrite_BlendConstants& out) noexcept
+{
+    const f32x4 fg{ foregroundColor[0], foregroundColor[1], foregroundColor[2], foregroundColor[3] };
+    const auto foregroundStraight = DWrite_UnpremultiplyColor(fg);
+    const auto contrastBoost = isThinFont ? 0.5f : 0.0f;
+    const auto k = contrastBoost + DWrite_ApplyLightOnDarkContrastAdjustment(grayscaleEnhancedContrast, foregroundStraight);
+    const auto intensity = DWrite_CalcColorIntensity({ fg.r, fg.g, fg.b });
+    const auto g0 = gammaRatios[0] * intensity + gammaRatios[1];
+    const auto g1 = gammaRatios[2] * intensity + gammaRatios[3];
+
+    out = {
+        .contrast = { k, k + 1.0f, 0.0f, 0.0f },
+        .gamma0 = { g0, g0, g0, g0 },
+        .gamma1 = { g1, g1, g1, g1 },
+        .color = { fg.r, fg.g, fg.b, fg.a },
+    };
+}
+
+void DWrite_GetCleartypeBlendConstants(const float (&gammaRatios)[4], float enhancedContrast, bool isThinFont, const float (&foregroundColor)[4], DWrite_BlendConstants& out) noexcept
+{
+    const f32x4 fg{ foregroundColor[0], foregroundColor[1], foregroundColor[2], foregroundColor[3] };
+    const auto s = DWrite_UnpremultiplyColor(fg);
+    const auto contrastBoost = isThinFont ? 0.5f : 0.0f;
+    const auto k = contrastBoost + DWrite_ApplyLightOnDarkContrastAdjustment(enhancedContrast, s);
+    const auto& gr = gammaRatios;
+
+    out = {
+        .contrast = { k, k + 1.0f, 0.0f, 0.0f },
+        .gamma0 = { gr[0] * s.r + gr[1], gr[0] * s.g + gr[1], gr[0] * s.b + gr[1], 0.0f },
+        .gamma1 = { gr[2] * s.r + gr[3], gr[2] * s.g + gr[3], gr[2] * s.b + gr[3], 0.0f },
+        .color = { s.r, s.g, s.b, fg.a },
+    };
+}
+
 // This belongs to isThinFontFamily().
 // Keep this in alphabetical order, or the loop will break.
 // Keep thinFontFamilyNamesMaxWithNull updated.
@@ -122,6 +168,7 @@ bool DWrite_IsThinFontFamily(const wchar_t* canonicalFamilyName) noexcept
     return n == 0;
 }
 
+#ifdef _WIN32
 bool DWrite_IsThinFontFamily(IDWriteFontCollection* fontCollection, const wchar_t* familyName)
 {
     UINT32 index;
@@ -156,3 +203,4 @@ bool DWrite_IsThinFontFamily(IDWriteFontCollection* fontCollection, const wchar_
 
     return DWrite_IsThinFontFamily(&enUsFamilyName[0]);
 }
+#endif
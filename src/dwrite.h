@@ -3,11 +3,16 @@
 
 #pragma once
 
+// The gamma ratio and thin-font helpers are portable, so that the CPU blending
+// code in blend.h can be used on platforms without DirectWrite as well.
+// Everything that requires a DirectWrite object is only available on Windows.
+#ifdef _WIN32
 // Exclude stuff from <Windows.h> we don't need.
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
 
 #include <dwrite_1.h>
+#endif
 
 // The `gamma` and `grayscaleEnhancedContrast` values are required for DWrite_GetGrayscaleCorrectedAlpha()
 // in shader.hlsl and can be passed in your constant buffer, for instance.
@@ -24,7 +29,9 @@
 //
 // Under Windows applications aren't expected to refresh the rendering params after startup,
 // allowing you to cache these values for the lifetime of your application.
+#ifdef _WIN32
 void DWrite_GetRenderParams(IDWriteFactory1* factory, float* gamma, float* cleartypeEnhancedContrast, float* grayscaleEnhancedContrast, IDWriteRenderingParams1** linearParams);
+#endif
 
 // This function produces 4 magic constants for DWrite_ApplyAlphaCorrection() in dwrite.hlsl
 // and are required as an argument for DWrite_GetGrayscaleCorrectedAlpha().
@@ -47,6 +54,34 @@ void DWrite_GetGammaRatiosForLinearTarget(float gamma, float (&out)[4]) noexcept
 // For all other cases, use DWrite_GetGammaRatiosForLinearTarget.
 void DWrite_GetGammaRatiosForEncodedTarget(float gamma, float (&out)[4]) noexcept;
 
+// DWrite_GrayscaleBlend and DWrite_CleartypeBlend in dwrite.hlsl spend most of their instructions on
+// DWrite_UnpremultiplyColor, DWrite_ApplyLightOnDarkContrastAdjustment and DWrite_CalcColorIntensity,
+// none of which depend on the pixel. DWrite_GetGrayscaleBlendConstants and DWrite_GetCleartypeBlendConstants
+// compute all of that once per foreground color. Pass the result in your constant buffer and call
+// the DWrite_BlendConstants overloads of DWrite_GrayscaleBlend/DWrite_CleartypeBlend instead.
+// Their results are identical to the regular functions.
+//
+// The layout matches the DWrite_BlendConstants struct in dwrite.hlsl (4 float4 registers).
+struct DWrite_BlendConstants
+{
+    // x: The effective enhanced contrast k, including the thin-font boost and the light-on-dark adjustment.
+    // y: k + 1
+    // zw: Unused.
+    float contrast[4];
+    // gammaRatios.x * f + gammaRatios.y and gammaRatios.z * f + gammaRatios.w, where f is the intensity of the
+    // foreground color for grayscale (in xyzw) and the straight foreground color per channel for ClearType (in xyz).
+    float gamma0[4];
+    float gamma1[4];
+    // Grayscale: The premultiplied foreground color.
+    // ClearType: The straight foreground color in xyz and its alpha in w.
+    float color[4];
+};
+
+// gammaRatios, the enhanced contrast and isThinFont are the same as for DWrite_GrayscaleBlend/DWrite_CleartypeBlend.
+// foregroundColor is the premultiplied RGBA text color.
+void DWrite_GetGrayscaleBlendConstants(const float (&gammaRatios)[4], float grayscaleEnhancedContrast, bool isThinFont, const float (&foregroundColor)[4], DWrite_BlendConstants& out) noexcept;
+void DWrite_GetCleartypeBlendConstants(const float (&gammaRatios)[4], float enhancedContrast, bool isThinFont, const float (&foregroundColor)[4], DWrite_BlendConstants& out) noexcept;
+
 // DWrite_IsThinFontFamily returns true if the specified family name is in our hard-coded list of "thin fonts".
 // These are fonts that require special rendering because their strokes are too thin.
 //
@@ -70,8 +105,10 @@ void DWrite_GetGammaRatiosForEncodedTarget(float gamma, float (&out)[4]) noexcep
 // See the overloaded alternative version of isThinFontFamily.
 bool DWrite_IsThinFontFamily(const wchar_t* canonicalFamilyName) noexcept;
 
+#ifdef _WIN32
 // The actual DWrite_IsThinFontFamily() expects you to pass a "canonical" family name,
 // which technically isn't that trivial to determine. This function might help you with that.
 // Just give it the font collection you use and any family name from that collection.
 // (For instance from IDWriteFactory::GetSystemFontCollection.)
 bool DWrite_IsThinFontFamily(IDWriteFontCollection* fontCollection, const wchar_t* familyName);
+#endif
@@ -140,3 +140,110 @@ float4 DWrite_CleartypeBlend(float4 gammaRatios, float enhancedContrast, bool is
     float3 alphaCorrected = DWrite_ApplyAlphaCorrection3(contrasted, foregroundStraight, gammaRatios);
     return float4(lerp(backgroundColor.rgb, foregroundStraight, alphaCorrected * foregroundColor.a), 1.0f);
 }
+
+// Filled out by DWrite_GetGrayscaleBlendConstants() or DWrite_GetCleartypeBlendConstants() in dwrite.cpp.
+// See the struct of the same name in dwrite.h for a description of the members.
+struct DWrite_BlendConstants
+{
+    float4 contrast;
+    float4 gamma0;
+    float4 gamma1;
+    float4 color;
+};
+
+// Same as the other DWrite_GrayscaleBlend overload, but with everything that only depends on the foreground
+// color precomputed on the CPU. This saves the unpremultiplication (including a branch and 3 divisions),
+// 2 dot products and a handful of multiply-adds per pixel. The result is the same.
+float4 DWrite_GrayscaleBlend(DWrite_BlendConstants c, float glyphAlpha)
+{
+    float contrasted = glyphAlpha * c.contrast.y / (glyphAlpha * c.contrast.x + 1.0f);
+    float alphaCorrected = contrasted + contrasted * (1 - contrasted) * (c.gamma0.x * contrasted + c.gamma1.x);
+    return c.color * alphaCorrected;
+}
+
+// Same as the other DWrite_CleartypeBlend overload, but with everything that only depends on the foreground
+// color precomputed on the CPU. See the DWrite_GrayscaleBlend overload above.
+float4 DWrite_CleartypeBlend(DWrite_BlendConstants c, float4 backgroundColor, float4 glyphColor)
+{
+    float3 contrasted = glyphColor.rgb * c.contrast.y / (glyphColor.rgb * c.contrast.x + 1.0f);
+    float3 alphaCorrected = contrasted + contrasted * (1 - contrasted) * (c.gamma0.rgb * contrasted + c.gamma1.rgb);
+    return float4(lerp(backgroundColor.rgb, c.color.rgb, alphaCorrected * c.color.a), 1.0f);
+}
+
+// Blends straight into a linear scRGB target (DXGI_FORMAT_R16G16B16A16_FLOAT), the format DWM composes SDR content
+// into on HDR displays. With the gamma ratios from DWrite_GetGammaRatiosForLinearTarget this looks like blending into
+// an SDR target (see the fun fact above), without an intermediate SDR texture and a conversion pass.
+//
+// c:
+//   Computed for the linear foreground color, with SDR white at 1.0.
+// sdrWhiteLevel:
+//   The brightness of SDR white in scRGB units (1.0 = 80 nits), for instance from
+//   DISPLAYCONFIG_SDR_WHITE_LEVEL (SDRWhiteLevel / 1000.0f). The foreground color is scaled by it.
+// backgroundColor:
+//   The current contents of the target in scRGB units. It can be brighter than SDR white.
+//
+// The coverage weights only depend on the foreground color, so blending onto HDR content is well-defined.
+// For sdrWhiteLevel = 1 the results are identical to DWrite_GrayscaleBlend + alphaBlendPremultiplied
+// and DWrite_CleartypeBlend respectively.
+float4 DWrite_GrayscaleBlendScRgb(DWrite_BlendConstants c, float sdrWhiteLevel, float4 backgroundColor, float glyphAlpha)
+{
+    float4 top = DWrite_GrayscaleBlend(c, glyphAlpha);
+    top.rgb *= sdrWhiteLevel;
+    return backgroundColor * (1 - top.a) + top;
+}
+
+float4 DWrite_CleartypeBlendScRgb(DWrite_BlendConstants c, float sdrWhiteLevel, float4 backgroundColor, float4 glyphColor)
+{
+    float3 contrasted = glyphColor.rgb * c.contrast.y / (glyphColor.rgb * c.contrast.x + 1.0f);
+    float3 alphaCorrected = contrasted + contrasted * (1 - contrasted) * (c.gamma0.rgb * contrasted + c.gamma1.rgb);
+    return float4(lerp(backgroundColor.rgb, c.color.rgb * sdrWhiteLevel, alphaCorrected * c.color.a), 1.0f);
+}
+
+// DWrite_CleartypeBlend for glyphs rasterized with 6x1 overscaling, using a precomputed table.
+//
+// Such glyphs only contain 7 different coverage levels per channel and thus DWrite_CleartypeBlend can only
+// produce 7 different results per channel for any given foreground/background color pair. If your text only
+// uses a few color pairs (like a terminal does) you can precompute them and skip all of the math above.
+//
+// levels:
+//   levels[i].rgb is DWrite_CleartypeBlend(..., backgroundColor, foregroundColor, float4(i / 6.0f, ...)).
+//   See DWrite_GetCleartypeLevelColors() in blend.h, which computes these for you.
+// glyphColor:
+//   Same as for DWrite_CleartypeBlend. Values in between the 7 levels are rounded to the nearest level.
+float4 DWrite_CleartypeBlendLevels(float4 levels[7], float4 glyphColor)
+{
+    uint3 level = uint3(glyphColor.rgb * 6.0f + 0.5f);
+    return float4(levels[level.r].r, levels[level.g].g, levels[level.b].b, 1.0f);
+}
+
+// Same as DWrite_CleartypeBlendLevels, but with the tables stored in a texture, for when you have too many
+// color pairs to fit them into a constant buffer. Each row contains the 7 levels (padded to 8 texels) for
+// one foreground/background pair. With DXGI_FORMAT_B8G8R8A8_UNORM each row is exactly one
+// DWrite_CleartypeLevelTable from blend.h.
+float4 DWrite_CleartypeBlendLevelTexture(Texture2D<float4> table, uint row, float4 glyphColor)
+{
+    uint3 level = uint3(glyphColor.rgb * 6.0f + 0.5f);
+    return float4(table[uint2(level.r, row)].r, table[uint2(level.g, row)].g, table[uint2(level.b, row)].b, 1.0f);
+}
+
+// Compact glyph atlas formats. Grayscale glyphs only need their coverage, so they can be stored as
+// DXGI_FORMAT_R8_UNORM (or A8_UNORM) and read with .r (or .a) as the glyphAlpha. That's 4x smaller than B8G8R8A8.
+//
+// ClearType glyphs with 6x1 overscaling have 7 levels per subpixel, which fit into 3 bits each. They can be
+// stored as DXGI_FORMAT_R16_UINT, 2x smaller than B8G8R8A8, with blue in bits 0-2, green in bits 3-5 and red
+// in bits 6-8. See DWrite_PackCleartypeCoverage() in blend.h, which packs them for you.
+//
+// Returns the coverage in the same format as a B8G8R8A8 atlas, i.e. as the glyphColor of DWrite_CleartypeBlend.
+float3 DWrite_UnpackCleartypeCoverage(uint packed)
+{
+    uint3 level = min(uint3(packed >> 6, packed >> 3, packed) & 7, 6);
+    // The 8-bit value of each level is round(level * 255 / 6), e.g. 43 for level 1.
+    return float3((level * 255 + 3) / 6) / 255.0f;
+}
+
+// DWrite_CleartypeBlendLevels for packed coverage. This skips computing the levels.
+float4 DWrite_CleartypeBlendLevelsPacked(float4 levels[7], uint packed)
+{
+    uint3 level = min(uint3(packed >> 6, packed >> 3, packed) & 7, 6);
+    return float4(levels[level.r].r, levels[level.g].g, levels[level.b].b, 1.0f);
+}
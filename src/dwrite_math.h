@@ -0,0 +1,39 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "util.h"
+
+// The per-color helpers of dwrite.hlsl, shared by the CPU port in blend.h and by the
+// DWrite_Get*BlendConstants() functions in dwrite.cpp. Like blend.h, these are 1:1 translations
+// of their HLSL counterparts and should be kept in sync with them.
+
+inline f32 DWrite_Saturate(f32 v) noexcept
+{
+    // Written this way so that NaN turns into 0, just like saturate() in HLSL.
+    return v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+}
+
+inline f32x3 DWrite_UnpremultiplyColor(const f32x4& color) noexcept
+{
+    f32x3 rgb{ color.r, color.g, color.b };
+    if (color.a != 0)
+    {
+        rgb.r /= color.a;
+        rgb.g /= color.a;
+        rgb.b /= color.a;
+    }
+    return rgb;
+}
+
+inline f32 DWrite_ApplyLightOnDarkContrastAdjustment(f32 grayscaleEnhancedContrast, const f32x3& color) noexcept
+{
+    // See dwrite.hlsl for the unsimplified version of this.
+    return grayscaleEnhancedContrast * DWrite_Saturate(color.r * (0.30f * -4.0f) + color.g * (0.59f * -4.0f) + color.b * (0.11f * -4.0f) + 3.0f);
+}
+
+inline f32 DWrite_CalcColorIntensity(const f32x3& color) noexcept
+{
+    return color.r * 0.25f + color.g * 0.5f + color.b * 0.25f;
+}
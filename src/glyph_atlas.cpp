@@ -0,0 +1,689 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "glyph_atlas.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <utility>
+
+// imgui_draw.cpp compiles its own copy of stb_rect_pack. STBRP_STATIC keeps the two from clashing.
+// Not all of its functions are used, which GCC and clang warn about for static functions.
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include <imstb_rectpack.h>
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+// The number of phases actually used for glyphs of the given size: a power of 2 in [1, 256].
+static u32 effectivePhases(const DWrite_SubpixelPolicy& policy, u32 size) noexcept
+{
+    return size > policy.maxSize ? 1 : std::bit_floor(std::clamp(policy.phases, 1u, 256u));
+}
+
+DWrite_QuantizedX DWrite_QuantizeGlyphX(const DWrite_SubpixelPolicy& policy, u32 size, f32 x) noexcept
+{
+    const auto phases = static_cast<f32>(effectivePhases(policy, size));
+    // Dividing by a power of 2 is exact, so the fraction is exactly a multiple of 1/phases.
+    const auto rounded = std::floor(x * phases + 0.5f) / phases;
+    const auto pixel = std::floor(rounded);
+    return {
+        .x = static_cast<i32>(pixel),
+        .subpixel = static_cast<u32>((rounded - pixel) * 256.0f),
+    };
+}
+
+struct DWrite_GlyphAtlas::Page
+{
+    stbrp_context context{};
+    // The skyline needs at most one node per column to guarantee the best results.
+    std::vector<stbrp_node> nodes;
+    u32 generation = 0;
+    // The most recent lastUsed of all glyphs on this page.
+    u64 lastUsed = 0;
+    u32 glyphCount = 0;
+    u64 usedArea = 0;
+};
+
+static constexpr u32 initialCapacity = 64;
+
+DWrite_GlyphAtlas::DWrite_GlyphAtlas(u32 width, u32 height, u32 pageCount) :
+    _pages{ std::make_unique<Page[]>(pageCount ? pageCount : 1) },
+    _pageCount{ pageCount ? pageCount : 1 },
+    _slots{ std::make_unique<Slot[]>(initialCapacity) },
+    _capacity{ initialCapacity },
+    _width{ width },
+    _height{ height }
+{
+    for (u32 i = 0; i < _pageCount; ++i)
+    {
+        _pages[i].nodes.resize(width);
+        resetPage(i);
+    }
+}
+
+DWrite_GlyphAtlas::~DWrite_GlyphAtlas() = default;
+
+u32 DWrite_GlyphAtlas::Width() const noexcept
+{
+    return _width;
+}
+
+u32 DWrite_GlyphAtlas::Height() const noexcept
+{
+    return _height;
+}
+
+u32 DWrite_GlyphAtlas::PageCount() const noexcept
+{
+    return _pageCount;
+}
+
+void DWrite_GlyphAtlas::BeginFrame() noexcept
+{
+    _frame++;
+}
+
+u64 DWrite_GlyphAtlas::Frame() const noexcept
+{
+    return _frame;
+}
+
+const DWrite_AtlasGlyph* DWrite_GlyphAtlas::Find(const DWrite_GlyphKey& key) noexcept
+{
+    const auto slot = findSlot(key, DWrite_HashGlyphKey(key));
+    if (!slot->tag)
+    {
+        _stats.misses++;
+        return nullptr;
+    }
+
+    _stats.hits++;
+    touch(*slot);
+    return &slot->glyph;
+}
+
+const DWrite_AtlasGlyph* DWrite_GlyphAtlas::FindNearestVariant(const DWrite_GlyphKey& key, const DWrite_SubpixelPolicy& policy) noexcept
+{
+    if (const auto glyph = Find(key))
+    {
+        return glyph;
+    }
+
+    // Try the other phases of the policy in order of their distance to the requested one.
+    // Glyphs above the policy's maxSize only have one phase, so there's nothing else to try.
+    const auto step = 256 / effectivePhases(policy, key.size);
+    auto variant = key;
+
+    for (auto distance = step; distance < 256; distance += step)
+    {
+        for (const auto subpixel : { key.subpixel - distance, key.subpixel + distance })
+        {
+            // The subtraction wraps around to a large value if the phase would be negative.
+            if (subpixel >= 256)
+            {
+                continue;
+            }
+
+            variant.subpixel = subpixel;
+            if (const auto slot = findSlot(variant, DWrite_HashGlyphKey(variant)); slot->tag)
+            {
+                _stats.variantFallbacks++;
+                touch(*slot);
+                return &slot->glyph;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+const DWrite_AtlasGlyph* DWrite_GlyphAtlas::Insert(const DWrite_GlyphKey& key, u32 width, u32 height)
+{
+    const auto hash = DWrite_HashGlyphKey(key);
+
+    if (const auto slot = findSlot(key, hash); slot->tag)
+    {
+        touch(*slot);
+        return &slot->glyph;
+    }
+
+    if (width > _width || height > _height)
+    {
+        _stats.failures++;
+        return nullptr;
+    }
+
+    // Keep the load factor at or below 50%. This happens first, so that running out of memory doesn't leak atlas space.
+    if ((_size + 1) * 2 > _capacity)
+    {
+        rehash(_capacity * 2);
+    }
+
+    DWrite_Rect rect;
+    auto page = _currentPage;
+
+    if (width && height)
+    {
+        // Try the current page first and then all others, because older pages may still have some gaps left.
+        bool packed = false;
+        for (u32 i = 0; i < _pageCount && !packed; ++i)
+        {
+            page = (_currentPage + i) % _pageCount;
+            packed = page != _compactSource && pack(page, width, height, rect);
+        }
+
+        if (!packed)
+        {
+            // Evict the least recently used page and start filling it from scratch.
+            page = 0;
+            for (u32 i = 1; i < _pageCount; ++i)
+            {
+                if (_pages[i].lastUsed < _pages[page].lastUsed)
+                {
+                    page = i;
+                }
+            }
+
+            if (!evictPage(page) || !pack(page, width, height, rect))
+            {
+                _stats.failures++;
+                return nullptr;
+            }
+        }
+
+        _currentPage = page;
+    }
+
+    // findSlot() returns the first empty slot in the probe sequence if the key doesn't exist.
+    // It needs to be called again, because evictPage() rehashes the map.
+    const auto slot = findSlot(key, hash);
+    slot->key = key;
+    slot->glyph = {
+        .rect = rect,
+        .page = page,
+        .generation = _pages[page].generation,
+    };
+    slot->tag = makeTag(hash);
+    touch(*slot);
+
+    const auto area = static_cast<u64>(width) * height;
+    _pages[page].glyphCount++;
+    _pages[page].usedArea += area;
+    _size++;
+    _usedArea += area;
+    _stats.insertions++;
+    return &slot->glyph;
+}
+
+void DWrite_GlyphAtlas::Clear() noexcept
+{
+    for (u32 i = 0; i < _capacity; ++i)
+    {
+        _slots[i].tag = 0;
+    }
+    for (u32 i = 0; i < _pageCount; ++i)
+    {
+        _pages[i].generation++;
+        resetPage(i);
+    }
+    _size = 0;
+    _usedArea = 0;
+    _currentPage = 0;
+    _compactSource = none;
+    ClearMoves();
+}
+
+bool DWrite_GlyphAtlas::IsValid(const DWrite_AtlasGlyph& glyph) const noexcept
+{
+    return glyph.page < _pageCount && glyph.generation == _pages[glyph.page].generation;
+}
+
+u32 DWrite_GlyphAtlas::PageGeneration(u32 page) const noexcept
+{
+    return page < _pageCount ? _pages[page].generation : 0;
+}
+
+const std::vector<DWrite_GlyphKey>& DWrite_GlyphAtlas::EvictedGlyphs() const noexcept
+{
+    return _evicted;
+}
+
+void DWrite_GlyphAtlas::ClearEvictedGlyphs() noexcept
+{
+    _evicted.clear();
+}
+
+u32 DWrite_GlyphAtlas::Compact(std::chrono::microseconds budget, u64 maxIdleFrames)
+{
+    if (_pageCount < 2)
+    {
+        return 0;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + budget;
+    u32 moved = 0;
+    u32 visited = 0;
+
+    for (;;)
+    {
+        if (_compactSource == none && !selectCompactionSource(maxIdleFrames))
+        {
+            return moved;
+        }
+
+        auto& source = _pages[_compactSource];
+
+        if (!source.glyphCount)
+        {
+            // Draw calls of this frame may still reference the old locations.
+            if (source.lastUsed == _frame)
+            {
+                return moved;
+            }
+
+            source.generation++;
+            resetPage(_compactSource);
+            _stats.compactedPages++;
+            _compactSource = none;
+            continue;
+        }
+
+        while (_compactCursor < _capacity && source.glyphCount)
+        {
+            // Checking the clock is comparatively expensive, so it's only done every few slots.
+            if (++visited % 16 == 0 && std::chrono::steady_clock::now() >= deadline)
+            {
+                return moved;
+            }
+
+            auto& slot = _slots[_compactCursor];
+            if (!slot.tag || slot.glyph.page != _compactSource)
+            {
+                _compactCursor++;
+                continue;
+            }
+
+            if (_frame - slot.lastUsed > maxIdleFrames)
+            {
+                const auto area = static_cast<u64>(slot.glyph.rect.right - slot.glyph.rect.left) * (slot.glyph.rect.bottom - slot.glyph.rect.top);
+                _evicted.push_back(slot.key);
+                source.glyphCount--;
+                source.usedArea -= area;
+                _size--;
+                _usedArea -= area;
+                _stats.droppedGlyphs++;
+                // This shifts the following slots back, so the cursor stays where it is.
+                eraseSlot(_compactCursor);
+                continue;
+            }
+
+            if (!relocate(slot))
+            {
+                // The other pages are full. Give up on this page until it gets picked again.
+                _compactSource = none;
+                return moved;
+            }
+
+            moved++;
+            _compactCursor++;
+        }
+
+        // eraseSlot() may have moved glyphs in front of the cursor when it wrapped around.
+        _compactCursor = 0;
+    }
+}
+
+const std::vector<DWrite_AtlasMove>& DWrite_GlyphAtlas::Moves() const noexcept
+{
+    return _moves;
+}
+
+void DWrite_GlyphAtlas::ClearMoves() noexcept
+{
+    _moves.clear();
+    _moveIndex.clear();
+}
+
+bool DWrite_GlyphAtlas::Remap(DWrite_AtlasGlyph& glyph) const noexcept
+{
+    // A glyph can be moved several times. Each move goes to a newer generation, so this can't loop forever.
+    while (!IsValid(glyph))
+    {
+        const auto it = _moveIndex.find(locationKey(glyph));
+        if (it == _moveIndex.end())
+        {
+            return false;
+        }
+
+        const auto& from = _moves[it->second].from;
+        if (from.page != glyph.page || from.generation != glyph.generation || from.rect.left != glyph.rect.left || from.rect.top != glyph.rect.top)
+        {
+            return false;
+        }
+
+        glyph = _moves[it->second].to;
+    }
+    return true;
+}
+
+u32 DWrite_GlyphAtlas::Size() const noexcept
+{
+    return _size;
+}
+
+u64 DWrite_GlyphAtlas::UsedArea() const noexcept
+{
+    return _usedArea;
+}
+
+DWrite_GlyphAtlasWorkingSet DWrite_GlyphAtlas::WorkingSet(u64 frameCount) const
+{
+    DWrite_GlyphAtlasWorkingSet ws;
+    // The hash of each used glyph's key without its phase, and its area.
+    std::vector<std::pair<u64, u64>> used;
+
+    for (u32 i = 0; i < _capacity; ++i)
+    {
+        const auto& slot = _slots[i];
+        if (!slot.tag || _frame - slot.lastUsed >= frameCount)
+        {
+            continue;
+        }
+
+        const auto& r = slot.glyph.rect;
+        const auto area = static_cast<u64>(r.right - r.left) * (r.bottom - r.top);
+        auto key = slot.key;
+        key.subpixel = 0;
+
+        ws.variants++;
+        ws.variantArea += area;
+        used.emplace_back(DWrite_HashGlyphKey(key), area);
+    }
+
+    // All variants of a glyph are about the same size, so any one of them stands in for the glyph.
+    std::sort(used.begin(), used.end());
+    for (size_t i = 0; i < used.size(); ++i)
+    {
+        if (i == 0 || used[i].first != used[i - 1].first)
+        {
+            ws.glyphs++;
+            ws.glyphArea += used[i].second;
+        }
+    }
+
+    return ws;
+}
+
+DWrite_GlyphAtlasStats DWrite_GlyphAtlas::Stats() const noexcept
+{
+    return _stats;
+}
+
+void DWrite_GlyphAtlas::ResetStats() noexcept
+{
+    _stats = {};
+}
+
+u64 DWrite_HashGlyphKey(const DWrite_GlyphKey& key) noexcept
+{
+    // The key packed into 2 u64 and mixed with MurmurHash3's fmix64 finalizer.
+    auto h = (static_cast<u64>(key.fontFace) << 32 | key.glyphIndex) * 0x9e3779b97f4a7c15;
+    h ^= static_cast<u64>(key.size) << 32 | static_cast<u64>(key.subpixel) << 8 | static_cast<u64>(key.mode);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    return h;
+}
+
+u32 DWrite_GlyphAtlas::makeTag(u64 hash) noexcept
+{
+    return static_cast<u32>(hash >> 32) | 1;
+}
+
+// Textures are at most 16384 pixels wide and tall, so 16 bits per coordinate are enough. The generation
+// wraps around after 65536 evictions of the same page, which is why Remap() double-checks the result.
+// Empty glyphs all share the same location, which is fine, since they're all equally empty.
+u64 DWrite_GlyphAtlas::locationKey(const DWrite_AtlasGlyph& glyph) noexcept
+{
+    return static_cast<u64>(glyph.page & 0xffff) << 48 | static_cast<u64>(glyph.generation & 0xffff) << 32 | (glyph.rect.left & 0xffff) << 16 | (glyph.rect.top & 0xffff);
+}
+
+// Returns the slot holding the key or the empty slot where it would have to be inserted.
+// There's always at least one empty slot, because the load factor never exceeds 50%.
+DWrite_GlyphAtlas::Slot* DWrite_GlyphAtlas::findSlot(const DWrite_GlyphKey& key, u64 hash) const noexcept
+{
+    const auto mask = _capacity - 1;
+    const auto tag = makeTag(hash);
+
+    for (auto i = static_cast<u32>(hash) & mask;; i = (i + 1) & mask)
+    {
+        auto& slot = _slots[i];
+        if (!slot.tag || (slot.tag == tag && slot.key == key))
+        {
+            return &slot;
+        }
+    }
+}
+
+// Moves all occupied slots into a new table of the given capacity.
+void DWrite_GlyphAtlas::rehash(u32 capacity)
+{
+    const auto oldSlots = std::move(_slots);
+    const auto oldCapacity = _capacity;
+
+    _capacity = capacity;
+    _slots = std::make_unique<Slot[]>(_capacity);
+
+    for (u32 i = 0; i < oldCapacity; ++i)
+    {
+        const auto& old = oldSlots[i];
+        if (old.tag)
+        {
+            *findSlot(old.key, DWrite_HashGlyphKey(old.key)) = old;
+        }
+    }
+
+    _compactCursor = 0;
+}
+
+// Removes the slot and shifts back the following ones that would otherwise become unreachable,
+// because their probe sequence started at or before the removed slot.
+void DWrite_GlyphAtlas::eraseSlot(u32 index) noexcept
+{
+    const auto mask = _capacity - 1;
+    auto hole = index;
+
+    for (auto i = (index + 1) & mask; _slots[i].tag; i = (i + 1) & mask)
+    {
+        const auto home = static_cast<u32>(DWrite_HashGlyphKey(_slots[i].key)) & mask;
+        // The slot can move into the hole unless its home lies cyclically within (hole, i].
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            _slots[hole] = _slots[i];
+            hole = i;
+        }
+    }
+
+    _slots[hole].tag = 0;
+}
+
+void DWrite_GlyphAtlas::touch(Slot& slot) noexcept
+{
+    slot.lastUsed = _frame;
+    _pages[slot.glyph.page].lastUsed = _frame;
+}
+
+bool DWrite_GlyphAtlas::pack(u32 page, u32 width, u32 height, DWrite_Rect& rect) noexcept
+{
+    stbrp_rect r{};
+    r.w = static_cast<stbrp_coord>(width);
+    r.h = static_cast<stbrp_coord>(height);
+    if (!stbrp_pack_rects(&_pages[page].context, &r, 1))
+    {
+        return false;
+    }
+
+    rect = {
+        .left = static_cast<u32>(r.x),
+        .top = static_cast<u32>(r.y),
+        .right = static_cast<u32>(r.x) + width,
+        .bottom = static_cast<u32>(r.y) + height,
+    };
+    return true;
+}
+
+// Removes all glyphs on the page and resets it. Returns false if the page was used during the current frame.
+bool DWrite_GlyphAtlas::evictPage(u32 page)
+{
+    auto& p = _pages[page];
+    if (p.lastUsed == _frame)
+    {
+        return false;
+    }
+    if (page == _compactSource)
+    {
+        _compactSource = none;
+    }
+
+    // Deleting from a linear probing table would require shifting back the following slots. Since an eviction
+    // touches a large part of the table anyway, it's simpler to drop the glyphs and rehash everything in place.
+    _evicted.reserve(_evicted.size() + p.glyphCount);
+    for (u32 i = 0; i < _capacity; ++i)
+    {
+        auto& slot = _slots[i];
+        if (slot.tag && slot.glyph.page == page)
+        {
+            _evicted.push_back(slot.key);
+            slot.tag = 0;
+        }
+    }
+    rehash(_capacity);
+
+    _stats.evictedPages++;
+    _stats.evictedGlyphs += p.glyphCount;
+    _size -= p.glyphCount;
+    _usedArea -= p.usedArea;
+    p.generation++;
+    resetPage(page);
+    return true;
+}
+
+void DWrite_GlyphAtlas::resetPage(u32 page) noexcept
+{
+    auto& p = _pages[page];
+    p.lastUsed = 0;
+    p.glyphCount = 0;
+    p.usedArea = 0;
+    stbrp_init_target(&p.context, static_cast<int>(_width), static_cast<int>(_height), p.nodes.data(), static_cast<int>(_width));
+}
+
+// The area below the skyline, which the packer can't use anymore.
+u64 DWrite_GlyphAtlas::skylineArea(u32 page) const noexcept
+{
+    u64 area = 0;
+    for (auto n = _pages[page].context.active_head; n && n->next; n = n->next)
+    {
+        area += static_cast<u64>(n->next->x - n->x) * n->y;
+    }
+    return area;
+}
+
+// Picks the page with the least live glyph area among the fragmented ones, as long as the other pages
+// have enough room left for its live glyphs. The current page is still being filled and never picked.
+bool DWrite_GlyphAtlas::selectCompactionSource(u64 maxIdleFrames)
+{
+    _liveArea.assign(_pageCount, 0);
+    for (u32 i = 0; i < _capacity; ++i)
+    {
+        const auto& slot = _slots[i];
+        if (slot.tag && _frame - slot.lastUsed <= maxIdleFrames)
+        {
+            const auto& r = slot.glyph.rect;
+            _liveArea[slot.glyph.page] += static_cast<u64>(r.right - r.left) * (r.bottom - r.top);
+        }
+    }
+
+    const auto pageArea = static_cast<u64>(_width) * _height;
+    u64 freeArea = 0;
+    auto best = none;
+
+    for (u32 i = 0; i < _pageCount; ++i)
+    {
+        const auto skyline = skylineArea(i);
+        freeArea += pageArea - skyline;
+
+        if (i == _currentPage || skyline * 4 < pageArea * 3 || _liveArea[i] * 2 >= pageArea)
+        {
+            continue;
+        }
+        if (best == none || _liveArea[i] < _liveArea[best])
+        {
+            best = i;
+        }
+    }
+
+    if (best == none || freeArea - (pageArea - skylineArea(best)) < _liveArea[best])
+    {
+        return false;
+    }
+
+    _compactSource = best;
+    _compactCursor = 0;
+    return true;
+}
+
+// Moves the glyph off the compaction source into any other page with room and records the move.
+bool DWrite_GlyphAtlas::relocate(Slot& slot)
+{
+    const auto from = slot.glyph;
+    const auto width = from.rect.right - from.rect.left;
+    const auto height = from.rect.bottom - from.rect.top;
+
+    DWrite_Rect rect;
+    auto page = _currentPage;
+
+    if (width && height)
+    {
+        bool packed = false;
+        for (u32 i = 0; i < _pageCount && !packed; ++i)
+        {
+            page = (_currentPage + i) % _pageCount;
+            packed = page != _compactSource && pack(page, width, height, rect);
+        }
+        if (!packed)
+        {
+            return false;
+        }
+    }
+
+    auto& source = _pages[from.page];
+    auto& target = _pages[page];
+    const auto area = static_cast<u64>(width) * height;
+
+    slot.glyph = {
+        .rect = rect,
+        .page = page,
+        .generation = target.generation,
+    };
+
+    source.glyphCount--;
+    source.usedArea -= area;
+    target.glyphCount++;
+    target.usedArea += area;
+    // The glyph keeps its age, so that moving it doesn't protect the target page from eviction.
+    target.lastUsed = std::max(target.lastUsed, slot.lastUsed);
+
+    _moveIndex.insert_or_assign(locationKey(from), static_cast<u32>(_moves.size()));
+    _moves.push_back({ .key = slot.key, .from = from, .to = slot.glyph });
+    _stats.compactedGlyphs++;
+    return true;
+}
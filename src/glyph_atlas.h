@@ -0,0 +1,255 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "compositor.h"
+
+// A glyph atlas keeps every rasterized glyph in a texture, so that text only needs to be rasterized
+// once and can then be drawn with one quad per glyph (see DWrite_BlendGlyphs). DWrite_GlyphAtlas only
+// manages the layout of the texture. It doesn't know about DirectWrite or Direct3D, which means that the
+// caller rasterizes the glyphs and uploads them to the returned rectangles however it likes.
+//
+// The atlas consists of one or more equally sized pages (e.g. the slices of a texture array). Once all of
+// them are full, the least recently used page is evicted as a whole, which keeps the memory usage bounded
+// without having to flush and re-rasterize everything at once. Each eviction bumps the page's generation,
+// which invalidates all glyphs that were on it.
+//
+// Since glyphs are only ever removed a page at a time, pages fill up with glyphs that were only used briefly,
+// and evicting them throws out the glyphs that are still in use along with them. Compact() fixes this
+// incrementally: it moves the live glyphs of such a page into the free space of the others, drops the rest
+// and then resets the page, so that it can be filled from scratch. The moves are published, so that callers
+// can copy the pixels and update cached DWrite_AtlasGlyph handles (see Remap()).
+
+// Identifies a rasterized glyph. Any field that changes the rasterized result must be part of the key.
+struct DWrite_GlyphKey
+{
+    // An ID for the font face (IDWriteFontFace, including its simulations and axis values), assigned by the caller.
+    u32 fontFace = 0;
+    // The DWRITE_GLYPH_RUN::glyphIndices value.
+    u32 glyphIndex = 0;
+    // The font size in 1/64 pixels (26.6 fixed point), which avoids hashing floats.
+    u32 size = 0;
+    // The horizontal offset of the glyph origin within the pixel in 1/256 pixels, see DWrite_QuantizeGlyphX().
+    u32 subpixel = 0;
+    // Grayscale glyphs are A8 coverage and all others are B8G8R8A8. See DWrite_AtlasPage.
+    DWrite_BlendMode mode = DWrite_BlendMode::Grayscale;
+
+    bool operator==(const DWrite_GlyphKey&) const noexcept = default;
+};
+
+// A 64-bit hash of all fields of the key.
+u64 DWrite_HashGlyphKey(const DWrite_GlyphKey& key) noexcept;
+
+// Proportional fonts have fractional advances, so glyphs that are all snapped to whole pixels end up
+// unevenly spaced. Positioning them horizontally at a fraction of a pixel fixes that, but every distinct
+// fraction (phase) is a separate rasterization of the glyph. This decides how many of them there are.
+struct DWrite_SubpixelPolicy
+{
+    // The number of phases per pixel: a power of 2 up to 256. 1 snaps glyphs to whole pixels, which is
+    // enough for monospace fonts with integer advances. 4 is a good default for proportional fonts.
+    u32 phases = 4;
+    // Glyphs larger than this (in 1/64 pixels, like DWrite_GlyphKey::size) are snapped to whole pixels,
+    // because the snapping error becomes relatively smaller, while each variant takes up more atlas space.
+    u32 maxSize = 64 * 64;
+};
+
+struct DWrite_QuantizedX
+{
+    // The whole pixel the glyph's origin is in.
+    i32 x = 0;
+    // The value for DWrite_GlyphKey::subpixel.
+    u32 subpixel = 0;
+};
+
+// Rounds the horizontal glyph origin x (in pixels) to the nearest phase of the policy. Since the phase
+// is stored in 1/256 pixels, policies with different phase counts share the variants they have in common.
+DWrite_QuantizedX DWrite_QuantizeGlyphX(const DWrite_SubpixelPolicy& policy, u32 size, f32 x) noexcept;
+
+// The offset in pixels to rasterize a variant at, e.g. the baselineOriginX of IDWriteFactory::CreateGlyphRunAnalysis.
+inline f32 DWrite_SubpixelOffset(u32 subpixel) noexcept
+{
+    return static_cast<f32>(subpixel) * (1.0f / 256.0f);
+}
+
+// Where a glyph is stored. Callers may cache these, as long as they check DWrite_GlyphAtlas::IsValid() before use.
+struct DWrite_AtlasGlyph
+{
+    DWrite_Rect rect;
+    u32 page = 0;
+    // The generation of the page when the glyph was inserted.
+    u32 generation = 0;
+};
+
+// A glyph that Compact() moved. The caller has to copy its pixels from `from` to `to`.
+struct DWrite_AtlasMove
+{
+    DWrite_GlyphKey key;
+    DWrite_AtlasGlyph from;
+    DWrite_AtlasGlyph to;
+};
+
+// What the glyphs that were recently used cost, to weigh the number of subpixel phases against atlas space.
+struct DWrite_GlyphAtlasWorkingSet
+{
+    // The glyphs (counting each subpixel variant separately) and the pixels they cover.
+    u32 variants = 0;
+    u64 variantArea = 0;
+    // The same, but with only one variant per glyph, i.e. what the working set would be without subpixel positioning.
+    u32 glyphs = 0;
+    u64 glyphArea = 0;
+};
+
+struct DWrite_GlyphAtlasStats
+{
+    // Find() calls that found the glyph.
+    u64 hits = 0;
+    // Find() calls that didn't.
+    u64 misses = 0;
+    // Insert() calls that allocated a new glyph.
+    u64 insertions = 0;
+    // Insert() calls that failed, because the atlas was full and no page could be evicted.
+    u64 failures = 0;
+    // The number of pages and glyphs that were evicted.
+    u64 evictedPages = 0;
+    u64 evictedGlyphs = 0;
+    // FindNearestVariant() calls that returned a different phase than the requested one.
+    u64 variantFallbacks = 0;
+    // The number of glyphs Compact() moved, the ones it dropped because they were idle and the pages it reset.
+    u64 compactedGlyphs = 0;
+    u64 droppedGlyphs = 0;
+    u64 compactedPages = 0;
+};
+
+class DWrite_GlyphAtlas
+{
+public:
+    // The size of each page in pixels and the number of pages.
+    DWrite_GlyphAtlas(u32 width, u32 height, u32 pageCount = 1);
+    ~DWrite_GlyphAtlas();
+
+    DWrite_GlyphAtlas(const DWrite_GlyphAtlas&) = delete;
+    DWrite_GlyphAtlas& operator=(const DWrite_GlyphAtlas&) = delete;
+
+    u32 Width() const noexcept;
+    u32 Height() const noexcept;
+    u32 PageCount() const noexcept;
+
+    // Starts a new frame. Pages with glyphs that were used during the current frame are never evicted,
+    // because they may still be referenced by draw calls that haven't been submitted yet.
+    void BeginFrame() noexcept;
+    u64 Frame() const noexcept;
+
+    // Returns the glyph, or nullptr if it hasn't been inserted yet or was evicted, and marks it as used.
+    // The pointer stays valid until the next call to any non-const member function.
+    const DWrite_AtlasGlyph* Find(const DWrite_GlyphKey& key) noexcept;
+    // Like Find(), but if the glyph doesn't exist with the requested subpixel phase, this returns the variant
+    // with the nearest phase of the given policy instead, which can be drawn while the exact one isn't rasterized
+    // yet. This lets a renderer rasterize variants lazily, e.g. a limited number per frame. Only phases that the
+    // policy would produce for key.size are considered, so glyphs above its maxSize never fall back to another phase.
+    const DWrite_AtlasGlyph* FindNearestVariant(const DWrite_GlyphKey& key, const DWrite_SubpixelPolicy& policy) noexcept;
+    // Allocates a width x height rectangle for the glyph with the skyline packer, marks it as used and returns it.
+    // The caller is expected to rasterize the glyph into it. If the glyph already exists, it's returned as is.
+    // Empty glyphs (like whitespace) don't take up any space and return an empty rectangle.
+    //
+    // If no page has enough room, the least recently used page is evicted, unless it was used during the current
+    // frame. In that case this returns nullptr and the caller should flush its draw calls, call BeginFrame() and retry.
+    // The pointer stays valid like the one returned by Find().
+    const DWrite_AtlasGlyph* Insert(const DWrite_GlyphKey& key, u32 width, u32 height);
+    // Removes all glyphs, for instance after the font changed. This invalidates all glyphs like an eviction.
+    void Clear() noexcept;
+
+    // Returns true if the glyph is still stored where it was when Find() or Insert() returned it.
+    bool IsValid(const DWrite_AtlasGlyph& glyph) const noexcept;
+    // The current generation of the page. It starts at 0 and is incremented whenever the page is evicted or cleared.
+    u32 PageGeneration(u32 page) const noexcept;
+    // The keys of the glyphs evicted since the last call to ClearEvictedGlyphs(), for callers that keep their
+    // own caches of DWrite_AtlasGlyph. Clear() doesn't add to this list.
+    const std::vector<DWrite_GlyphKey>& EvictedGlyphs() const noexcept;
+    void ClearEvictedGlyphs() noexcept;
+
+    // Moves glyphs off the most fragmented page for at most the given time. Glyphs count as live if they
+    // were used during the last maxIdleFrames frames, and a page qualifies once the packer has used up 3/4
+    // of it, while its live glyphs cover less than half of it. Live glyphs are moved to other pages, and all
+    // others are dropped and show up in EvictedGlyphs(). Once the page is empty and wasn't used during the
+    // current frame, it's reset like an eviction. This keeps the atlas close to the size of the working set.
+    //
+    // Returns the number of glyphs moved. The caller must copy the pixels of all new Moves() before drawing
+    // them and before uploading any glyph inserted after this call. Calling this once per frame with a budget
+    // of a fraction of a millisecond spreads the work of compacting a page over several frames.
+    u32 Compact(std::chrono::microseconds budget, u64 maxIdleFrames);
+    // The glyphs moved since the last call to ClearMoves(), in the order they were moved.
+    const std::vector<DWrite_AtlasMove>& Moves() const noexcept;
+    void ClearMoves() noexcept;
+    // Updates a cached glyph handle that is no longer valid (see IsValid()) to where Compact() moved it.
+    // Returns false if the glyph was evicted instead or was moved before the last call to ClearMoves().
+    bool Remap(DWrite_AtlasGlyph& glyph) const noexcept;
+
+    // The number of glyphs in the atlas.
+    u32 Size() const noexcept;
+    // The number of pixels covered by glyphs. Compared to Width() * Height() * PageCount() this tells how full the atlas is.
+    u64 UsedArea() const noexcept;
+    // The glyphs used during the last frameCount frames, including the current one.
+    DWrite_GlyphAtlasWorkingSet WorkingSet(u64 frameCount = 1) const;
+    DWrite_GlyphAtlasStats Stats() const noexcept;
+    void ResetStats() noexcept;
+
+private:
+    struct Page;
+
+    // An open-addressing hash map slot. Collisions are resolved with linear probing.
+    struct Slot
+    {
+        DWrite_GlyphKey key;
+        DWrite_AtlasGlyph glyph;
+        // The frame the glyph was last used in.
+        u64 lastUsed = 0;
+        // The upper half of the key's hash with the lowest bit set. 0 marks an empty slot.
+        u32 tag = 0;
+    };
+
+    static u32 makeTag(u64 hash) noexcept;
+    static u64 locationKey(const DWrite_AtlasGlyph& glyph) noexcept;
+    Slot* findSlot(const DWrite_GlyphKey& key, u64 hash) const noexcept;
+    void rehash(u32 capacity);
+    void eraseSlot(u32 index) noexcept;
+    void touch(Slot& slot) noexcept;
+    bool pack(u32 page, u32 width, u32 height, DWrite_Rect& rect) noexcept;
+    bool evictPage(u32 page);
+    void resetPage(u32 page) noexcept;
+    u64 skylineArea(u32 page) const noexcept;
+    bool selectCompactionSource(u64 maxIdleFrames);
+    bool relocate(Slot& slot);
+
+    static constexpr u32 none = ~0u;
+
+    std::unique_ptr<Page[]> _pages;
+    u32 _pageCount = 0;
+    // The page new glyphs go to first.
+    u32 _currentPage = 0;
+    // The capacity is a power of 2 and at least twice the number of glyphs, which keeps probe sequences short.
+    std::unique_ptr<Slot[]> _slots;
+    u32 _capacity = 0;
+    u32 _size = 0;
+    u64 _usedArea = 0;
+    u32 _width = 0;
+    u32 _height = 0;
+    // Starts at 1, so that a lastUsed of 0 means "never".
+    u64 _frame = 1;
+    std::vector<DWrite_GlyphKey> _evicted;
+    // The page Compact() is emptying, or none. Insert() doesn't put new glyphs on it.
+    u32 _compactSource = none;
+    // The next slot Compact() looks at. Reset whenever the slots move around.
+    u32 _compactCursor = 0;
+    std::vector<DWrite_AtlasMove> _moves;
+    // locationKey(move.from) -> index into _moves.
+    std::unordered_map<u64, u32> _moveIndex;
+    // Reused by selectCompactionSource().
+    std::vector<u64> _liveArea;
+    DWrite_GlyphAtlasStats _stats;
+};
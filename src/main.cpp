@@ -26,6 +26,7 @@
 #include <main_vs.h>
 #include <main_ps.h>
 
+#include "blend.h"
 #include "dwrite.h"
 #include "util.h"
 
@@ -35,13 +36,6 @@ static bool g_viewportSizeChanged = true;
 static UINT g_dpi = USER_DEFAULT_SCREEN_DPI;
 static bool g_dpiChanged = true;
 
-enum class BlendMode : u32
-{
-    DWriteGrayscale,
-    DWriteClearType,
-    Primitive,
-};
-
 struct alignas(16) ConstantBuffer
 {
     alignas(sizeof(u32x2)) u32x2 splitPos;
@@ -52,7 +46,10 @@ struct alignas(16) ConstantBuffer
     alignas(sizeof(f32x4)) float gammaRatios[4];
     alignas(sizeof(f32)) f32 cleartypeEnhancedContrast = 0;
     alignas(sizeof(f32)) f32 grayscaleEnhancedContrast = 0;
-    alignas(sizeof(u32)) BlendMode mode = BlendMode::DWriteGrayscale;
+    alignas(sizeof(u32)) DWrite_BlendMode mode = DWrite_BlendMode::Grayscale;
+    alignas(sizeof(f32)) f32 sdrWhiteLevel = 1;
+    alignas(sizeof(f32x4)) f32x4 cleartypeLevels[7];
+    alignas(sizeof(f32x4)) DWrite_BlendConstants blendConstants;
 };
 
 // Forward declare message handler from imgui_impl_win32.cpp
@@ -88,21 +85,10 @@ static f32x4 premultiplyColor(const f32x4& in) noexcept
     return { in.r * in.a, in.g * in.a, in.b * in.a, in.a };
 }
 
+// Single colors use the exact conversion. The polynomial span functions in color.h are only worth it for bulk data.
 static f32x4 sRGBToLinear(f32x4 in) noexcept
 {
-    for (int i = 0; i < 3; i++)
-    {
-        auto& c = in[i];
-        if (c <= 0.04045f)
-        {
-            c /= 12.92f;
-        }
-        else
-        {
-            c = std::pow((c + 0.055f) / 1.055f, 2.4f);
-        }
-    }
-    return in;
+    return { DWrite_SrgbToLinear(in.r), DWrite_SrgbToLinear(in.g), DWrite_SrgbToLinear(in.b), in.a };
 }
 
 const D2D1_COLOR_F& asD2DColor(const f32x4& color) noexcept
@@ -403,8 +389,12 @@ static void winMainImpl(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstan
     f32x4 foreground{ 1.0f, 1.0f, 1.0f, 1.0f };
     char textBuffer[1024]{};
     bool textChanged = true;
-    BlendMode mode = BlendMode::DWriteGrayscale;
+    DWrite_BlendMode mode = DWrite_BlendMode::Grayscale;
     bool srgb = false;
+    // scRGB blends in linear space like sRGB, but into a DXGI_FORMAT_R16G16B16A16_FLOAT swap chain.
+    bool scrgb = false;
+    // The brightness of SDR white in scRGB units (1.0 = 80 nits). Only used for scRGB.
+    f32 sdrWhiteLevel = 1.0f;
 
     // DirectWrite results
     wil::com_ptr<ID3D11RenderTargetView> renderTargetView;
@@ -513,23 +503,35 @@ static void winMainImpl(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstan
                 static constexpr const char* modes[] = {
                     "DWrite Grayscale",
                     "DWrite Grayscale (sRGB)",
+                    "DWrite Grayscale (scRGB)",
                     "DWrite ClearType",
                     "DWrite ClearType (sRGB)",
+                    "DWrite ClearType (scRGB)",
+                    "DWrite ClearType 7-level table",
+                    "DWrite ClearType 7-level table (sRGB)",
+                    "DWrite ClearType 7-level table (scRGB)",
                     "Primitive Copy",
                     "Primitive Copy (sRGB)",
+                    "Primitive Copy (scRGB)",
                 };
 
                 const auto count = IM_ARRAYSIZE(modes);
-                auto current = static_cast<int>(mode) * 2 + srgb;
+                auto current = static_cast<int>(mode) * 3 + (scrgb ? 2 : srgb ? 1 : 0);
                 current = std::min(current, count - 1);
 
                 if (ImGui::Combo("mode", &current, modes, count))
                 {
-                    mode = static_cast<BlendMode>(current / 2);
-                    srgb = (current % 2) != 0;
+                    mode = static_cast<DWrite_BlendMode>(current / 3);
+                    srgb = (current % 3) == 1;
+                    scrgb = (current % 3) == 2;
                     textChanged = true;
                     g_viewportSizeChanged = true; // force recreation of render targets
                 }
+
+                if (scrgb)
+                {
+                    constantBufferInvalidated |= ImGui::SliderFloat("SDR white", &sdrWhiteLevel, 1.0f, 6.0f);
+                }
             }
             ImGui::Spacing();
             ImGui::Separator();
@@ -582,10 +584,10 @@ static void winMainImpl(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstan
 
             wil::com_ptr<ID2D1RenderTarget> d2dTextureRenderTarget;
             wil::com_ptr<ID2D1RenderTarget> d3dTextureRenderTarget;
-            createD2DRenderTargetTexture(device.get(), d2dFactory.get(), srgb ? DXGI_FORMAT_B8G8R8A8_UNORM_SRGB : DXGI_FORMAT_B8G8R8A8_UNORM, tileSize.x, tileSize.y, g_dpi, d2dTextureRenderTarget.addressof(), d2dTextureView.put());
+            createD2DRenderTargetTexture(device.get(), d2dFactory.get(), srgb || scrgb ? DXGI_FORMAT_B8G8R8A8_UNORM_SRGB : DXGI_FORMAT_B8G8R8A8_UNORM, tileSize.x, tileSize.y, g_dpi, d2dTextureRenderTarget.addressof(), d2dTextureView.put());
             createD2DRenderTargetTexture(device.get(), d2dFactory.get(), DXGI_FORMAT_B8G8R8A8_UNORM, tileSize.x, tileSize.y, g_dpi, d3dTextureRenderTarget.addressof(), d3dTextureView.put());
 
-            if (mode == BlendMode::DWriteClearType)
+            if (mode == DWrite_BlendMode::ClearType || mode == DWrite_BlendMode::ClearTypeLevels)
             {
                 d2dTextureRenderTarget->SetTextAntialiasMode(D2D1_TEXT_ANTIALIAS_MODE_CLEARTYPE);
                 d3dTextureRenderTarget->SetTextAntialiasMode(D2D1_TEXT_ANTIALIAS_MODE_CLEARTYPE);
@@ -594,8 +596,8 @@ static void winMainImpl(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstan
             d3dTextureRenderTarget->SetTextRenderingParams(linearParams.get());
 
             {
-                const auto b = srgb ? sRGBToLinear(background) : background;
-                const auto f = srgb ? sRGBToLinear(foreground) : foreground;
+                const auto b = srgb || scrgb ? sRGBToLinear(background) : background;
+                const auto f = srgb || scrgb ? sRGBToLinear(foreground) : foreground;
                 wil::com_ptr<ID2D1SolidColorBrush> foregroundBrush;
                 THROW_IF_FAILED(d2dTextureRenderTarget->CreateSolidColorBrush(&asD2DColor(f), nullptr, foregroundBrush.addressof()));
 
@@ -628,13 +630,14 @@ static void winMainImpl(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstan
             renderTargetView.reset();
             deviceContext->ClearState();
             deviceContext->Flush();
-            swapChain->ResizeBuffers(0, g_viewportSize.x, g_viewportSize.y, DXGI_FORMAT_UNKNOWN, DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT);
+            // FP16 swap chains default to DXGI_COLOR_SPACE_RGB_FULL_G10_NONE_P709 (scRGB), so there's no need to call SetColorSpace1().
+            swapChain->ResizeBuffers(0, g_viewportSize.x, g_viewportSize.y, scrgb ? DXGI_FORMAT_R16G16B16A16_FLOAT : DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT);
 
             wil::com_ptr<ID3D11Texture2D> buffer;
             THROW_IF_FAILED(swapChain->GetBuffer(0, __uuidof(buffer), buffer.put_void()));
 
             const D3D11_RENDER_TARGET_VIEW_DESC desc{
-                .Format = srgb ? DXGI_FORMAT_B8G8R8A8_UNORM_SRGB : DXGI_FORMAT_B8G8R8A8_UNORM,
+                .Format = scrgb ? DXGI_FORMAT_R16G16B16A16_FLOAT : srgb ? DXGI_FORMAT_B8G8R8A8_UNORM_SRGB : DXGI_FORMAT_B8G8R8A8_UNORM,
                 .ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D,
             };
             THROW_IF_FAILED(device->CreateRenderTargetView(buffer.get(), &desc, renderTargetView.put()));
@@ -660,8 +663,9 @@ static void winMainImpl(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstan
             data.cleartypeEnhancedContrast = cleartypeEnhancedContrast;
             data.grayscaleEnhancedContrast = grayscaleEnhancedContrast;
             data.mode = mode;
+            data.sdrWhiteLevel = scrgb ? sdrWhiteLevel : 1.0f;
 
-            if (srgb)
+            if (srgb || scrgb)
             {
                 data.background = sRGBToLinear(data.background);
                 data.foreground = sRGBToLinear(data.foreground);
@@ -672,6 +676,17 @@ static void winMainImpl(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstan
                 DWrite_GetGammaRatiosForEncodedTarget(gamma, data.gammaRatios);
             }
 
+            {
+                DWrite_BlendParams params{
+                    .cleartypeEnhancedContrast = data.cleartypeEnhancedContrast,
+                    .grayscaleEnhancedContrast = data.grayscaleEnhancedContrast,
+                    .foregroundColor = data.foreground,
+                };
+                std::copy_n(&data.gammaRatios[0], 4, &params.gammaRatios[0]);
+                DWrite_GetCleartypeLevelColors(params, data.background, data.cleartypeLevels);
+                data.blendConstants = mode == DWrite_BlendMode::Grayscale ? DWrite_GetGrayscaleBlendConstants(params) : DWrite_GetCleartypeBlendConstants(params);
+            }
+
             deviceContext->UpdateSubresource(constantBuffer.get(), 0, nullptr, &data, 0, 0);
             constantBufferInvalidated = false;
         }
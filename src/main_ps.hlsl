@@ -13,12 +13,16 @@ cbuffer ConstBuffer : register(b0)
     float cleartypeEnhancedContrast;
     float grayscaleEnhancedContrast;
     uint mode;
+    float sdrWhiteLevel; // 1 unless the target is scRGB
+    float4 cleartypeLevels[7];
+    DWrite_BlendConstants blendConstants;
 };
 
 // d2dTexture stores text/glyphs as drawn by Direct2D natively.
 // d3dTexture stores the glyphs as a regular alpha texture which we
 // still need to blend. Technically d3dTexture could be stored as A8
-// instead of B8G8R8A8, but this doesn't matter much for this demo.
+// (or packed ClearType, see DWrite_UnpackCleartypeCoverage) instead
+// of B8G8R8A8, but this doesn't matter much for this demo.
 Texture2D<float4> d2dTexture : register(t0);
 Texture2D<float4> d3dTexture : register(t1);
 
@@ -47,6 +51,7 @@ float4 main(float4 pos: SV_Position): SV_Target
     // The texture drawn with D2D will be shown as it is.
     // It's already blended with the background and is for comparison only.
     float4 d2dColor = d2dTexture[tilePos];
+    d2dColor.rgb *= sdrWhiteLevel;
 
     // This applies the internal DirectWrite alpha blending algorithm.
     float4 d3dColor;
@@ -54,18 +59,23 @@ float4 main(float4 pos: SV_Position): SV_Target
     {
         case 0:
             // DWrite Grayscale AA
-            d3dColor = DWrite_GrayscaleBlend(gammaRatios, grayscaleEnhancedContrast, false, foreground, d3dTexture[tilePos].a);
-            d3dColor = alphaBlendPremultiplied(background, d3dColor);
+            d3dColor = DWrite_GrayscaleBlendScRgb(blendConstants, sdrWhiteLevel, float4(background.rgb * sdrWhiteLevel, background.a), d3dTexture[tilePos].a);
             break;
         case 1:
             // DWrite ClearType AA
-            d3dColor = DWrite_CleartypeBlend(gammaRatios, cleartypeEnhancedContrast, false, background, foreground, d3dTexture[tilePos]);
+            d3dColor = DWrite_CleartypeBlendScRgb(blendConstants, sdrWhiteLevel, float4(background.rgb * sdrWhiteLevel, background.a), d3dTexture[tilePos]);
             break;
         case 2:
+            // DWrite ClearType AA via the 7-level table (quantizes the glyph coverage)
+            d3dColor = DWrite_CleartypeBlendLevels(cleartypeLevels, d3dTexture[tilePos]);
+            d3dColor.rgb *= sdrWhiteLevel;
+            break;
+        case 3:
         default:
             // Primitive 1:1 copy (potentially with sRGB)
             d3dColor = foreground * d3dTexture[tilePos];
             d3dColor = alphaBlendPremultiplied(background, d3dColor);
+            d3dColor.rgb *= sdrWhiteLevel;
             break;
     }
 
@@ -0,0 +1,339 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "palette.h"
+
+#include <cstring>
+
+#if DWRITE_BLEND_X86
+#include <immintrin.h>
+#endif
+
+void DWrite_BuildPaletteBlendTable(const DWrite_BlendParams& params, DWrite_BlendMode mode, u32 foreground, u32 background, DWrite_PaletteBlendTable& out) noexcept
+{
+    auto p = params;
+    p.foregroundColor = DWrite_UnpackColor(foreground);
+
+    switch (mode)
+    {
+    case DWrite_BlendMode::Grayscale:
+    {
+        // Blending every coverage value onto the background with the Scalar span function
+        // guarantees that the table produces the exact same results.
+        u8 coverage[256];
+        for (u32 i = 0; i < 256; ++i)
+        {
+            coverage[i] = static_cast<u8>(i);
+            out.colors[i] = background;
+        }
+        DWrite_GrayscaleBlendSpan_Scalar(p, &coverage[0], &out.colors[0], 256);
+        break;
+    }
+    case DWrite_BlendMode::ClearType:
+    {
+        u32 coverage[256];
+        for (u32 i = 0; i < 256; ++i)
+        {
+            coverage[i] = i * 0x010101;
+            out.colors[i] = background;
+        }
+        DWrite_CleartypeBlendSpan_Scalar(p, &coverage[0], &out.colors[0], 256);
+        break;
+    }
+    case DWrite_BlendMode::ClearTypeLevels:
+    {
+        DWrite_CleartypeLevelTable levels;
+        DWrite_BuildCleartypeLevelTable(p, background, levels);
+        for (u32 i = 0; i < 256; ++i)
+        {
+            out.colors[i] = levels.levels[DWrite_CleartypeCoverageLevel(i)];
+        }
+        break;
+    }
+    default:
+        memset(&out.colors[0], 0, sizeof(out.colors));
+        break;
+    }
+}
+
+void DWrite_GrayscaleBlendSpanPalette_Scalar(const DWrite_PaletteBlendTable& table, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        dst[i] = table.colors[glyphAlpha[i]];
+    }
+}
+
+void DWrite_CleartypeBlendSpanPalette_Scalar(const DWrite_PaletteBlendTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto glyph = glyphColor[i];
+        const auto b = table.colors[glyph & 0xff] & 0x0000ff;
+        const auto g = table.colors[(glyph >> 8) & 0xff] & 0x00ff00;
+        const auto r = table.colors[(glyph >> 16) & 0xff] & 0xff0000;
+        dst[i] = 0xff000000 | r | g | b;
+    }
+}
+
+#if DWRITE_BLEND_X86
+
+DWRITE_TARGET_AVX2 void DWrite_GrayscaleBlendSpanPalette_AVX2(const DWrite_PaletteBlendTable& table, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    const auto colors = reinterpret_cast<const int*>(&table.colors[0]);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(glyphAlpha + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_i32gather_epi32(colors, index, 4));
+    }
+
+    DWrite_GrayscaleBlendSpanPalette_Scalar(table, glyphAlpha + i, dst + i, count - i);
+}
+
+DWRITE_TARGET_AVX2 void DWrite_CleartypeBlendSpanPalette_AVX2(const DWrite_PaletteBlendTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    const auto colors = reinterpret_cast<const int*>(&table.colors[0]);
+    const auto mask = _mm256_set1_epi32(0xff);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto glyph = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(glyphColor + i));
+        const auto b = _mm256_i32gather_epi32(colors, _mm256_and_si256(glyph, mask), 4);
+        const auto g = _mm256_i32gather_epi32(colors, _mm256_and_si256(_mm256_srli_epi32(glyph, 8), mask), 4);
+        const auto r = _mm256_i32gather_epi32(colors, _mm256_and_si256(_mm256_srli_epi32(glyph, 16), mask), 4);
+        // Take B from the first gather, G from the second and R from the third. Alpha is always opaque.
+        const auto bg = _mm256_blendv_epi8(g, b, _mm256_set1_epi32(0x0000ff));
+        const auto rgb = _mm256_blendv_epi8(r, bg, _mm256_set1_epi32(0x00ffff));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(rgb, _mm256_set1_epi32(0xff000000)));
+    }
+
+    DWrite_CleartypeBlendSpanPalette_Scalar(table, glyphColor + i, dst + i, count - i);
+}
+
+#endif
+
+// Indexed by DWrite_BlendIsa.
+static constexpr DWrite_PaletteKernels s_kernels[]{
+    {
+        .grayscaleBlendSpanPalette = DWrite_GrayscaleBlendSpanPalette_Scalar,
+        .cleartypeBlendSpanPalette = DWrite_CleartypeBlendSpanPalette_Scalar,
+    },
+#if DWRITE_BLEND_X86
+    {
+        .grayscaleBlendSpanPalette = DWrite_GrayscaleBlendSpanPalette_Scalar,
+        .cleartypeBlendSpanPalette = DWrite_CleartypeBlendSpanPalette_Scalar,
+    },
+    {
+        .grayscaleBlendSpanPalette = DWrite_GrayscaleBlendSpanPalette_AVX2,
+        .cleartypeBlendSpanPalette = DWrite_CleartypeBlendSpanPalette_AVX2,
+    },
+    {
+        .grayscaleBlendSpanPalette = DWrite_GrayscaleBlendSpanPalette_AVX2,
+        .cleartypeBlendSpanPalette = DWrite_CleartypeBlendSpanPalette_AVX2,
+    },
+#endif
+};
+
+// The tier is the one picked for the span functions in blend.h, which is always supported.
+static const DWrite_PaletteKernels& activeKernels() noexcept
+{
+    return s_kernels[static_cast<u32>(DWrite_GetBlendIsa())];
+}
+
+const DWrite_PaletteKernels& DWrite_GetPaletteKernels(DWrite_BlendIsa isa) noexcept
+{
+    const auto supported = DWrite_GetSupportedBlendIsa();
+    return s_kernels[static_cast<u32>(isa < supported ? isa : supported)];
+}
+
+void DWrite_GrayscaleBlendSpanPalette(const DWrite_PaletteBlendTable& table, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    activeKernels().grayscaleBlendSpanPalette(table, glyphAlpha, dst, count);
+}
+
+void DWrite_CleartypeBlendSpanPalette(const DWrite_PaletteBlendTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    activeKernels().cleartypeBlendSpanPalette(table, glyphColor, dst, count);
+}
+
+DWrite_PaletteBlendCache::DWrite_PaletteBlendCache(u32 capacity) :
+    _capacity{ capacity ? capacity : 1 }
+{
+    // Get() hands out pointers into _entries, so it must never reallocate.
+    _entries.reserve(_capacity);
+    // This also keeps the noexcept functions from allocating.
+    _free.reserve(_capacity);
+    _map.reserve(_capacity);
+}
+
+void DWrite_PaletteBlendCache::SetParams(const DWrite_BlendParams& params) noexcept
+{
+    if (memcmp(&_params.gammaRatios[0], &params.gammaRatios[0], sizeof(_params.gammaRatios)) == 0 &&
+        _params.cleartypeEnhancedContrast == params.cleartypeEnhancedContrast &&
+        _params.grayscaleEnhancedContrast == params.grayscaleEnhancedContrast &&
+        _params.isThinFont == params.isThinFont)
+    {
+        return;
+    }
+
+    memcpy(&_params.gammaRatios[0], &params.gammaRatios[0], sizeof(_params.gammaRatios));
+    _params.cleartypeEnhancedContrast = params.cleartypeEnhancedContrast;
+    _params.grayscaleEnhancedContrast = params.grayscaleEnhancedContrast;
+    _params.isThinFont = params.isThinFont;
+    Clear();
+}
+
+void DWrite_PaletteBlendCache::SetPalette(const u32* colors, size_t count) noexcept
+{
+    count = count < 256 ? count : 256;
+
+    // Bit i of `changed` is set if palette entry i changed.
+    u64 changed[4]{};
+    bool any = false;
+    for (size_t i = 0; i < 256; ++i)
+    {
+        const auto color = i < count ? colors[i] : 0;
+        if (_palette[i] != color)
+        {
+            _palette[i] = color;
+            changed[i / 64] |= u64{ 1 } << (i % 64);
+            any = true;
+        }
+    }
+
+    if (!any)
+    {
+        return;
+    }
+
+    for (auto index = _head; index != none;)
+    {
+        const auto next = _entries[index].next;
+        const auto key = _entries[index].key;
+        const auto fg = key & 0xff;
+        const auto bg = (key >> 8) & 0xff;
+        if ((changed[fg / 64] >> (fg % 64)) & 1 || (changed[bg / 64] >> (bg % 64)) & 1)
+        {
+            drop(index);
+            _stats.invalidations++;
+        }
+        index = next;
+    }
+}
+
+void DWrite_PaletteBlendCache::Clear() noexcept
+{
+    _stats.invalidations += _map.size();
+
+    _free.clear();
+    for (u32 i = 0; i < static_cast<u32>(_entries.size()); ++i)
+    {
+        _free.push_back(i);
+    }
+    _map.clear();
+    _head = none;
+    _tail = none;
+}
+
+const DWrite_PaletteBlendTable* DWrite_PaletteBlendCache::Get(u8 fg, u8 bg, DWrite_BlendMode mode)
+{
+    if (mode == DWrite_BlendMode::Primitive)
+    {
+        return nullptr;
+    }
+
+    const auto key = makeKey(fg, bg, mode);
+
+    if (const auto it = _map.find(key); it != _map.end())
+    {
+        _stats.hits++;
+        if (it->second != _head)
+        {
+            unlink(it->second);
+            pushFront(it->second);
+        }
+        return &_entries[it->second].table;
+    }
+
+    _stats.misses++;
+
+    u32 index;
+    if (!_free.empty())
+    {
+        index = _free.back();
+        _free.pop_back();
+    }
+    else if (_entries.size() < _capacity)
+    {
+        index = static_cast<u32>(_entries.size());
+        _entries.emplace_back();
+    }
+    else
+    {
+        index = _tail;
+        drop(index);
+        _free.pop_back();
+        _stats.evictions++;
+    }
+
+    auto& entry = _entries[index];
+    DWrite_BuildPaletteBlendTable(_params, mode, _palette[fg], _palette[bg], entry.table);
+    entry.key = key;
+    _map.emplace(key, index);
+    pushFront(index);
+    return &entry.table;
+}
+
+u32 DWrite_PaletteBlendCache::Capacity() const noexcept
+{
+    return _capacity;
+}
+
+u32 DWrite_PaletteBlendCache::Size() const noexcept
+{
+    return static_cast<u32>(_map.size());
+}
+
+DWrite_PaletteBlendCacheStats DWrite_PaletteBlendCache::Stats() const noexcept
+{
+    return _stats;
+}
+
+void DWrite_PaletteBlendCache::ResetStats() noexcept
+{
+    _stats = {};
+}
+
+u32 DWrite_PaletteBlendCache::makeKey(u8 fg, u8 bg, DWrite_BlendMode mode) noexcept
+{
+    return static_cast<u32>(fg) | static_cast<u32>(bg) << 8 | static_cast<u32>(mode) << 16;
+}
+
+void DWrite_PaletteBlendCache::unlink(u32 index) noexcept
+{
+    auto& entry = _entries[index];
+    (entry.prev != none ? _entries[entry.prev].next : _head) = entry.next;
+    (entry.next != none ? _entries[entry.next].prev : _tail) = entry.prev;
+    entry.prev = none;
+    entry.next = none;
+}
+
+void DWrite_PaletteBlendCache::pushFront(u32 index) noexcept
+{
+    auto& entry = _entries[index];
+    entry.prev = none;
+    entry.next = _head;
+    (_head != none ? _entries[_head].prev : _tail) = index;
+    _head = index;
+}
+
+// Removes the entry from the map and the LRU list and marks it as free.
+void DWrite_PaletteBlendCache::drop(u32 index) noexcept
+{
+    _map.erase(_entries[index].key);
+    unlink(index);
+    _free.push_back(index);
+}
@@ -0,0 +1,128 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "blend.h"
+
+// Terminals draw nearly all of their text with colors from a small palette (16 or 256 entries) on top of a
+// background that's also a palette color. For a given foreground/background pair and blend mode the result
+// only depends on the 8-bit glyph coverage, which allows us to precompute all 256 possible outputs once and
+// turn the blend into a single table lookup per pixel (or one per subpixel channel for ClearType).
+
+// The blended B8G8R8A8 color for each coverage value.
+// For Grayscale, colors[i] is the result for a coverage of i.
+// For ClearType, each color channel of colors[i] is the result for a coverage of i in that channel.
+struct DWrite_PaletteBlendTable
+{
+    alignas(64) u32 colors[256];
+};
+
+// Builds the table for the given foreground and background pixel. params.foregroundColor is ignored.
+// mode must be one of the coverage-based modes (Grayscale, ClearType or ClearTypeLevels). For the ClearType modes
+// the background must be opaque. The results are identical to blending with the Scalar span functions on a
+// destination filled with the background color (DWrite_GrayscaleBlendSpan, DWrite_CleartypeBlendSpan and
+// DWrite_CleartypeBlendSpanLevels respectively).
+void DWrite_BuildPaletteBlendTable(const DWrite_BlendParams& params, DWrite_BlendMode mode, u32 foreground, u32 background, DWrite_PaletteBlendTable& out) noexcept;
+
+// Blends a row of glyph coverage with a prebuilt table and writes the result to dst. Like with
+// DWrite_CleartypeBlendSpanLevels, dst is never read. Both forward to the implementation picked by
+// DWrite_SetBlendIsa(), all of which produce identical results.
+void DWrite_GrayscaleBlendSpanPalette(const DWrite_PaletteBlendTable& table, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanPalette(const DWrite_PaletteBlendTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept;
+
+void DWrite_GrayscaleBlendSpanPalette_Scalar(const DWrite_PaletteBlendTable& table, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanPalette_Scalar(const DWrite_PaletteBlendTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept;
+#if DWRITE_BLEND_X86
+void DWrite_GrayscaleBlendSpanPalette_AVX2(const DWrite_PaletteBlendTable& table, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+void DWrite_CleartypeBlendSpanPalette_AVX2(const DWrite_PaletteBlendTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept;
+#endif
+
+// The function-pointer table used by the dispatching functions above. It follows the tier picked with
+// DWrite_SetBlendIsa(). There are only Scalar and AVX2 implementations, which the other tiers reuse.
+struct DWrite_PaletteKernels
+{
+    void (*grayscaleBlendSpanPalette)(const DWrite_PaletteBlendTable& table, const u8* glyphAlpha, u32* dst, size_t count) noexcept;
+    void (*cleartypeBlendSpanPalette)(const DWrite_PaletteBlendTable& table, const u32* glyphColor, u32* dst, size_t count) noexcept;
+};
+
+// Returns the kernels for the given tier. The tier is clamped like in DWrite_SetBlendIsa().
+const DWrite_PaletteKernels& DWrite_GetPaletteKernels(DWrite_BlendIsa isa) noexcept;
+
+struct DWrite_PaletteBlendCacheStats
+{
+    // Get() calls that found an existing table.
+    u64 hits = 0;
+    // Get() calls that had to build a table.
+    u64 misses = 0;
+    // Tables that were dropped to make room for a new one.
+    u64 evictions = 0;
+    // Tables that were dropped by SetParams(), SetPalette() or Clear().
+    u64 invalidations = 0;
+};
+
+// A cache of DWrite_PaletteBlendTable, keyed by (foreground index, background index, blend mode).
+// Tables are built lazily on first use and the least recently used one is evicted once the cache is full.
+//
+// The cache isn't thread-safe. Use one per thread (or per render target) instead.
+class DWrite_PaletteBlendCache
+{
+public:
+    // Each table is 1KiB. 256 of them are enough for the handful of color pairs a typical screen uses.
+    explicit DWrite_PaletteBlendCache(u32 capacity = 256);
+
+    // Sets the gamma ratios, contrast values and thin font flag the tables are built with.
+    // params.foregroundColor is ignored. If any of the values changed, all tables are dropped.
+    // Call this whenever DWrite_GetRenderParams() or the font changes.
+    void SetParams(const DWrite_BlendParams& params) noexcept;
+    // Replaces the palette with count B8G8R8A8 colors (premultiplied, at most 256). Entries past count are set to 0.
+    // Only the tables that use a color that actually changed are dropped.
+    void SetPalette(const u32* colors, size_t count) noexcept;
+    // Drops all tables.
+    void Clear() noexcept;
+
+    // Returns the table for blending the palette color fg onto the palette color bg, building it if needed.
+    // Returns nullptr for DWrite_BlendMode::Primitive, which isn't coverage-based.
+    // The pointer stays valid until the next call to any non-const member function.
+    const DWrite_PaletteBlendTable* Get(u8 fg, u8 bg, DWrite_BlendMode mode);
+
+    u32 Capacity() const noexcept;
+    // The number of tables currently cached.
+    u32 Size() const noexcept;
+    DWrite_PaletteBlendCacheStats Stats() const noexcept;
+    void ResetStats() noexcept;
+
+private:
+    static constexpr u32 none = ~0u;
+
+    struct Entry
+    {
+        DWrite_PaletteBlendTable table;
+        u32 key = 0;
+        // The neighbors in the LRU list.
+        u32 prev = none;
+        u32 next = none;
+    };
+
+    static u32 makeKey(u8 fg, u8 bg, DWrite_BlendMode mode) noexcept;
+    void unlink(u32 index) noexcept;
+    void pushFront(u32 index) noexcept;
+    void drop(u32 index) noexcept;
+
+    std::vector<Entry> _entries;
+    // Indices into _entries that aren't in use.
+    std::vector<u32> _free;
+    // makeKey() -> index into _entries.
+    std::unordered_map<u32, u32> _map;
+    // The most and least recently used entry.
+    u32 _head = none;
+    u32 _tail = none;
+    u32 _capacity = 0;
+
+    DWrite_BlendParams _params;
+    u32 _palette[256]{};
+    DWrite_PaletteBlendCacheStats _stats;
+};
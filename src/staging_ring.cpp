@@ -0,0 +1,247 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "staging_ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+static size_t alignUp(size_t value, size_t alignment) noexcept
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+DWrite_CpuStagingBackend::DWrite_CpuStagingBackend(std::vector<Page> pages) :
+    _pages{ std::move(pages) }
+{
+}
+
+u64 DWrite_CpuStagingBackend::Submit(const DWrite_StagingBatch& batch)
+{
+    for (size_t i = 0; i < batch.copyCount; ++i)
+    {
+        const auto& c = batch.copies[i];
+        if (c.page >= _pages.size())
+        {
+            continue;
+        }
+
+        const auto& page = _pages[c.page];
+        const auto rowBytes = static_cast<size_t>(c.rect.right - c.rect.left) * c.bytesPerPixel;
+        const u8* src = batch.memory + c.offset;
+        u8* dst = page.pixels + c.rect.top * page.stride + c.rect.left * c.bytesPerPixel;
+
+        for (auto y = c.rect.top; y < c.rect.bottom; ++y)
+        {
+            memcpy(dst, src, rowBytes);
+            src += c.rowPitch;
+            dst += page.stride;
+        }
+    }
+
+    _copies += batch.copyCount;
+    return ++_fence;
+}
+
+u64 DWrite_CpuStagingBackend::CompletedFence()
+{
+    return _fence;
+}
+
+void DWrite_CpuStagingBackend::WaitForFence(u64)
+{
+}
+
+u64 DWrite_CpuStagingBackend::SubmittedBatches() const noexcept
+{
+    return _fence;
+}
+
+u64 DWrite_CpuStagingBackend::SubmittedCopies() const noexcept
+{
+    return _copies;
+}
+
+DWrite_StagingRing::DWrite_StagingRing(DWrite_StagingBackend& backend, void* memory, size_t capacity, u32 rowPitchAlignment, u32 placementAlignment) :
+    _backend{ backend },
+    _memory{ static_cast<u8*>(memory) },
+    _capacity{ capacity },
+    _rowPitchAlignment{ rowPitchAlignment ? rowPitchAlignment : 1 },
+    _placementAlignment{ placementAlignment ? placementAlignment : 1 }
+{
+}
+
+u8* DWrite_StagingRing::Allocate(u32 page, const DWrite_Rect& rect, u32 bytesPerPixel, u32& rowPitch)
+{
+    rowPitch = 0;
+
+    const auto width = rect.right > rect.left ? rect.right - rect.left : 0;
+    const auto height = rect.bottom > rect.top ? rect.bottom - rect.top : 0;
+    if (!width || !height || !bytesPerPixel)
+    {
+        return nullptr;
+    }
+
+    const auto rowBytes = static_cast<size_t>(width) * bytesPerPixel;
+    const auto pitch = alignUp(rowBytes, _rowPitchAlignment);
+    // The last row doesn't need the padding, which matches how D3D12 computes the size of a placed footprint.
+    const auto size = pitch * (height - 1) + rowBytes;
+    if (size > _capacity || pitch > UINT32_MAX)
+    {
+        _stats.failures++;
+        return nullptr;
+    }
+
+    size_t offset = 0;
+    if (!tryAllocate(size, offset))
+    {
+        Reclaim();
+
+        if (!tryAllocate(size, offset))
+        {
+            // The pending copies hold on to memory that can only be reused once the GPU is done with them.
+            // Backends like DWrite_CpuStagingBackend complete the batch during Submit(), so it may be reusable right away.
+            Flush();
+            Reclaim();
+
+            while (!tryAllocate(size, offset))
+            {
+                // If nothing is in flight, the ring is empty and tryAllocate() can't fail, since size <= _capacity.
+                const auto& oldest = _inFlight.front();
+                if (oldest.fence > _backend.CompletedFence())
+                {
+                    _stats.stalls++;
+                    _backend.WaitForFence(oldest.fence);
+                }
+                _used -= oldest.bytes;
+                _inFlight.pop_front();
+            }
+        }
+    }
+
+    _pending.push_back({
+        .offset = offset,
+        .rowPitch = static_cast<u32>(pitch),
+        .bytesPerPixel = bytesPerPixel,
+        .page = page,
+        .rect = { rect.left, rect.top, rect.left + width, rect.top + height },
+    });
+    rowPitch = static_cast<u32>(pitch);
+    return _memory + offset;
+}
+
+void DWrite_StagingRing::Flush()
+{
+    if (_pending.empty())
+    {
+        return;
+    }
+
+    // Backends usually have to bind or transition each destination page, so the copies are grouped by page.
+    _sorted = _pending;
+    std::stable_sort(_sorted.begin(), _sorted.end(), [](const DWrite_StagingCopy& a, const DWrite_StagingCopy& b) {
+        return a.page < b.page;
+    });
+
+    _dirtyRects.clear();
+    for (const auto& c : _sorted)
+    {
+        if (_dirtyRects.empty() || _dirtyRects.back().page != c.page)
+        {
+            _dirtyRects.push_back({ .page = c.page, .rect = c.rect });
+            continue;
+        }
+
+        auto& r = _dirtyRects.back().rect;
+        r.left = std::min(r.left, c.rect.left);
+        r.top = std::min(r.top, c.rect.top);
+        r.right = std::max(r.right, c.rect.right);
+        r.bottom = std::max(r.bottom, c.rect.bottom);
+    }
+
+    const DWrite_StagingBatch batch{
+        .memory = _memory,
+        .copies = _sorted.data(),
+        .copyCount = _sorted.size(),
+        .dirtyRects = _dirtyRects.data(),
+        .dirtyRectCount = _dirtyRects.size(),
+    };
+    const auto fence = _backend.Submit(batch);
+
+    _inFlight.push_back({ .fence = fence, .bytes = _pendingBytes });
+    _pending.clear();
+    _pendingBytes = 0;
+    _stats.flushes++;
+}
+
+void DWrite_StagingRing::Reclaim()
+{
+    if (_inFlight.empty())
+    {
+        return;
+    }
+
+    const auto completed = _backend.CompletedFence();
+    while (!_inFlight.empty() && _inFlight.front().fence <= completed)
+    {
+        _used -= _inFlight.front().bytes;
+        _inFlight.pop_front();
+    }
+}
+
+size_t DWrite_StagingRing::Capacity() const noexcept
+{
+    return _capacity;
+}
+
+size_t DWrite_StagingRing::UsedBytes() const noexcept
+{
+    return _used;
+}
+
+size_t DWrite_StagingRing::PendingCopies() const noexcept
+{
+    return _pending.size();
+}
+
+DWrite_StagingRingStats DWrite_StagingRing::Stats() const noexcept
+{
+    return _stats;
+}
+
+void DWrite_StagingRing::ResetStats() noexcept
+{
+    _stats = {};
+}
+
+// Allocations are made in the order they're freed in, so the used memory is always a single contiguous
+// (possibly wrapping) range that ends at _head. If an allocation doesn't fit between _head and the end of
+// the ring, the rest of the ring is skipped and counted as part of the allocation, so that it's freed with it.
+bool DWrite_StagingRing::tryAllocate(size_t size, size_t& offset) noexcept
+{
+    if (!_used)
+    {
+        _head = 0;
+    }
+
+    auto start = alignUp(_head, _placementAlignment);
+    if (start > _capacity || _capacity - start < size)
+    {
+        start = 0;
+    }
+
+    const auto padding = start >= _head ? start - _head : _capacity - _head;
+    const auto bytes = padding + size;
+    if (bytes > _capacity - _used)
+    {
+        return false;
+    }
+
+    offset = start;
+    _head = start + size;
+    _used += bytes;
+    _pendingBytes += bytes;
+    _stats.allocations++;
+    _stats.allocatedBytes += bytes;
+    return true;
+}
@@ -0,0 +1,174 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "compositor.h"
+
+// Uploading each glyph with its own texture update (e.g. a CreateAlphaTexture() result passed to
+// UpdateSubresource()) is slow, because every call allocates and synchronizes on its own. Direct2D instead
+// writes glyphs into a pool of upload heaps and sends them to the GPU in batches, and so does DWrite_StagingRing.
+//
+// Glyphs are written linearly into a fixed-size ring of CPU-visible memory (e.g. a persistently mapped
+// D3D12 upload heap). Flush() hands everything written since the last flush to a DWrite_StagingBackend as a
+// single list of copies, which the backend records on the GPU and signals with a fence. Once the fence has
+// completed, the memory is reused for new glyphs. The ring doesn't know about Direct3D itself.
+
+// Copies a rectangle of pixels from the staging memory into an atlas page.
+struct DWrite_StagingCopy
+{
+    // The byte offset of the first row in the staging memory.
+    size_t offset = 0;
+    // The distance between rows in the staging memory in bytes.
+    u32 rowPitch = 0;
+    u32 bytesPerPixel = 0;
+    u32 page = 0;
+    // Where the pixels go in the page. The size of the rectangle is the size of the copied area.
+    DWrite_Rect rect;
+};
+
+// The bounding rectangle of all copies into a page.
+struct DWrite_StagingDirtyRect
+{
+    u32 page = 0;
+    DWrite_Rect rect;
+};
+
+// Everything written into the ring since the last flush.
+struct DWrite_StagingBatch
+{
+    // The staging memory. DWrite_StagingCopy::offset is relative to this.
+    const u8* memory = nullptr;
+    // Sorted by page and, within each page, in the order the glyphs were written.
+    const DWrite_StagingCopy* copies = nullptr;
+    size_t copyCount = 0;
+    // One per page that is written to, sorted by page.
+    const DWrite_StagingDirtyRect* dirtyRects = nullptr;
+    size_t dirtyRectCount = 0;
+};
+
+// The GPU side of the ring. Fence values must increase monotonically, starting above 0.
+class DWrite_StagingBackend
+{
+public:
+    virtual ~DWrite_StagingBackend() = default;
+
+    // Records all copies of the batch (e.g. one CopyTextureRegion() each) and returns the fence value
+    // that will be signaled once the GPU is done reading the staging memory.
+    virtual u64 Submit(const DWrite_StagingBatch& batch) = 0;
+    // The last fence value the GPU has signaled.
+    virtual u64 CompletedFence() = 0;
+    // Blocks until the fence value was signaled.
+    virtual void WaitForFence(u64 fence) = 0;
+};
+
+// A backend that copies the batches into atlas pages in CPU memory, for DWrite_BlendGlyphs or for
+// testing the ring without a GPU. The copies are done during Submit(), so every fence completes immediately.
+class DWrite_CpuStagingBackend final : public DWrite_StagingBackend
+{
+public:
+    // A page is a pointer to its pixels and the distance between rows in bytes, like DWrite_AtlasPage.
+    struct Page
+    {
+        u8* pixels = nullptr;
+        size_t stride = 0;
+    };
+
+    explicit DWrite_CpuStagingBackend(std::vector<Page> pages);
+
+    u64 Submit(const DWrite_StagingBatch& batch) override;
+    u64 CompletedFence() override;
+    void WaitForFence(u64 fence) override;
+
+    // The number of batches and copies submitted so far.
+    u64 SubmittedBatches() const noexcept;
+    u64 SubmittedCopies() const noexcept;
+
+private:
+    std::vector<Page> _pages;
+    u64 _fence = 0;
+    u64 _copies = 0;
+};
+
+struct DWrite_StagingRingStats
+{
+    // Allocate() calls that succeeded and the bytes they used, including alignment padding.
+    u64 allocations = 0;
+    u64 allocatedBytes = 0;
+    // Allocate() calls that failed, because the glyph is larger than the ring.
+    u64 failures = 0;
+    // Flush() calls that submitted a batch, whether they were explicit or caused by a full ring.
+    u64 flushes = 0;
+    // The number of times Allocate() had to block on WaitForFence() for memory to become available.
+    u64 stalls = 0;
+};
+
+class DWrite_StagingRing
+{
+public:
+    // memory is the CPU-visible staging buffer of capacity bytes, which the ring doesn't own.
+    // Each glyph's rows start at a multiple of rowPitchAlignment and its first row at a multiple of
+    // placementAlignment bytes. Both must be powers of 2. For D3D12 copies from buffers into
+    // textures these are D3D12_TEXTURE_DATA_PITCH_ALIGNMENT (256) and D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT (512).
+    DWrite_StagingRing(DWrite_StagingBackend& backend, void* memory, size_t capacity, u32 rowPitchAlignment = 1, u32 placementAlignment = 1);
+
+    DWrite_StagingRing(const DWrite_StagingRing&) = delete;
+    DWrite_StagingRing& operator=(const DWrite_StagingRing&) = delete;
+
+    // Reserves room for a width x height glyph that will be copied to rect.left/top of the page, and returns
+    // where the caller should write its pixels, with rowPitch receiving the distance between rows in bytes.
+    // The memory must be fully written before the next call to Allocate() or Flush().
+    //
+    // If the ring is full, this first reuses the memory of batches the GPU is done with, then flushes the
+    // pending copies and finally waits for the oldest fence. It only returns nullptr if the glyph
+    // doesn't fit into the ring at all. Empty glyphs aren't recorded and return nullptr as well.
+    u8* Allocate(u32 page, const DWrite_Rect& rect, u32 bytesPerPixel, u32& rowPitch);
+    // Submits all copies since the last flush to the backend, usually once per frame before drawing.
+    // Does nothing if there are none.
+    void Flush();
+    // Reuses the memory of all batches whose fence has completed. Allocate() calls this as needed,
+    // but calling it once per frame keeps Allocate() from having to query the backend.
+    void Reclaim();
+
+    size_t Capacity() const noexcept;
+    // The number of bytes used by pending copies and batches the GPU hasn't finished yet.
+    size_t UsedBytes() const noexcept;
+    // The number of copies since the last flush.
+    size_t PendingCopies() const noexcept;
+    DWrite_StagingRingStats Stats() const noexcept;
+    void ResetStats() noexcept;
+
+private:
+    // A flushed batch whose memory is still in use by the GPU.
+    struct InFlight
+    {
+        u64 fence = 0;
+        size_t bytes = 0;
+    };
+
+    bool tryAllocate(size_t size, size_t& offset) noexcept;
+
+    DWrite_StagingBackend& _backend;
+    u8* _memory = nullptr;
+    size_t _capacity = 0;
+    u32 _rowPitchAlignment = 1;
+    u32 _placementAlignment = 1;
+
+    // The next allocation starts here, unless it has to wrap around to 0.
+    size_t _head = 0;
+    // The bytes used by _pending and _inFlight. The free space is the _capacity - _used bytes after _head.
+    size_t _used = 0;
+    // The bytes used by _pending, including the padding in front of each allocation.
+    size_t _pendingBytes = 0;
+    std::vector<DWrite_StagingCopy> _pending;
+    std::deque<InFlight> _inFlight;
+
+    // Reused by Flush().
+    std::vector<DWrite_StagingCopy> _sorted;
+    std::vector<DWrite_StagingDirtyRect> _dirtyRects;
+
+    DWrite_StagingRingStats _stats;
+};
@@ -0,0 +1,224 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "thread_pool.h"
+
+#include <algorithm>
+
+static constexpr u64 packRange(u64 begin, u64 end) noexcept
+{
+    return begin | (end << 32);
+}
+
+static constexpr u64 rangeBegin(u64 range) noexcept
+{
+    return range & 0xffffffff;
+}
+
+static constexpr u64 rangeEnd(u64 range) noexcept
+{
+    return range >> 32;
+}
+
+DWrite_ThreadPool::DWrite_ThreadPool(u32 threadCount)
+{
+    if (!threadCount)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    _threadCount = threadCount;
+    _slots = std::make_unique<Slot[]>(threadCount);
+    _threads.reserve(threadCount - 1);
+
+    // Slot 0 belongs to the thread calling ParallelFor().
+    for (u32 i = 1; i < threadCount; ++i)
+    {
+        _threads.emplace_back(&DWrite_ThreadPool::workerMain, this, i);
+    }
+}
+
+DWrite_ThreadPool::~DWrite_ThreadPool()
+{
+    _shutdown = true;
+    _generation.fetch_add(1, std::memory_order_release);
+    _generation.notify_all();
+
+    for (auto& t : _threads)
+    {
+        t.join();
+    }
+}
+
+u32 DWrite_ThreadPool::ThreadCount() const noexcept
+{
+    return _threadCount;
+}
+
+void DWrite_ThreadPool::ParallelFor(size_t count, void (*func)(void* context, size_t index) noexcept, void* context) noexcept
+{
+    if (!count)
+    {
+        return;
+    }
+
+    while (_busy.exchange(true, std::memory_order_acquire))
+    {
+        _busy.wait(true, std::memory_order_relaxed);
+    }
+
+    _func = func;
+    _context = context;
+
+    // The ranges are packed into 32 bits each, so very large jobs are split up into multiple rounds.
+    // That's >4 billion items per round, so in practice there's always just one.
+    static constexpr size_t maxRound = 0xffffffff;
+    const size_t n = _threadCount;
+
+    for (size_t base = 0; base < count; base += maxRound)
+    {
+        const auto roundCount = std::min(count - base, maxRound);
+
+        // Evenly split the range up front, so that stealing is only needed to balance uneven work.
+        for (size_t i = 0; i < n; ++i)
+        {
+            const auto begin = base + roundCount * i / n;
+            const auto end = base + roundCount * (i + 1) / n;
+            _slots[i].range.store(packRange(begin - base, end - base), std::memory_order_relaxed);
+        }
+
+        _roundBase = base;
+        _finished.store(0, std::memory_order_relaxed);
+        _generation.fetch_add(1, std::memory_order_release);
+        _generation.notify_all();
+
+        participate(0);
+
+        // Wait for the workers. Apart from finishing their own items, this also
+        // ensures that none of them still holds on to _func or the slots.
+        for (;;)
+        {
+            const auto finished = _finished.load(std::memory_order_acquire);
+            if (finished == _threadCount - 1)
+            {
+                break;
+            }
+            _finished.wait(finished, std::memory_order_acquire);
+        }
+    }
+
+    _busy.store(false, std::memory_order_release);
+    _busy.notify_one();
+}
+
+void DWrite_ThreadPool::workerMain(u32 index) noexcept
+{
+    u32 generation = 0;
+
+    for (;;)
+    {
+        // ParallelFor() waits for all workers before starting the next round,
+        // so each worker observes every generation exactly once.
+        _generation.wait(generation, std::memory_order_acquire);
+        generation = _generation.load(std::memory_order_acquire);
+
+        if (_shutdown)
+        {
+            return;
+        }
+
+        participate(index);
+
+        if (_finished.fetch_add(1, std::memory_order_acq_rel) + 1 == _threadCount - 1)
+        {
+            _finished.notify_one();
+        }
+    }
+}
+
+void DWrite_ThreadPool::participate(u32 index) noexcept
+{
+    const auto func = _func;
+    const auto context = _context;
+    const auto base = _roundBase;
+    size_t item;
+
+    do
+    {
+        while (popOwn(index, item))
+        {
+            func(context, base + item);
+        }
+    } while (steal(index));
+}
+
+// Takes the next item from the front of our own range.
+bool DWrite_ThreadPool::popOwn(u32 index, size_t& item) noexcept
+{
+    auto& range = _slots[index].range;
+    auto r = range.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+        const auto begin = rangeBegin(r);
+        const auto end = rangeEnd(r);
+        if (begin >= end)
+        {
+            return false;
+        }
+        // This CAS fails if a thief just took the back half of our range (or spuriously).
+        if (range.compare_exchange_weak(r, packRange(begin + 1, end), std::memory_order_relaxed))
+        {
+            item = static_cast<size_t>(begin);
+            return true;
+        }
+    }
+}
+
+// Moves the back half of the largest remaining range into our own (empty) slot.
+// Returns false if there's nothing left to steal.
+bool DWrite_ThreadPool::steal(u32 index) noexcept
+{
+    for (;;)
+    {
+        u32 victim = 0;
+        u64 victimRange = 0;
+        u64 victimRemaining = 0;
+
+        for (u32 i = 0; i < _threadCount; ++i)
+        {
+            if (i == index)
+            {
+                continue;
+            }
+
+            const auto r = _slots[i].range.load(std::memory_order_relaxed);
+            const auto begin = rangeBegin(r);
+            const auto end = rangeEnd(r);
+            const auto remaining = begin < end ? end - begin : 0;
+            if (remaining > victimRemaining)
+            {
+                victim = i;
+                victimRange = r;
+                victimRemaining = remaining;
+            }
+        }
+
+        if (!victimRemaining)
+        {
+            return false;
+        }
+
+        // With a single remaining item, mid == begin and we take it entirely.
+        const auto begin = rangeBegin(victimRange);
+        const auto end = rangeEnd(victimRange);
+        const auto mid = begin + victimRemaining / 2;
+
+        if (_slots[victim].range.compare_exchange_strong(victimRange, packRange(begin, mid), std::memory_order_relaxed))
+        {
+            // Our slot is empty, so no one else is going to touch it until we store the stolen range.
+            _slots[index].range.store(packRange(mid, end), std::memory_order_relaxed);
+            return true;
+        }
+    }
+}
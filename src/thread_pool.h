@@ -0,0 +1,81 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "util.h"
+
+// A fork-join thread pool for data-parallel loops, like compositing the tiles of a framebuffer.
+//
+// ParallelFor() splits the index range evenly between all threads (including the calling one).
+// Each thread then works through its own range front to back, and once it runs out of work it steals
+// the back half of the largest remaining range of another thread. This keeps all cores busy even if some
+// items (e.g. tiles full of text) take much longer than others (e.g. empty tiles), without any locks and
+// with only one atomic operation per item in the common case.
+class DWrite_ThreadPool
+{
+public:
+    // threadCount includes the calling thread. 0 picks std::thread::hardware_concurrency().
+    explicit DWrite_ThreadPool(u32 threadCount = 0);
+    ~DWrite_ThreadPool();
+
+    DWrite_ThreadPool(const DWrite_ThreadPool&) = delete;
+    DWrite_ThreadPool& operator=(const DWrite_ThreadPool&) = delete;
+
+    // The number of threads that ParallelFor() uses, including the calling thread.
+    u32 ThreadCount() const noexcept;
+
+    // Calls func(context, index) for each index in [0, count) and returns once all calls have finished.
+    // The calls happen in no particular order and on any thread. func must not call ParallelFor() on the same pool.
+    // Concurrent calls to ParallelFor() from different threads are serialized.
+    void ParallelFor(size_t count, void (*func)(void* context, size_t index) noexcept, void* context) noexcept;
+
+    template<typename Func>
+    void ParallelFor(size_t count, Func&& func) noexcept
+    {
+        using F = std::remove_reference_t<Func>;
+        ParallelFor(
+            count,
+            [](void* context, size_t index) noexcept {
+                (*static_cast<F*>(context))(index);
+            },
+            const_cast<void*>(static_cast<const void*>(&func)));
+    }
+
+private:
+    // A [begin, end) range packed into a single u64, so that it can be updated with a single CAS.
+    // Each one is on its own cache line, because the owning thread updates it for every item.
+    struct alignas(64) Slot
+    {
+        std::atomic<u64> range{ 0 };
+    };
+
+    void workerMain(u32 index) noexcept;
+    void participate(u32 index) noexcept;
+    bool popOwn(u32 index, size_t& item) noexcept;
+    bool steal(u32 index) noexcept;
+
+    std::unique_ptr<Slot[]> _slots;
+    std::vector<std::thread> _threads;
+    u32 _threadCount = 1;
+
+    // The current job. Written by ParallelFor() before bumping _generation.
+    void (*_func)(void* context, size_t index) noexcept = nullptr;
+    void* _context = nullptr;
+    // The index of the first item of the current round. See ParallelFor().
+    size_t _roundBase = 0;
+
+    // Incremented for every job and on shutdown. The workers wait on it.
+    std::atomic<u32> _generation{ 0 };
+    // The number of workers that finished the current job. ParallelFor() waits on it.
+    std::atomic<u32> _finished{ 0 };
+    // Serializes concurrent ParallelFor() calls.
+    std::atomic<bool> _busy{ false };
+    bool _shutdown = false;
+};
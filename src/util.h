@@ -22,6 +22,36 @@ struct vec2
     }
 };
 
+template<typename T>
+struct vec3
+{
+    union
+    {
+        T x{};
+        T r;
+    };
+    union
+    {
+        T y{};
+        T g;
+    };
+    union
+    {
+        T z{};
+        T b;
+    };
+
+    operator T*() noexcept
+    {
+        return &x;
+    }
+
+    operator T*() const noexcept
+    {
+        return &x;
+    }
+};
+
 template<typename T>
 struct vec4
 {
@@ -57,10 +87,35 @@ struct vec4
     }
 };
 
+// An IEEE 754 binary16 value, as stored in DXGI_FORMAT_R16G16B16A16_FLOAT textures or buffers.
+// This is only a storage type. See DWrite_F32ToF16() and DWrite_F16ToF32() in color.h for conversions.
+struct f16
+{
+    uint16_t bits;
+};
+
+using u8 = uint8_t;
+using u8x4 = vec4<u8>;
+using u16 = uint16_t;
+
+using i16 = int16_t;
+using i32 = int32_t;
+
 using u32 = uint32_t;
 using u32x2 = vec2<u32>;
 using u32x4 = vec4<u32>;
 
+using u64 = uint64_t;
+
 using f32 = float;
 using f32x2 = vec2<f32>;
+using f32x3 = vec3<f32>;
 using f32x4 = vec4<f32>;
+
+using f64 = double;
+
+using f16x4 = vec4<f16>;
+
+// The compact color types must stay as small as the DXGI formats they mirror.
+static_assert(sizeof(u8x4) == 4);
+static_assert(sizeof(f16x4) == 8);
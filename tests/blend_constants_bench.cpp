@@ -0,0 +1,120 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Compares the per-pixel DWrite_GrayscaleBlend()/DWrite_CleartypeBlend() overloads, which derive everything from the
+// foreground color for every pixel, against the DWrite_BlendConstants overloads that the Scalar span functions use.
+// Both variants are plain scalar loops over the same rows, so the difference is only the precomputed constants.
+// It also prints the largest difference between the two outputs in 8-bit steps.
+//
+// Usage: blend_constants_bench [pixels per row] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "blend.h"
+#include "dwrite.h"
+
+// The per-pixel loops as the span functions looked before DWrite_BlendConstants existed.
+static void grayscaleBlendPerPixel(const DWrite_BlendParams& params, const u8* glyphAlpha, u32* dst, size_t count) noexcept
+{
+    const f32x4 gammaRatios{ params.gammaRatios[0], params.gammaRatios[1], params.gammaRatios[2], params.gammaRatios[3] };
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto alpha = static_cast<f32>(glyphAlpha[i]) * (1.0f / 255.0f);
+        const auto top = DWrite_GrayscaleBlend(gammaRatios, params.grayscaleEnhancedContrast, params.isThinFont, params.foregroundColor, alpha);
+        dst[i] = DWrite_PackColor(DWrite_AlphaBlendPremultiplied(DWrite_UnpackColor(dst[i]), top));
+    }
+}
+
+static void cleartypeBlendPerPixel(const DWrite_BlendParams& params, const u32* glyphColor, u32* dst, size_t count) noexcept
+{
+    const f32x4 gammaRatios{ params.gammaRatios[0], params.gammaRatios[1], params.gammaRatios[2], params.gammaRatios[3] };
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto glyph = DWrite_UnpackColor(glyphColor[i]);
+        const auto background = DWrite_UnpackColor(dst[i]);
+        dst[i] = DWrite_PackColor(DWrite_CleartypeBlend(gammaRatios, params.cleartypeEnhancedContrast, params.isThinFont, background, params.foregroundColor, glyph));
+    }
+}
+
+// The largest difference of any channel between the two rows.
+static u32 maxDifference(const std::vector<u32>& a, const std::vector<u32>& b) noexcept
+{
+    u32 result = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        for (u32 shift = 0; shift < 32; shift += 8)
+        {
+            const auto x = (a[i] >> shift) & 0xff;
+            const auto y = (b[i] >> shift) & 0xff;
+            result = std::max(result, x > y ? x - y : y - x);
+        }
+    }
+    return result;
+}
+
+// Blends a fresh copy of the background with fn() per repetition and returns the fastest time per pixel in nanoseconds.
+template<typename T>
+static double measure(const std::vector<u32>& background, std::vector<u32>& dst, int repetitions, const T& fn)
+{
+    auto best = 1e300;
+
+    for (int i = 0; i < repetitions; ++i)
+    {
+        dst = background;
+        const auto start = std::chrono::steady_clock::now();
+        fn(dst.data(), dst.size());
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count());
+    }
+
+    return best / static_cast<double>(background.size());
+}
+
+int main(int argc, char** argv)
+{
+    const size_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1 << 16;
+    const int repetitions = argc > 2 ? std::max(1, atoi(argv[2])) : 50;
+
+    std::mt19937 rng{ 1 };
+    std::vector<u8> glyphAlpha(count);
+    std::vector<u32> glyphColor(count);
+    // ClearType needs an opaque background. Grayscale doesn't, but it's the common case.
+    std::vector<u32> background(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        glyphAlpha[i] = static_cast<u8>(rng());
+        glyphColor[i] = rng();
+        background[i] = rng() | 0xff000000;
+    }
+
+    DWrite_BlendParams params;
+    DWrite_GetGammaRatiosForEncodedTarget(1.8f, params.gammaRatios);
+    // A translucent color (0.9, 0.8, 0.3) with an alpha of 0.75, premultiplied.
+    params.foregroundColor = { 0.675f, 0.6f, 0.225f, 0.75f };
+
+    std::vector<u32> perPixel;
+    std::vector<u32> constants;
+
+    printf("%zu pixels, best of %d\n", count, repetitions);
+    printf("mode       per-pixel ns/px  constants ns/px  speedup  max diff\n");
+
+    {
+        const auto a = measure(background, perPixel, repetitions, [&](u32* dst, size_t n) { grayscaleBlendPerPixel(params, glyphAlpha.data(), dst, n); });
+        const auto b = measure(background, constants, repetitions, [&](u32* dst, size_t n) { DWrite_GrayscaleBlendSpan_Scalar(params, glyphAlpha.data(), dst, n); });
+        printf("grayscale  %15.2f  %15.2f  %6.2fx  %8u\n", a, b, a / b, maxDifference(perPixel, constants));
+    }
+    {
+        const auto a = measure(background, perPixel, repetitions, [&](u32* dst, size_t n) { cleartypeBlendPerPixel(params, glyphColor.data(), dst, n); });
+        const auto b = measure(background, constants, repetitions, [&](u32* dst, size_t n) { DWrite_CleartypeBlendSpan_Scalar(params, glyphColor.data(), dst, n); });
+        printf("cleartype  %15.2f  %15.2f  %6.2fx  %8u\n", a, b, a / b, maxDifference(perPixel, constants));
+    }
+
+    return 0;
+}
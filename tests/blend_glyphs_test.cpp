@@ -0,0 +1,124 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Checks that DWrite_BlendGlyphs draws overlapping glyphs in submission order, even when they come from different
+// atlas pages. The reference draws one glyph per DWrite_BlendGlyphs() call, which can't reorder anything.
+// It uses the same tile size, so that every glyph row is split into the same spans.
+//
+// Usage: blend_glyphs_test [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "compositor.h"
+
+static constexpr u32 targetWidth = 301;
+static constexpr u32 targetHeight = 203;
+static constexpr u32 pageSize = 64;
+
+int main(int argc, char** argv)
+{
+    const auto seed = argc > 1 ? static_cast<u32>(atoi(argv[1])) : 1u;
+    std::mt19937 rng{ seed };
+    const auto next = [&]() { return static_cast<u32>(rng()); };
+
+    // Pages 0 and 1 are A8 for grayscale glyphs, 2 and 3 are B8G8R8A8 and 4 holds packed ClearType coverage.
+    std::vector<u8> a8[2];
+    std::vector<u32> bgra[2];
+    std::vector<u16> packed;
+    DWrite_AtlasPage pages[5];
+    for (u32 i = 0; i < 2; ++i)
+    {
+        a8[i].resize(pageSize * pageSize);
+        bgra[i].resize(pageSize * pageSize);
+        for (auto& v : a8[i])
+        {
+            v = static_cast<u8>(next());
+        }
+        for (auto& v : bgra[i])
+        {
+            v = next();
+        }
+        pages[i] = { .pixels = a8[i].data(), .stride = pageSize };
+        pages[2 + i] = { .pixels = bgra[i].data(), .stride = pageSize * 4 };
+    }
+    packed.resize(pageSize * pageSize);
+    for (auto& v : packed)
+    {
+        v = DWrite_PackCleartypeCoverage(next());
+    }
+    pages[4] = { .pixels = packed.data(), .stride = pageSize * 2, .cleartypePacked = true };
+
+    DWrite_BlendParams params;
+    DWrite_GetGammaRatiosForEncodedTarget(1.8f, params.gammaRatios);
+
+    const auto randomColor = [&]() {
+        const auto a = static_cast<f32>(next() % 256) / 255.0f;
+        return f32x4{ a * static_cast<f32>(next() % 256) / 255.0f, a * static_cast<f32>(next() % 256) / 255.0f, a * static_cast<f32>(next() % 256) / 255.0f, a };
+    };
+
+    // The glyphs cover the target several times over, so that most of them overlap, and some stick out of it.
+    std::vector<DWrite_GlyphInstance> glyphs(600);
+    for (auto& g : glyphs)
+    {
+        const auto w = 1 + next() % 40;
+        const auto h = 1 + next() % 40;
+        const auto x = next() % (targetWidth + 20);
+        const auto y = next() % (targetHeight + 20);
+        g.dest = { x, y, x + w, y + h };
+        g.atlasPos = { next() % (pageSize - w + 1), next() % (pageSize - h + 1) };
+        g.mode = static_cast<DWrite_BlendMode>(next() % 4);
+        g.foreground = randomColor();
+
+        switch (g.mode)
+        {
+        case DWrite_BlendMode::Grayscale:
+            g.atlasPage = next() % 2;
+            break;
+        case DWrite_BlendMode::Primitive:
+            g.atlasPage = 2 + next() % 2;
+            break;
+        default:
+            g.atlasPage = 2 + next() % 3;
+            g.background = next() % 2 ? next() | 0xff000000 : 0;
+            break;
+        }
+    }
+
+    std::vector<u32> background(targetWidth * targetHeight);
+    for (auto& v : background)
+    {
+        v = next() | 0xff000000;
+    }
+
+    DWrite_ThreadPool pool{ 4 };
+    int failures = 0;
+
+    for (const auto tileSize : { DWrite_DefaultTileSize, u32x2{ 16, 16 }, u32x2{ 1024, 1024 } })
+    {
+        auto expected = background;
+        auto actual = background;
+        const DWrite_Bitmap<u32> expectedTarget{ expected.data(), targetWidth, targetHeight, targetWidth };
+        const DWrite_Bitmap<u32> actualTarget{ actual.data(), targetWidth, targetHeight, targetWidth };
+
+        for (const auto& g : glyphs)
+        {
+            DWrite_BlendGlyphs(pool, params, &pages[0], &g, 1, expectedTarget, tileSize);
+        }
+        DWrite_BlendGlyphs(pool, params, &pages[0], glyphs.data(), glyphs.size(), actualTarget, tileSize);
+
+        size_t mismatches = 0;
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            mismatches += expected[i] != actual[i];
+        }
+
+        printf("tile %ux%u: %zu of %zu pixels differ\n", tileSize.x, tileSize.y, mismatches, expected.size());
+        failures += mismatches != 0;
+    }
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
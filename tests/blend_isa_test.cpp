@@ -0,0 +1,185 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Checks that every instruction set tier the CPU supports produces the same results as the Scalar one within
+// 1 LSB per channel, for the grayscale and ClearType span functions. Each tier is selected with DWrite_SetBlendIsa(),
+// like the DWRITE_BLEND_ISA environment variable does, and compared against DWrite_GetBlendKernels(Scalar).
+// Every span length from 0 to 1000 pixels is tested at varying alignments, to cover the tail handling,
+// and the pixels around each span must stay untouched.
+//
+// Usage: blend_isa_test
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <random>
+#include <vector>
+
+#include "blend.h"
+#include "check.h"
+#include "dwrite.h"
+
+static constexpr size_t maxCount = 1000;
+// The number of pixels in front of and behind each span, which must not be written.
+static constexpr size_t guard = 32;
+static constexpr u32 canary = 0xdeadbeef;
+
+static const char* isaName(DWrite_BlendIsa isa) noexcept
+{
+    switch (isa)
+    {
+    case DWrite_BlendIsa::SSE41:
+        return "SSE41";
+    case DWrite_BlendIsa::AVX2:
+        return "AVX2";
+    case DWrite_BlendIsa::AVX512:
+        return "AVX512";
+    default:
+        return "Scalar";
+    }
+}
+
+// The largest difference of any channel between the two pixels.
+static u32 maxDifference(u32 a, u32 b) noexcept
+{
+    u32 result = 0;
+    for (u32 shift = 0; shift < 32; shift += 8)
+    {
+        const auto x = (a >> shift) & 0xff;
+        const auto y = (b >> shift) & 0xff;
+        const auto d = x > y ? x - y : y - x;
+        result = d > result ? d : result;
+    }
+    return result;
+}
+
+// Compares dst[guard + offset, guard + offset + count) against expected, which holds
+// the Scalar results for the same range. Everything outside the range must still be the canary.
+// Returns the largest difference, or UINT32_MAX if a canary was overwritten.
+static u32 compare(std::vector<u32>& dst, const std::vector<u32>& expected, size_t offset, size_t count) noexcept
+{
+    u32 result = 0;
+    for (size_t i = 0; i < dst.size(); ++i)
+    {
+        if (i < guard + offset || i >= guard + offset + count)
+        {
+            if (dst[i] != canary)
+            {
+                return UINT32_MAX;
+            }
+        }
+        else
+        {
+            const auto d = maxDifference(dst[i], expected[i]);
+            result = d > result ? d : result;
+        }
+    }
+    return result;
+}
+
+int main()
+{
+    std::mt19937 rng{ 1 };
+    const auto next = [&]() { return static_cast<u32>(rng()); };
+
+    // The spans start at up to 15 pixels into these, so that every alignment relative to a 64-byte register is covered.
+    std::vector<u8> glyphAlpha(maxCount + 16);
+    std::vector<u32> glyphColor(maxCount + 16);
+    std::vector<u32> opaque(maxCount + 16);
+    std::vector<u32> translucent(maxCount + 16);
+    for (size_t i = 0; i < glyphAlpha.size(); ++i)
+    {
+        glyphAlpha[i] = static_cast<u8>(next());
+        glyphColor[i] = next() & 0xffffff;
+        opaque[i] = next() | 0xff000000;
+        // Premultiplied, so that no channel exceeds alpha.
+        const auto a = next() & 0xff;
+        translucent[i] = a << 24 | (next() % (a + 1)) << 16 | (next() % (a + 1)) << 8 | next() % (a + 1);
+    }
+
+    // Make sure that the spans contain fully uncovered and fully covered pixels.
+    for (size_t i = 0; i < glyphAlpha.size(); i += 5)
+    {
+        glyphAlpha[i] = i % 2 ? 255 : 0;
+        glyphColor[i] = i % 2 ? 0xffffff : 0;
+    }
+
+    std::vector<DWrite_BlendParams> paramSets(3);
+    DWrite_GetGammaRatiosForEncodedTarget(1.8f, paramSets[0].gammaRatios);
+    paramSets[0].foregroundColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+    DWrite_GetGammaRatiosForEncodedTarget(2.2f, paramSets[1].gammaRatios);
+    paramSets[1].foregroundColor = { 0.675f, 0.6f, 0.225f, 0.75f };
+    paramSets[1].isThinFont = true;
+    DWrite_GetGammaRatiosForLinearTarget(1.0f, paramSets[2].gammaRatios);
+    paramSets[2].foregroundColor = { 0.9f, 0.95f, 1.0f, 1.0f };
+    paramSets[2].grayscaleEnhancedContrast = 0.0f;
+    paramSets[2].cleartypeEnhancedContrast = 1.0f;
+
+    const auto& scalar = DWrite_GetBlendKernels(DWrite_BlendIsa::Scalar);
+    std::vector<u32> dst(guard + 15 + maxCount + guard);
+    std::vector<u32> expected(dst.size());
+
+    for (const auto isa : { DWrite_BlendIsa::SSE41, DWrite_BlendIsa::AVX2, DWrite_BlendIsa::AVX512 })
+    {
+        if (DWrite_SetBlendIsa(isa) != isa)
+        {
+            printf("%s: not supported, skipped\n", isaName(isa));
+            continue;
+        }
+
+        u32 worst[2]{};
+
+        for (const auto& params : paramSets)
+        {
+            for (size_t count = 0; count <= maxCount; ++count)
+            {
+                const auto offset = count % 16;
+
+                const auto run = [&](u32 mode, const std::vector<u32>& background) {
+                    std::fill(dst.begin(), dst.end(), canary);
+                    std::copy_n(background.begin() + offset, count, dst.begin() + guard + offset);
+                    expected = dst;
+
+                    const auto d = &dst[guard + offset];
+                    const auto e = &expected[guard + offset];
+                    if (mode == 0)
+                    {
+                        scalar.grayscaleBlendSpan(params, &glyphAlpha[offset], e, count);
+                        DWrite_GrayscaleBlendSpan(params, &glyphAlpha[offset], d, count);
+                    }
+                    else
+                    {
+                        scalar.cleartypeBlendSpan(params, &glyphColor[offset], e, count);
+                        DWrite_CleartypeBlendSpan(params, &glyphColor[offset], d, count);
+                    }
+
+                    const auto diff = compare(dst, expected, offset, count);
+                    if (!CHECK(diff <= 1))
+                    {
+                        printf("  %s %s: count=%zu offset=%zu %s\n",
+                               isaName(isa),
+                               mode == 0 ? "grayscale" : "cleartype",
+                               count,
+                               offset,
+                               diff == UINT32_MAX ? "wrote outside the span" : "differs by more than 1 LSB");
+                    }
+                    if (diff != UINT32_MAX && diff > worst[mode])
+                    {
+                        worst[mode] = diff;
+                    }
+                };
+
+                run(0, opaque);
+                run(0, translucent);
+                // ClearType is only defined for opaque backgrounds.
+                run(1, opaque);
+            }
+        }
+
+        printf("%s: max difference grayscale=%u cleartype=%u\n", isaName(isa), worst[0], worst[1]);
+    }
+
+    DWrite_SetBlendIsa(DWrite_GetSupportedBlendIsa());
+    return CheckResult();
+}
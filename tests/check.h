@@ -0,0 +1,35 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <cstdio>
+
+// A minimal assertion helper for the test programs. Failed checks are reported and counted instead of
+// aborting, so that a single run shows all of them. main() should return CheckResult().
+
+inline int g_checkFailures = 0;
+
+inline bool CheckImpl(bool ok, const char* expr, const char* file, int line) noexcept
+{
+    if (!ok)
+    {
+        printf("%s(%d): check failed: %s\n", file, line, expr);
+        g_checkFailures++;
+    }
+    return ok;
+}
+
+#define CHECK(expr) CheckImpl(static_cast<bool>(expr), #expr, __FILE__, __LINE__)
+
+// Prints the summary and returns the process exit code.
+inline int CheckResult() noexcept
+{
+    if (g_checkFailures)
+    {
+        printf("FAILED (%d checks)\n", g_checkFailures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
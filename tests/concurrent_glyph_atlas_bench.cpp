@@ -0,0 +1,94 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Measures how glyph lookups scale with the number of threads: DWrite_ConcurrentGlyphAtlas::Find() against
+// DWrite_GlyphAtlas::Find() behind a std::mutex, which is what sharing a single-threaded atlas would look like.
+// Both atlases hold the same glyphs and the total number of lookups is the same for every thread count.
+//
+// Usage: concurrent_glyph_atlas_bench [total lookups]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "concurrent_glyph_atlas.h"
+
+static constexpr u32 glyphCount = 2000;
+
+static DWrite_GlyphKey glyphKey(u32 glyphIndex) noexcept
+{
+    return { .fontFace = 1, .glyphIndex = glyphIndex, .size = 12 * 64 };
+}
+
+// Runs fn(thread) on threadCount threads and returns the average time per lookup in nanoseconds.
+template<typename T>
+static double measure(u32 threadCount, u64 lookups, const T& fn)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (u32 i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back(fn, i);
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(lookups);
+}
+
+int main(int argc, char** argv)
+{
+    const u64 totalLookups = argc > 1 ? strtoull(argv[1], nullptr, 10) : 4000000;
+
+    printf("%u glyphs, %llu lookups per run, %u hardware threads\n", glyphCount, static_cast<unsigned long long>(totalLookups), std::thread::hardware_concurrency());
+    printf("threads  concurrent ns/op  mutex ns/op\n");
+
+    for (const u32 threadCount : { 1u, 2u, 4u, 8u, 16u, 32u })
+    {
+        DWrite_ConcurrentGlyphAtlas concurrent{ 2048, 2048, 2, threadCount };
+        DWrite_GlyphAtlas locked{ 2048, 2048, 2 };
+        std::mutex mutex;
+
+        for (u32 i = 0; i < glyphCount; ++i)
+        {
+            DWrite_AtlasGlyph glyph;
+            concurrent.Insert(0, glyphKey(i), 10, 14, glyph);
+            locked.Insert(glyphKey(i), 10, 14);
+        }
+        concurrent.Publish();
+
+        const auto perThread = totalLookups / threadCount;
+        const auto lookups = perThread * threadCount;
+
+        // A cheap LCG per thread, so that the threads don't look up the same glyphs in lockstep.
+        const auto concurrentNs = measure(threadCount, lookups, [&](u32 thread) {
+            DWrite_AtlasGlyph glyph;
+            u32 x = thread * 7919;
+            for (u64 i = 0; i < perThread; ++i)
+            {
+                x = x * 1664525 + 1013904223;
+                concurrent.Find(thread, glyphKey(x % glyphCount), glyph);
+            }
+        });
+        const auto mutexNs = measure(threadCount, lookups, [&](u32 thread) {
+            u32 x = thread * 7919;
+            for (u64 i = 0; i < perThread; ++i)
+            {
+                x = x * 1664525 + 1013904223;
+                const std::lock_guard lock{ mutex };
+                locked.Find(glyphKey(x % glyphCount));
+            }
+        });
+
+        printf("%7u  %16.1f  %11.1f\n", threadCount, concurrentNs, mutexNs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,254 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Hammers a DWrite_ConcurrentGlyphAtlas from several threads and checks that no two live glyphs overlap.
+//
+// Every frame, each thread looks up glyphs from a window of glyph indices that slides forward over time and
+// inserts the ones it doesn't find. Instead of rasterizing, the thread that inserts a glyph fills its rectangle
+// in a mirror of the atlas pages with a tag derived from the glyph index. Then one thread calls Publish() while
+// the others keep calling Find(), and finally all threads check that every glyph they find has the expected size
+// and that its rectangle still holds its tag. The pages are small, so that Publish() has to evict pages.
+// The glyphs a thread inserted during a frame must also be found while Publish() moves them into the hash map,
+// and an empty glyph inserted up front must survive all evictions.
+//
+// Usage: concurrent_glyph_atlas_stress [threads] [frames]
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "concurrent_glyph_atlas.h"
+
+static constexpr u32 pageWidth = 512;
+static constexpr u32 pageHeight = 512;
+static constexpr u32 pageCount = 3;
+// Set in the mirror for pixels written during the current frame, to catch two insertions into the same place.
+static constexpr u32 freshFlag = 0x80000000;
+// The glyph index of the empty glyph. It's far away from the ones the threads look up.
+static constexpr u32 emptyGlyphIndex = 0xffffffff;
+
+static DWrite_GlyphKey glyphKey(u32 glyphIndex) noexcept
+{
+    return { .fontFace = 1, .glyphIndex = glyphIndex, .size = 12 * 64 };
+}
+
+static u32 glyphWidth(u32 glyphIndex) noexcept
+{
+    return 3 + glyphIndex * 7 % 29;
+}
+
+static u32 glyphHeight(u32 glyphIndex) noexcept
+{
+    return 5 + glyphIndex * 13 % 31;
+}
+
+static u32 glyphTag(u32 glyphIndex) noexcept
+{
+    return (glyphIndex * 2654435761u | 1) & ~freshFlag;
+}
+
+int main(int argc, char** argv)
+{
+    const u32 threadCount = argc > 1 ? static_cast<u32>(std::max(2, atoi(argv[1]))) : 8;
+    const u32 frameCount = argc > 2 ? static_cast<u32>(std::max(1, atoi(argv[2]))) : 300;
+
+    DWrite_ConcurrentGlyphAtlas atlas{ pageWidth, pageHeight, pageCount, threadCount };
+    std::vector<std::atomic<u32>> mirror(static_cast<size_t>(pageCount) * pageWidth * pageHeight);
+    std::barrier barrier{ static_cast<ptrdiff_t>(threadCount) };
+
+    std::atomic<u64> overlaps{ 0 };
+    std::atomic<u64> wrongRects{ 0 };
+    std::atomic<u64> wrongPixels{ 0 };
+    std::atomic<u64> existing{ 0 };
+    std::atomic<u64> failed{ 0 };
+    std::atomic<u64> checked{ 0 };
+    std::atomic<u64> lost{ 0 };
+
+    DWrite_AtlasGlyph emptyGlyph;
+    atlas.Insert(0, glyphKey(emptyGlyphIndex), 0, 0, emptyGlyph);
+
+    const auto pixel = [&](const DWrite_AtlasGlyph& glyph, u32 x, u32 y) -> std::atomic<u32>& {
+        return mirror[(static_cast<size_t>(glyph.page) * pageHeight + y) * pageWidth + x];
+    };
+
+    // Returns false if the glyph can't be the one for glyphIndex, no matter what's in the mirror.
+    const auto checkRect = [&](const DWrite_AtlasGlyph& glyph, u32 glyphIndex) {
+        const auto& r = glyph.rect;
+        const auto ok = glyph.page < pageCount && r.right <= pageWidth && r.bottom <= pageHeight &&
+                        r.right - r.left == glyphWidth(glyphIndex) && r.bottom - r.top == glyphHeight(glyphIndex);
+        if (!ok)
+        {
+            wrongRects++;
+        }
+        return ok;
+    };
+
+    const auto worker = [&](u32 thread) {
+        std::mt19937 rng{ thread * 77 + 1 };
+        // The glyphs Insert() returned during the current frame.
+        std::vector<u32> inserted;
+
+        for (u32 frame = 0; frame < frameCount; ++frame)
+        {
+            // Alternate between a large working set that needs evictions and a small one that mostly hits.
+            const auto base = frame * 10;
+            const auto window = frame % 100 < 50 ? 400u : 100u;
+            inserted.clear();
+
+            // Find() and Insert() from all threads.
+            for (int i = 0; i < 200; ++i)
+            {
+                const auto glyphIndex = base + rng() % window;
+                const auto key = glyphKey(glyphIndex);
+                DWrite_AtlasGlyph glyph;
+
+                if (atlas.Find(thread, key, glyph))
+                {
+                    continue;
+                }
+
+                switch (atlas.Insert(thread, key, glyphWidth(glyphIndex), glyphHeight(glyphIndex), glyph))
+                {
+                case DWrite_AtlasInsertResult::Inserted:
+                    inserted.push_back(glyphIndex);
+                    if (!checkRect(glyph, glyphIndex))
+                    {
+                        break;
+                    }
+                    for (auto y = glyph.rect.top; y < glyph.rect.bottom; ++y)
+                    {
+                        for (auto x = glyph.rect.left; x < glyph.rect.right; ++x)
+                        {
+                            if (pixel(glyph, x, y).exchange(glyphTag(glyphIndex) | freshFlag, std::memory_order_relaxed) & freshFlag)
+                            {
+                                overlaps++;
+                            }
+                        }
+                    }
+                    break;
+                case DWrite_AtlasInsertResult::Existing:
+                    inserted.push_back(glyphIndex);
+                    existing++;
+                    break;
+                case DWrite_AtlasInsertResult::Failed:
+                    failed++;
+                    break;
+                }
+            }
+
+            barrier.arrive_and_wait();
+
+            // Publish() on thread 0 while the others keep calling Find().
+            if (thread == 0)
+            {
+                for (auto& p : mirror)
+                {
+                    p.store(p.load(std::memory_order_relaxed) & ~freshFlag, std::memory_order_relaxed);
+                }
+                atlas.Publish();
+                atlas.ClearEvictedGlyphs();
+            }
+            else
+            {
+                // Their pages were used during the ending frame, so Publish() can't evict them.
+                for (const auto glyphIndex : inserted)
+                {
+                    DWrite_AtlasGlyph glyph;
+                    if (!atlas.Find(thread, glyphKey(glyphIndex), glyph))
+                    {
+                        lost++;
+                    }
+                }
+
+                for (int i = 0; i < 100; ++i)
+                {
+                    const auto glyphIndex = base + rng() % 400;
+                    DWrite_AtlasGlyph glyph;
+                    if (atlas.Find(thread, glyphKey(glyphIndex), glyph))
+                    {
+                        // The pixels may be overwritten by now if Publish() evicted the page, but the rectangle can't change.
+                        checkRect(glyph, glyphIndex);
+                    }
+                }
+            }
+
+            barrier.arrive_and_wait();
+
+            // Check the pixels of the glyphs that survived Publish().
+            for (int i = 0; i < 50; ++i)
+            {
+                const auto glyphIndex = base + rng() % 400;
+                DWrite_AtlasGlyph glyph;
+                if (!atlas.Find(thread, glyphKey(glyphIndex), glyph) || !atlas.IsValid(glyph) || !checkRect(glyph, glyphIndex))
+                {
+                    continue;
+                }
+
+                checked++;
+                for (auto y = glyph.rect.top; y < glyph.rect.bottom; ++y)
+                {
+                    for (auto x = glyph.rect.left; x < glyph.rect.right; ++x)
+                    {
+                        if (pixel(glyph, x, y).load(std::memory_order_relaxed) != glyphTag(glyphIndex))
+                        {
+                            wrongPixels++;
+                        }
+                    }
+                }
+            }
+
+            barrier.arrive_and_wait();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (u32 i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back(worker, i);
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    DWrite_AtlasGlyph glyph;
+    const auto emptyGlyphValid = atlas.Find(0, glyphKey(emptyGlyphIndex), glyph) && atlas.IsValid(glyph) && atlas.IsValid(emptyGlyph);
+
+    const auto stats = atlas.Stats();
+    printf("threads=%u frames=%u\n", threadCount, frameCount);
+    printf("  overlaps=%llu wrongRects=%llu wrongPixels=%llu lost=%llu checkedGlyphs=%llu emptyGlyphValid=%d\n",
+           static_cast<unsigned long long>(overlaps.load()),
+           static_cast<unsigned long long>(wrongRects.load()),
+           static_cast<unsigned long long>(wrongPixels.load()),
+           static_cast<unsigned long long>(lost.load()),
+           static_cast<unsigned long long>(checked.load()),
+           emptyGlyphValid);
+    printf("  size=%u hits=%llu misses=%llu insertions=%llu existing=%llu failed=%llu evictedPages=%llu evictedGlyphs=%llu\n",
+           atlas.Size(),
+           static_cast<unsigned long long>(stats.hits),
+           static_cast<unsigned long long>(stats.misses),
+           static_cast<unsigned long long>(stats.insertions),
+           static_cast<unsigned long long>(existing.load()),
+           static_cast<unsigned long long>(failed.load()),
+           static_cast<unsigned long long>(stats.evictedPages),
+           static_cast<unsigned long long>(stats.evictedGlyphs));
+
+    if (overlaps || wrongRects || wrongPixels || lost || !emptyGlyphValid)
+    {
+        printf("FAILED\n");
+        return 1;
+    }
+    if (!stats.evictedPages || !checked)
+    {
+        printf("FAILED: the run didn't evict any pages or check any glyphs\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
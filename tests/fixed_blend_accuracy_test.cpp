@@ -0,0 +1,97 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Checks with DWrite_MeasureFixedBlendAccuracy() that the fixed-point span functions stay within 1 LSB of the
+// float ones, for grayscale and ClearType, a range of gammas, contrasts and foreground colors, and every
+// instruction set tier the fixed-point functions are implemented for that the CPU supports.
+//
+// Usage: fixed_blend_accuracy_test
+
+#include <cstdio>
+#include <initializer_list>
+
+#include "blend.h"
+#include "check.h"
+#include "dwrite.h"
+
+static const char* isaName(DWrite_BlendIsa isa) noexcept
+{
+    switch (isa)
+    {
+    case DWrite_BlendIsa::SSE41:
+        return "SSE41";
+    case DWrite_BlendIsa::AVX2:
+        return "AVX2";
+    case DWrite_BlendIsa::AVX512:
+        return "AVX512";
+    default:
+        return "Scalar";
+    }
+}
+
+int main()
+{
+    // The fixed-point functions only have a Scalar and an AVX2 implementation. The other tiers use one of them.
+    const DWrite_BlendIsa tiers[]{ DWrite_BlendIsa::Scalar, DWrite_BlendIsa::AVX2 };
+    // Translucent foreground colors are premultiplied.
+    const f32x4 foregrounds[]{
+        { 0.0f, 0.0f, 0.0f, 1.0f },
+        { 1.0f, 1.0f, 1.0f, 1.0f },
+        { 0.9f, 0.2f, 0.5f, 1.0f },
+        { 0.675f, 0.6f, 0.225f, 0.75f },
+        { 0.1f, 0.05f, 0.2f, 0.25f },
+    };
+
+    for (const auto requested : tiers)
+    {
+        const auto isa = DWrite_SetBlendIsa(requested);
+        if (isa != requested)
+        {
+            printf("%s: not supported, skipped\n", isaName(requested));
+            continue;
+        }
+
+        for (const auto gamma : { 1.0f, 1.8f, 2.2f })
+        {
+            for (const auto contrast : { 0.0f, 0.5f, 1.0f })
+            {
+                for (const auto thin : { false, true })
+                {
+                    for (const auto& foreground : foregrounds)
+                    {
+                        DWrite_BlendParams params;
+                        DWrite_GetGammaRatiosForEncodedTarget(gamma, params.gammaRatios);
+                        params.grayscaleEnhancedContrast = contrast;
+                        params.cleartypeEnhancedContrast = contrast;
+                        params.isThinFont = thin;
+                        params.foregroundColor = foreground;
+
+                        for (const auto cleartype : { false, true })
+                        {
+                            const auto acc = DWrite_MeasureFixedBlendAccuracy(params, cleartype);
+                            if (!CHECK(acc.samples && acc.maxError <= 1))
+                            {
+                                printf("  %s %s: gamma=%.1f contrast=%.1f thin=%d foreground=(%.3f, %.3f, %.3f, %.3f) maxError=%u meanError=%.4f\n",
+                                       isaName(isa),
+                                       cleartype ? "cleartype" : "grayscale",
+                                       gamma,
+                                       contrast,
+                                       thin,
+                                       foreground.r,
+                                       foreground.g,
+                                       foreground.b,
+                                       foreground.a,
+                                       acc.maxError,
+                                       acc.meanError);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        printf("%s: checked\n", isaName(isa));
+    }
+
+    return CheckResult();
+}
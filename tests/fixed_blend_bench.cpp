@@ -0,0 +1,126 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Compares the fixed-point span functions against the float ones at every instruction set tier the CPU supports.
+// The fixed-point functions only have a Scalar and an AVX2 implementation, which the other tiers use as well.
+// It also prints the largest difference between the two outputs in 8-bit steps.
+//
+// Usage: fixed_blend_bench [pixels per row] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <random>
+#include <vector>
+
+#include "blend.h"
+#include "dwrite.h"
+
+static const char* isaName(DWrite_BlendIsa isa) noexcept
+{
+    switch (isa)
+    {
+    case DWrite_BlendIsa::SSE41:
+        return "SSE41";
+    case DWrite_BlendIsa::AVX2:
+        return "AVX2";
+    case DWrite_BlendIsa::AVX512:
+        return "AVX512";
+    default:
+        return "Scalar";
+    }
+}
+
+// The largest difference of any channel between the two rows.
+static u32 maxDifference(const std::vector<u32>& a, const std::vector<u32>& b) noexcept
+{
+    u32 result = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        for (u32 shift = 0; shift < 32; shift += 8)
+        {
+            const auto x = (a[i] >> shift) & 0xff;
+            const auto y = (b[i] >> shift) & 0xff;
+            result = std::max(result, x > y ? x - y : y - x);
+        }
+    }
+    return result;
+}
+
+// Blends a fresh copy of the background with fn() per repetition and returns the fastest time per pixel in nanoseconds.
+template<typename T>
+static double measure(const std::vector<u32>& background, std::vector<u32>& dst, int repetitions, const T& fn)
+{
+    auto best = 1e300;
+
+    for (int i = 0; i < repetitions; ++i)
+    {
+        dst = background;
+        const auto start = std::chrono::steady_clock::now();
+        fn(dst.data(), dst.size());
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count());
+    }
+
+    return best / static_cast<double>(background.size());
+}
+
+int main(int argc, char** argv)
+{
+    const size_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1 << 16;
+    const int repetitions = argc > 2 ? std::max(1, atoi(argv[2])) : 50;
+
+    std::mt19937 rng{ 1 };
+    std::vector<u8> glyphAlpha(count);
+    std::vector<u32> glyphColor(count);
+    // ClearType needs an opaque background. Grayscale doesn't, but it's the common case.
+    std::vector<u32> background(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        glyphAlpha[i] = static_cast<u8>(rng());
+        glyphColor[i] = static_cast<u32>(rng());
+        background[i] = static_cast<u32>(rng()) | 0xff000000;
+    }
+
+    DWrite_BlendParams params;
+    DWrite_GetGammaRatiosForEncodedTarget(1.8f, params.gammaRatios);
+    // A translucent color (0.9, 0.8, 0.3) with an alpha of 0.75, premultiplied.
+    params.foregroundColor = { 0.675f, 0.6f, 0.225f, 0.75f };
+
+    DWrite_FixedBlendParams fixedParams;
+    DWrite_GetFixedBlendParams(params, fixedParams);
+
+    std::vector<u32> floats;
+    std::vector<u32> fixed;
+
+    printf("%zu pixels, best of %d\n", count, repetitions);
+    printf("tier    mode       float ns/px  fixed ns/px  float Gpx/s  fixed Gpx/s  speedup  max diff\n");
+
+    const auto print = [&](DWrite_BlendIsa isa, const char* mode, double a, double b) {
+        printf("%-6s  %-9s  %11.3f  %11.3f  %11.2f  %11.2f  %6.2fx  %8u\n", isaName(isa), mode, a, b, 1.0 / a, 1.0 / b, a / b, maxDifference(floats, fixed));
+    };
+
+    for (const auto requested : { DWrite_BlendIsa::Scalar, DWrite_BlendIsa::SSE41, DWrite_BlendIsa::AVX2, DWrite_BlendIsa::AVX512 })
+    {
+        const auto isa = DWrite_SetBlendIsa(requested);
+        if (isa != requested)
+        {
+            continue;
+        }
+
+        {
+            const auto a = measure(background, floats, repetitions, [&](u32* dst, size_t n) { DWrite_GrayscaleBlendSpan(params, glyphAlpha.data(), dst, n); });
+            const auto b = measure(background, fixed, repetitions, [&](u32* dst, size_t n) { DWrite_GrayscaleBlendSpanFixed(fixedParams, glyphAlpha.data(), dst, n); });
+            print(isa, "grayscale", a, b);
+        }
+        {
+            const auto a = measure(background, floats, repetitions, [&](u32* dst, size_t n) { DWrite_CleartypeBlendSpan(params, glyphColor.data(), dst, n); });
+            const auto b = measure(background, fixed, repetitions, [&](u32* dst, size_t n) { DWrite_CleartypeBlendSpanFixed(fixedParams, glyphColor.data(), dst, n); });
+            print(isa, "cleartype", a, b);
+        }
+    }
+
+    return 0;
+}
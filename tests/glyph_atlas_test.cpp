@@ -0,0 +1,425 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Deterministic tests for DWrite_GlyphAtlas: insertion and lookup, LRU page eviction, page generations,
+// compaction (the moved glyphs keep their size and pixels, and cached handles can be remapped) and
+// subpixel variants (DWrite_QuantizeGlyphX and FindNearestVariant).
+//
+// The glyphs aren't rasterized. Instead, the test keeps a mirror of the atlas pages in which every glyph's
+// rectangle is filled with a tag derived from its key, like the caller would upload its pixels.
+//
+// Usage: glyph_atlas_test
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "check.h"
+#include "glyph_atlas.h"
+
+static constexpr u32 pageSize = 64;
+
+static DWrite_GlyphKey glyphKey(u32 glyphIndex, u32 subpixel = 0) noexcept
+{
+    return { .fontFace = 1, .glyphIndex = glyphIndex, .size = 12 * 64, .subpixel = subpixel };
+}
+
+static u32 glyphTag(const DWrite_GlyphKey& key) noexcept
+{
+    return static_cast<u32>(DWrite_HashGlyphKey(key)) | 1;
+}
+
+static bool sameGlyph(const DWrite_AtlasGlyph& a, const DWrite_AtlasGlyph& b) noexcept
+{
+    return a.page == b.page && a.generation == b.generation && a.rect.left == b.rect.left && a.rect.top == b.rect.top &&
+           a.rect.right == b.rect.right && a.rect.bottom == b.rect.bottom;
+}
+
+// The pixels of all pages, with 0 for pixels that don't belong to any glyph.
+class Mirror
+{
+public:
+    explicit Mirror(u32 pageCount) :
+        _pixels(static_cast<size_t>(pageCount) * pageSize * pageSize)
+    {
+    }
+
+    // Fills the glyph's rectangle with the tag. Returns false if it overlaps another glyph.
+    bool Upload(const DWrite_AtlasGlyph& glyph, u32 tag)
+    {
+        bool ok = true;
+        forEach(glyph, [&](u32& p) {
+            ok &= p == 0;
+            p = tag;
+        });
+        return ok;
+    }
+
+    // Copies the pixels of a glyph that Compact() moved and clears the old location.
+    void Move(const DWrite_AtlasMove& move)
+    {
+        std::vector<u32> pixels;
+        forEach(move.from, [&](u32& p) {
+            pixels.push_back(p);
+            p = 0;
+        });
+        auto it = pixels.begin();
+        forEach(move.to, [&](u32& p) { p = *it++; });
+    }
+
+    // Returns true if the glyph's rectangle holds the tag.
+    bool Holds(const DWrite_AtlasGlyph& glyph, u32 tag)
+    {
+        bool ok = true;
+        forEach(glyph, [&](u32& p) { ok &= p == tag; });
+        return ok;
+    }
+
+    // Clears a page, like its glyphs being overwritten after an eviction.
+    void ClearPage(u32 page)
+    {
+        std::fill_n(_pixels.begin() + static_cast<size_t>(page) * pageSize * pageSize, pageSize * pageSize, 0u);
+    }
+
+private:
+    template<typename T>
+    void forEach(const DWrite_AtlasGlyph& glyph, const T& fn)
+    {
+        for (auto y = glyph.rect.top; y < glyph.rect.bottom; ++y)
+        {
+            for (auto x = glyph.rect.left; x < glyph.rect.right; ++x)
+            {
+                fn(_pixels[(static_cast<size_t>(glyph.page) * pageSize + y) * pageSize + x]);
+            }
+        }
+    }
+
+    std::vector<u32> _pixels;
+};
+
+// Inserting returns non-overlapping rectangles of the requested size, which Find() returns from then on.
+static void testInsertAndFind()
+{
+    DWrite_GlyphAtlas atlas{ pageSize, pageSize, 2 };
+    Mirror mirror{ 2 };
+    std::vector<DWrite_AtlasGlyph> glyphs;
+
+    for (u32 i = 0; i < 40; ++i)
+    {
+        const auto key = glyphKey(i);
+        const auto glyph = atlas.Insert(key, 3 + i % 11, 2 + i % 7);
+        if (!CHECK(glyph))
+        {
+            return;
+        }
+        CHECK(glyph->rect.right - glyph->rect.left == 3 + i % 11);
+        CHECK(glyph->rect.bottom - glyph->rect.top == 2 + i % 7);
+        CHECK(glyph->rect.right <= pageSize && glyph->rect.bottom <= pageSize);
+        CHECK(mirror.Upload(*glyph, glyphTag(key)));
+        glyphs.push_back(*glyph);
+    }
+
+    CHECK(atlas.Size() == 40);
+    CHECK(atlas.Stats().insertions == 40);
+    CHECK(atlas.Stats().evictedPages == 0);
+
+    for (u32 i = 0; i < 40; ++i)
+    {
+        const auto glyph = atlas.Find(glyphKey(i));
+        CHECK(glyph && sameGlyph(*glyph, glyphs[i]) && atlas.IsValid(*glyph));
+        CHECK(glyph && mirror.Holds(*glyph, glyphTag(glyphKey(i))));
+    }
+
+    // Inserting an existing glyph returns it as is, even with a different size.
+    const auto existing = atlas.Insert(glyphKey(5), 1, 1);
+    CHECK(existing && sameGlyph(*existing, glyphs[5]));
+    CHECK(atlas.Stats().insertions == 40);
+
+    // Other fields of the key make a different glyph.
+    auto key = glyphKey(5);
+    key.mode = DWrite_BlendMode::ClearType;
+    CHECK(!atlas.Find(key));
+
+    // Empty glyphs take up no space and glyphs larger than a page can't be inserted.
+    const auto empty = atlas.Insert(glyphKey(1000), 0, 10);
+    CHECK(empty && empty->rect.left == empty->rect.right);
+    CHECK(atlas.UsedArea() == [&] {
+        u64 area = 0;
+        for (const auto& g : glyphs)
+        {
+            area += static_cast<u64>(g.rect.right - g.rect.left) * (g.rect.bottom - g.rect.top);
+        }
+        return area;
+    }());
+    CHECK(!atlas.Insert(glyphKey(1001), pageSize + 1, 1));
+    CHECK(atlas.Stats().failures == 1);
+    CHECK(atlas.Stats().hits == 40);
+}
+
+// Fills two pages with 16x16 glyphs. Page 0 gets glyphs [0, 16) in frame 1 and page 1 gets [16, 32) in frame 2.
+static void fillTwoPages(DWrite_GlyphAtlas& atlas, Mirror& mirror, std::vector<DWrite_AtlasGlyph>& glyphs)
+{
+    for (u32 i = 0; i < 32; ++i)
+    {
+        if (i == 16)
+        {
+            atlas.BeginFrame();
+        }
+
+        const auto glyph = atlas.Insert(glyphKey(i), 16, 16);
+        if (!CHECK(glyph && glyph->page == i / 16))
+        {
+            return;
+        }
+        CHECK(mirror.Upload(*glyph, glyphTag(glyphKey(i))));
+        glyphs.push_back(*glyph);
+    }
+}
+
+// Once all pages are full, the least recently used one is evicted as a whole, unless it's used in the current frame.
+static void testEviction()
+{
+    DWrite_GlyphAtlas atlas{ pageSize, pageSize, 2 };
+    Mirror mirror{ 2 };
+    std::vector<DWrite_AtlasGlyph> glyphs;
+    fillTwoPages(atlas, mirror, glyphs);
+
+    // Using a glyph of page 0 makes page 1 the least recently used one.
+    atlas.BeginFrame();
+    CHECK(atlas.Find(glyphKey(3)));
+
+    atlas.BeginFrame();
+    const auto inserted = atlas.Insert(glyphKey(100), 16, 16);
+    CHECK(inserted && inserted->page == 1);
+    CHECK(atlas.Stats().evictedPages == 1);
+    CHECK(atlas.Stats().evictedGlyphs == 16);
+    CHECK(atlas.Size() == 17);
+    CHECK(atlas.PageGeneration(0) == 0);
+    CHECK(atlas.PageGeneration(1) == 1);
+
+    auto evicted = atlas.EvictedGlyphs();
+    std::sort(evicted.begin(), evicted.end(), [](const auto& a, const auto& b) { return a.glyphIndex < b.glyphIndex; });
+    if (CHECK(evicted.size() == 16))
+    {
+        for (u32 i = 0; i < 16; ++i)
+        {
+            CHECK(evicted[i] == glyphKey(16 + i));
+        }
+    }
+    atlas.ClearEvictedGlyphs();
+    CHECK(atlas.EvictedGlyphs().empty());
+
+    for (u32 i = 0; i < 32; ++i)
+    {
+        const auto glyph = atlas.Find(glyphKey(i));
+        CHECK(!glyph == (i >= 16));
+        CHECK(atlas.IsValid(glyphs[i]) == (i < 16));
+    }
+
+    // Every page has now been used during the current frame, so nothing can be evicted.
+    for (u32 i = 101; i < 116; ++i)
+    {
+        CHECK(atlas.Insert(glyphKey(i), 16, 16));
+    }
+    CHECK(!atlas.Insert(glyphKey(116), 16, 16));
+    CHECK(atlas.Stats().evictedPages == 1);
+    CHECK(atlas.Stats().failures == 1);
+
+    // In the next frame it works again.
+    atlas.BeginFrame();
+    CHECK(atlas.Insert(glyphKey(116), 16, 16));
+    CHECK(atlas.Stats().evictedPages == 2);
+}
+
+// Clear() invalidates everything through the page generations, without reporting the glyphs as evicted.
+static void testGenerations()
+{
+    DWrite_GlyphAtlas atlas{ pageSize, pageSize, 2 };
+    Mirror mirror{ 2 };
+    std::vector<DWrite_AtlasGlyph> glyphs;
+    fillTwoPages(atlas, mirror, glyphs);
+
+    atlas.Clear();
+    CHECK(atlas.Size() == 0);
+    CHECK(atlas.UsedArea() == 0);
+    CHECK(atlas.EvictedGlyphs().empty());
+    CHECK(atlas.PageGeneration(0) == 1 && atlas.PageGeneration(1) == 1);
+    for (u32 i = 0; i < 32; ++i)
+    {
+        CHECK(!atlas.IsValid(glyphs[i]));
+        CHECK(!atlas.Find(glyphKey(i)));
+    }
+
+    // A glyph inserted again may end up in the same place, but only the new handle is valid.
+    const auto glyph = atlas.Insert(glyphKey(0), 16, 16);
+    CHECK(glyph && glyph->generation == 1 && atlas.IsValid(*glyph));
+    CHECK(!atlas.IsValid(glyphs[0]));
+    CHECK(atlas.PageGeneration(2) == 0);
+    CHECK(!atlas.IsValid({ .rect = {}, .page = 2 }));
+}
+
+// Compact() moves the live glyphs off a fragmented page, drops the idle ones and then resets the page.
+static void testCompaction()
+{
+    DWrite_GlyphAtlas atlas{ pageSize, pageSize, 2 };
+    Mirror mirror{ 2 };
+    std::vector<DWrite_AtlasGlyph> glyphs;
+    fillTwoPages(atlas, mirror, glyphs);
+
+    // Make room on page 1 by evicting it and refilling it with only 2 glyphs. Page 0 is then the
+    // only full page and only 4 of its glyphs stay live, which makes it a candidate for compaction.
+    for (u32 i = 0; i < 4; ++i)
+    {
+        atlas.BeginFrame();
+        for (const u32 live : { 1u, 6u, 11u, 12u })
+        {
+            CHECK(atlas.Find(glyphKey(live)));
+        }
+    }
+    atlas.BeginFrame();
+    for (u32 i = 200; i < 202; ++i)
+    {
+        const auto glyph = atlas.Insert(glyphKey(i), 16, 16);
+        CHECK(glyph && glyph->page == 1);
+        if (i == 200)
+        {
+            mirror.ClearPage(1);
+        }
+        CHECK(glyph && mirror.Upload(*glyph, glyphTag(glyphKey(i))));
+    }
+    atlas.ClearEvictedGlyphs();
+    for (const u32 live : { 1u, 6u, 11u, 12u })
+    {
+        CHECK(atlas.Find(glyphKey(live)));
+    }
+
+    const auto moved = atlas.Compact(std::chrono::seconds{ 10 }, 2);
+    CHECK(moved == 4);
+    CHECK(atlas.Stats().compactedGlyphs == 4);
+    CHECK(atlas.Stats().droppedGlyphs == 12);
+    CHECK(atlas.EvictedGlyphs().size() == 12);
+    CHECK(atlas.Size() == 6);
+
+    if (CHECK(atlas.Moves().size() == 4))
+    {
+        for (const auto& move : atlas.Moves())
+        {
+            CHECK(move.from.page == 0 && move.to.page == 1);
+            CHECK(move.to.rect.right - move.to.rect.left == move.from.rect.right - move.from.rect.left);
+            CHECK(move.to.rect.bottom - move.to.rect.top == move.from.rect.bottom - move.from.rect.top);
+            mirror.Move(move);
+        }
+    }
+
+    // Every live glyph keeps its size and pixels, and the old handles remap to the new locations.
+    for (const u32 live : { 1u, 6u, 11u, 12u, 200u, 201u })
+    {
+        const auto glyph = atlas.Find(glyphKey(live));
+        if (!CHECK(glyph && glyph->page == 1))
+        {
+            continue;
+        }
+        CHECK(glyph->rect.right - glyph->rect.left == 16 && glyph->rect.bottom - glyph->rect.top == 16);
+        CHECK(mirror.Holds(*glyph, glyphTag(glyphKey(live))));
+
+        // The old location stays valid until the page is reset.
+        if (live < 16)
+        {
+            CHECK(atlas.IsValid(glyphs[live]));
+        }
+    }
+
+    // The idle glyphs are gone.
+    for (const auto& key : atlas.EvictedGlyphs())
+    {
+        CHECK(!atlas.Find(key));
+    }
+
+    // Page 0 was used during this frame, so it's only reset in the next one. That invalidates the old handles.
+    CHECK(atlas.Stats().compactedPages == 0);
+    atlas.BeginFrame();
+    atlas.Compact(std::chrono::seconds{ 10 }, 2);
+    CHECK(atlas.Stats().compactedPages == 1);
+    CHECK(atlas.PageGeneration(0) == 1);
+
+    auto handle = glyphs[6];
+    CHECK(!atlas.IsValid(handle));
+    const auto glyph = atlas.Find(glyphKey(6));
+    CHECK(atlas.Remap(handle) && glyph && sameGlyph(handle, *glyph));
+    auto dropped = glyphs[0];
+    CHECK(!atlas.Remap(dropped));
+
+    // ClearMoves() forgets the moves, after which the handles can't be remapped anymore.
+    atlas.ClearMoves();
+    handle = glyphs[6];
+    CHECK(!atlas.Remap(handle));
+
+    // The reset page is empty and takes new glyphs again.
+    for (u32 i = 300; i < 316; ++i)
+    {
+        const auto g = atlas.Insert(glyphKey(i), 16, 16);
+        CHECK(g && (g->page == 0 || g->page == 1));
+    }
+    CHECK(atlas.Stats().evictedPages == 1);
+}
+
+static void testSubpixelVariants()
+{
+    const DWrite_SubpixelPolicy four{ .phases = 4 };
+    const auto q = [](const DWrite_SubpixelPolicy& policy, u32 size, f32 x, i32 pixel, u32 subpixel) {
+        const auto r = DWrite_QuantizeGlyphX(policy, size, x);
+        return r.x == pixel && r.subpixel == subpixel;
+    };
+
+    CHECK(q(four, 12 * 64, 10.0f, 10, 0));
+    CHECK(q(four, 12 * 64, 10.3f, 10, 64));
+    CHECK(q(four, 12 * 64, 10.6f, 10, 128));
+    CHECK(q(four, 12 * 64, 10.9f, 11, 0));
+    CHECK(q(four, 12 * 64, -0.3f, -1, 192));
+    // Glyphs above maxSize are snapped to whole pixels.
+    CHECK(q(four, four.maxSize + 1, 10.3f, 10, 0));
+    CHECK(q(four, four.maxSize + 1, 10.6f, 11, 0));
+    // Phase counts are rounded down to a power of 2 in [1, 256].
+    CHECK(q({ .phases = 3 }, 12 * 64, 10.6f, 10, 128));
+    CHECK(q({ .phases = 0 }, 12 * 64, 10.6f, 11, 0));
+    CHECK(q({ .phases = 1000 }, 12 * 64, 10.5f + 1.0f / 256.0f, 10, 129));
+    CHECK(DWrite_SubpixelOffset(64) == 0.25f);
+
+    DWrite_GlyphAtlas atlas{ pageSize, pageSize, 1 };
+    const auto zero = *atlas.Insert(glyphKey(1, 0), 8, 8);
+    const auto three = *atlas.Insert(glyphKey(1, 192), 8, 8);
+
+    const auto nearest = [&](const DWrite_SubpixelPolicy& policy, u32 subpixel, const DWrite_AtlasGlyph* expected) {
+        const auto glyph = atlas.FindNearestVariant(glyphKey(1, subpixel), policy);
+        return expected ? glyph && sameGlyph(*glyph, *expected) : !glyph;
+    };
+
+    // The exact phase doesn't count as a fallback.
+    CHECK(nearest(four, 192, &three));
+    CHECK(atlas.Stats().variantFallbacks == 0);
+    // 64 is one phase away from 0 and 128 is one phase away from both 64 and 192, of which only 192 exists.
+    CHECK(nearest(four, 64, &zero));
+    CHECK(nearest(four, 128, &three));
+    CHECK(atlas.Stats().variantFallbacks == 2);
+    // With 2 phases only 0 and 128 are candidates.
+    CHECK(nearest({ .phases = 2 }, 128, &zero));
+    // With 1 phase there's nothing to fall back to.
+    CHECK(!atlas.Find(glyphKey(1, 64)));
+    CHECK(nearest({ .phases = 1 }, 64, nullptr));
+    // The policy snaps glyphs above maxSize to whole pixels, so the other phases of such glyphs aren't candidates,
+    // even if they were inserted under a policy that allowed them.
+    CHECK(nearest({ .phases = 4, .maxSize = 8 * 64 }, 64, nullptr));
+    CHECK(nearest({ .phases = 4, .maxSize = 12 * 64 }, 64, &zero));
+    // Other glyphs don't count.
+    CHECK(!atlas.FindNearestVariant(glyphKey(2, 64), four));
+}
+
+int main()
+{
+    testInsertAndFind();
+    testEviction();
+    testGenerations();
+    testCompaction();
+    testSubpixelVariants();
+    return CheckResult();
+}
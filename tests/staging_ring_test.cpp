@@ -0,0 +1,326 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Tests DWrite_StagingRing against DWrite_CpuStagingBackend and a backend whose fences only complete when the
+// test says so: alignment, wrapping, freeing of the padding at the end of the ring, the batches handed to the
+// backend, stall counting and the pixels that arrive in the pages.
+
+#include <random>
+#include <vector>
+
+#include "check.h"
+#include "staging_ring.h"
+
+// Copies everything like DWrite_CpuStagingBackend, but its fences only complete once Complete() or WaitForFence()
+// was called. It also keeps a copy of the last batch, since the batch's arrays only live until Submit() returns.
+class LateBackend final : public DWrite_StagingBackend
+{
+public:
+    explicit LateBackend(std::vector<DWrite_CpuStagingBackend::Page> pages) :
+        _inner{ std::move(pages) }
+    {
+    }
+
+    u64 Submit(const DWrite_StagingBatch& batch) override
+    {
+        lastCopies.assign(batch.copies, batch.copies + batch.copyCount);
+        lastDirtyRects.assign(batch.dirtyRects, batch.dirtyRects + batch.dirtyRectCount);
+        _inner.Submit(batch);
+        return ++submitted;
+    }
+
+    u64 CompletedFence() override
+    {
+        return completed;
+    }
+
+    void WaitForFence(u64 fence) override
+    {
+        waits++;
+        completed = std::max(completed, fence);
+    }
+
+    void Complete(u64 fence) noexcept
+    {
+        completed = std::max(completed, fence);
+    }
+
+    u64 submitted = 0;
+    u64 completed = 0;
+    u64 waits = 0;
+    std::vector<DWrite_StagingCopy> lastCopies;
+    std::vector<DWrite_StagingDirtyRect> lastDirtyRects;
+
+private:
+    DWrite_CpuStagingBackend _inner;
+};
+
+static size_t offsetOf(const std::vector<u8>& memory, const u8* p) noexcept
+{
+    return static_cast<size_t>(p - memory.data());
+}
+
+static bool sameRect(const DWrite_Rect& a, const DWrite_Rect& b) noexcept
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+// With D3D12's alignments every glyph starts at a multiple of 512 and every row at a multiple of 256 bytes.
+// Once the ring is full, the next glyph wraps around to 0 after waiting for the oldest batch.
+static void testAlignmentAndWrapping()
+{
+    std::vector<u8> page(64 * 64 * 4);
+    LateBackend backend{ { { page.data(), 64 * 4 } } };
+    std::vector<u8> memory(4096);
+    DWrite_StagingRing ring{ backend, memory.data(), memory.size(), 256, 512 };
+
+    // A 10x2 glyph at 4 bytes per pixel takes 256 + 40 bytes, so 8 of them fill the ring in steps of 512.
+    for (u32 i = 0; i < 8; ++i)
+    {
+        u32 rowPitch = 0;
+        const auto p = ring.Allocate(0, { i, 0, i + 10, 2 }, 4, rowPitch);
+        CHECK(p && offsetOf(memory, p) == i * 512);
+        CHECK(rowPitch == 256);
+    }
+    // The last glyph ends at 3584 + 296 = 3880.
+    CHECK(ring.UsedBytes() == 3880);
+    CHECK(ring.PendingCopies() == 8);
+
+    // The next one doesn't fit before the end of the ring, and the start is still in use by the GPU.
+    u32 rowPitch = 0;
+    const auto p = ring.Allocate(0, { 0, 10, 10, 12 }, 4, rowPitch);
+    CHECK(p && offsetOf(memory, p) == 0);
+    CHECK(backend.submitted == 1);
+    CHECK(backend.waits == 1);
+
+    const auto stats = ring.Stats();
+    CHECK(stats.allocations == 9);
+    CHECK(stats.flushes == 1);
+    CHECK(stats.stalls == 1);
+    CHECK(stats.failures == 0);
+
+    // A glyph that doesn't fit into the ring at all fails without flushing or waiting.
+    CHECK(!ring.Allocate(0, { 0, 0, 64, 64 }, 4, rowPitch));
+    CHECK(ring.Stats().failures == 1);
+    CHECK(backend.submitted == 1);
+}
+
+// When a glyph wraps around, the skipped bytes at the end of the ring belong to it and are freed along with it.
+static void testWrapPaddingIsFreed()
+{
+    std::vector<u8> page(64 * 64 * 4);
+    LateBackend backend{ { { page.data(), 64 * 4 } } };
+    std::vector<u8> memory(4096);
+    DWrite_StagingRing ring{ backend, memory.data(), memory.size() };
+    u32 rowPitch = 0;
+
+    // 3000 and 500 bytes in two batches.
+    CHECK(ring.Allocate(0, { 0, 0, 1000, 3 }, 1, rowPitch));
+    ring.Flush();
+    const auto second = ring.Allocate(0, { 0, 0, 500, 1 }, 1, rowPitch);
+    CHECK(second && offsetOf(memory, second) == 3000);
+    ring.Flush();
+
+    // Once the first batch is done, 1000 bytes fit at the start but not in the 596 bytes at the end.
+    backend.Complete(1);
+    ring.Reclaim();
+    CHECK(ring.UsedBytes() == 500);
+    const auto third = ring.Allocate(0, { 0, 0, 1000, 1 }, 1, rowPitch);
+    CHECK(third && offsetOf(memory, third) == 0);
+    CHECK(ring.UsedBytes() == 500 + 596 + 1000);
+    CHECK(ring.Stats().allocatedBytes == 3000 + 500 + 596 + 1000);
+    CHECK(ring.Stats().stalls == 0);
+    ring.Flush();
+
+    backend.Complete(2);
+    ring.Reclaim();
+    CHECK(ring.UsedBytes() == 596 + 1000);
+    backend.Complete(3);
+    ring.Reclaim();
+    CHECK(ring.UsedBytes() == 0);
+
+    // Nothing leaked, so the entire ring is available again.
+    const auto full = ring.Allocate(0, { 0, 0, 1024, 4 }, 1, rowPitch);
+    CHECK(full && offsetOf(memory, full) == 0);
+    CHECK(ring.UsedBytes() == 4096);
+}
+
+// The backend gets the copies sorted by page (in submission order within each page) and one dirty rect per page.
+static void testBatchLayout()
+{
+    std::vector<u8> pages(3 * 64 * 64 * 4);
+    LateBackend backend{ {
+        { pages.data(), 64 * 4 },
+        { pages.data() + 64 * 64 * 4, 64 * 4 },
+        { pages.data() + 2 * 64 * 64 * 4, 64 * 4 },
+    } };
+    std::vector<u8> memory(16384);
+    DWrite_StagingRing ring{ backend, memory.data(), memory.size() };
+    u32 rowPitch = 0;
+
+    const struct
+    {
+        u32 page;
+        DWrite_Rect rect;
+    } glyphs[]{
+        { 2, { 10, 10, 20, 20 } },
+        { 0, { 0, 0, 5, 5 } },
+        { 2, { 30, 5, 40, 15 } },
+        { 1, { 8, 8, 9, 9 } },
+        { 0, { 40, 30, 50, 60 } },
+    };
+    for (const auto& g : glyphs)
+    {
+        CHECK(ring.Allocate(g.page, g.rect, 4, rowPitch));
+    }
+    ring.Flush();
+
+    CHECK(backend.submitted == 1);
+    CHECK(ring.PendingCopies() == 0);
+    if (CHECK(backend.lastCopies.size() == 5))
+    {
+        const u32 expectedOrder[]{ 1, 4, 3, 0, 2 };
+        for (size_t i = 0; i < 5; ++i)
+        {
+            const auto& g = glyphs[expectedOrder[i]];
+            CHECK(backend.lastCopies[i].page == g.page);
+            CHECK(sameRect(backend.lastCopies[i].rect, g.rect));
+        }
+    }
+    if (CHECK(backend.lastDirtyRects.size() == 3))
+    {
+        CHECK(backend.lastDirtyRects[0].page == 0);
+        CHECK(sameRect(backend.lastDirtyRects[0].rect, { 0, 0, 50, 60 }));
+        CHECK(backend.lastDirtyRects[1].page == 1);
+        CHECK(sameRect(backend.lastDirtyRects[1].rect, { 8, 8, 9, 9 }));
+        CHECK(backend.lastDirtyRects[2].page == 2);
+        CHECK(sameRect(backend.lastDirtyRects[2].rect, { 10, 5, 40, 20 }));
+    }
+
+    // Flushing without pending copies doesn't submit an empty batch.
+    ring.Flush();
+    CHECK(backend.submitted == 1);
+    CHECK(ring.Stats().flushes == 1);
+}
+
+// A full ring only counts a stall if it actually has to wait for the GPU.
+static void testStallCounting()
+{
+    std::vector<u8> page(64 * 64);
+    u32 rowPitch = 0;
+
+    // Fences that complete during Submit() never stall, no matter how often the ring fills up.
+    {
+        DWrite_CpuStagingBackend backend{ { { page.data(), 64 } } };
+        std::vector<u8> memory(1024);
+        DWrite_StagingRing ring{ backend, memory.data(), memory.size() };
+        for (int i = 0; i < 100; ++i)
+        {
+            CHECK(ring.Allocate(0, { 0, 0, 30, 10 }, 1, rowPitch));
+        }
+        CHECK(ring.Stats().flushes == backend.SubmittedBatches());
+        CHECK(ring.Stats().flushes > 0);
+        CHECK(ring.Stats().stalls == 0);
+    }
+
+    // Late fences stall once per batch that has to be waited for.
+    {
+        LateBackend backend{ { { page.data(), 64 } } };
+        std::vector<u8> memory(1024);
+        DWrite_StagingRing ring{ backend, memory.data(), memory.size() };
+
+        // 3 batches of 300 bytes.
+        for (int i = 0; i < 3; ++i)
+        {
+            CHECK(ring.Allocate(0, { 0, 0, 30, 10 }, 1, rowPitch));
+            ring.Flush();
+        }
+
+        // The first batch completed in the meantime, so there's no need to wait.
+        backend.Complete(1);
+        CHECK(ring.Allocate(0, { 0, 0, 30, 10 }, 1, rowPitch));
+        CHECK(ring.Stats().stalls == 0);
+        CHECK(backend.waits == 0);
+
+        // A 900 byte glyph needs the 2 batches that are still in flight and the glyph above, which this flushes.
+        CHECK(ring.Allocate(0, { 0, 0, 30, 30 }, 1, rowPitch));
+        CHECK(backend.submitted == 4);
+        CHECK(ring.Stats().stalls == 3);
+        CHECK(backend.waits == 3);
+        CHECK(backend.completed == 4);
+    }
+}
+
+// Random glyphs at D3D12's alignments through a small ring, with fences that complete late or not at all
+// until the ring has to wait. Every page must end up with exactly the pixels that were written.
+static void testPixels()
+{
+    constexpr u32 size = 128;
+    std::mt19937 rng{ 42 };
+    const auto next = [&]() { return static_cast<u32>(rng()); };
+
+    // Page 0 holds B8G8R8A8 glyphs and page 1 A8 ones.
+    std::vector<u8> pages[2]{ std::vector<u8>(size * size * 4), std::vector<u8>(size * size) };
+    std::vector<u8> expected[2]{ pages[0], pages[1] };
+    const u32 bytesPerPixel[2]{ 4, 1 };
+
+    LateBackend backend{ { { pages[0].data(), size * 4 }, { pages[1].data(), size } } };
+    std::vector<u8> memory(32 * 1024);
+    DWrite_StagingRing ring{ backend, memory.data(), memory.size(), 256, 512 };
+
+    for (int frame = 0; frame < 500; ++frame)
+    {
+        for (u32 i = 0, n = next() % 24; i < n; ++i)
+        {
+            const auto page = next() % 2;
+            const auto bpp = bytesPerPixel[page];
+            const auto w = 1 + next() % 40;
+            const auto h = 1 + next() % 40;
+            const auto x = next() % (size - w);
+            const auto y = next() % (size - h);
+
+            u32 rowPitch = 0;
+            const auto p = ring.Allocate(page, { x, y, x + w, y + h }, bpp, rowPitch);
+            if (!CHECK(p && rowPitch % 256 == 0 && offsetOf(memory, p) % 512 == 0))
+            {
+                return;
+            }
+            CHECK(offsetOf(memory, p) + static_cast<size_t>(rowPitch) * (h - 1) + w * bpp <= memory.size());
+
+            for (u32 row = 0; row < h; ++row)
+            {
+                for (u32 col = 0; col < w * bpp; ++col)
+                {
+                    const auto v = static_cast<u8>(next());
+                    p[row * rowPitch + col] = v;
+                    expected[page][(y + row) * size * bpp + x * bpp + col] = v;
+                }
+            }
+        }
+
+        ring.Flush();
+        // The GPU lags one or two frames behind.
+        if (backend.submitted > 2)
+        {
+            backend.Complete(backend.submitted - 1 - next() % 2);
+        }
+        ring.Reclaim();
+    }
+
+    backend.Complete(backend.submitted);
+    ring.Reclaim();
+    CHECK(ring.UsedBytes() == 0);
+    CHECK(ring.Stats().stalls > 0 && ring.Stats().stalls == backend.waits);
+    CHECK(pages[0] == expected[0]);
+    CHECK(pages[1] == expected[1]);
+}
+
+int main()
+{
+    testAlignmentAndWrapping();
+    testWrapPaddingIsFreed();
+    testBatchLayout();
+    testStallCounting();
+    testPixels();
+    return CheckResult();
+}
@@ -0,0 +1,102 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+// Measures how DWrite_ThreadPool::ParallelFor() scales with the number of threads on a compositor-sized workload:
+// DWrite_CompositeGrayscale() of a full coverage layer into a 4K target. The "uniform" run has text everywhere,
+// so every tile costs about the same. In the "sparse" run only every 8th row of tiles has text and the rest is
+// empty coverage, which the span functions skip, so the threads only stay busy if they steal from each other.
+//
+// Usage: thread_pool_bench [width] [height] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "compositor.h"
+#include "dwrite.h"
+
+// Composites fn() per repetition into a fresh copy of the background and returns the fastest time in milliseconds.
+template<typename T>
+static double measure(const std::vector<u32>& background, std::vector<u32>& dst, int repetitions, const T& fn)
+{
+    auto best = 1e300;
+
+    for (int i = 0; i < repetitions; ++i)
+    {
+        dst = background;
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, std::chrono::duration<double, std::milli>(elapsed).count());
+    }
+
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    const u32 width = argc > 1 ? static_cast<u32>(std::max(1, atoi(argv[1]))) : 3840;
+    const u32 height = argc > 2 ? static_cast<u32>(std::max(1, atoi(argv[2]))) : 2160;
+    const int repetitions = argc > 3 ? std::max(1, atoi(argv[3])) : 20;
+    const size_t pixels = static_cast<size_t>(width) * height;
+
+    std::mt19937 rng{ 1 };
+    std::vector<u8> uniform(pixels);
+    std::vector<u8> sparse(pixels);
+    std::vector<u32> background(pixels);
+    for (size_t i = 0; i < pixels; ++i)
+    {
+        const auto tileRow = i / width / DWrite_DefaultTileSize.y;
+        uniform[i] = static_cast<u8>(rng());
+        sparse[i] = tileRow % 8 == 0 ? uniform[i] : 0;
+        background[i] = static_cast<u32>(rng()) | 0xff000000;
+    }
+
+    DWrite_BlendParams params;
+    DWrite_GetGammaRatiosForEncodedTarget(1.8f, params.gammaRatios);
+    params.foregroundColor = { 0.675f, 0.6f, 0.225f, 0.75f };
+
+    std::vector<u32> dst;
+    const DWrite_Bitmap<u32> target{ nullptr, width, height, width };
+
+    printf("%ux%u target, %ux%u tiles, best of %d, %u hardware threads\n", width, height, DWrite_DefaultTileSize.x, DWrite_DefaultTileSize.y, repetitions, std::thread::hardware_concurrency());
+    printf("threads  uniform ms  uniform Gpx/s  speedup  sparse ms  sparse Gpx/s  speedup\n");
+
+    double baseline[2]{};
+
+    for (const u32 threadCount : { 1u, 2u, 4u, 8u, 16u, 32u })
+    {
+        DWrite_ThreadPool pool{ threadCount };
+        double ms[2]{};
+
+        for (int i = 0; i < 2; ++i)
+        {
+            const DWrite_Bitmap<const u8> coverage{ i == 0 ? uniform.data() : sparse.data(), width, height, width };
+            ms[i] = measure(background, dst, repetitions, [&]() {
+                auto t = target;
+                t.pixels = dst.data();
+                DWrite_CompositeGrayscale(pool, params, coverage, t);
+            });
+            if (threadCount == 1)
+            {
+                baseline[i] = ms[i];
+            }
+        }
+
+        printf("%7u  %10.3f  %13.2f  %6.2fx  %9.3f  %12.2f  %6.2fx\n",
+               threadCount,
+               ms[0],
+               static_cast<double>(pixels) / ms[0] * 1e-6,
+               baseline[0] / ms[0],
+               ms[1],
+               static_cast<double>(pixels) / ms[1] * 1e-6,
+               baseline[1] / ms[1]);
+    }
+
+    return 0;
+}